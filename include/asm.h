@@ -2,9 +2,22 @@
 #define ASM_H
 
 #include "common.h"
+#include "config.h"
+#if EVSIM
+#include "sim.h"
+#endif
 
 #define ALWAYS_INLINE inline __attribute__((always_inline))
 
+#if EVSIM
+#define maccess(P) ((void)sim_access((const void *)(P)))
+
+#define _mwrite(P, V)                                                          \
+    do {                                                                       \
+        *(P) = (V);                                                            \
+        (void)sim_access((const void *)(P));                                   \
+    } while (0)
+#else
 #define maccess(P)                            \
     do {                                      \
         typeof(*(P)) _NO_USE;                 \
@@ -21,6 +34,7 @@
                              : "r"((V))                                        \
                              : "memory");                                      \
     } while (0)
+#endif // EVSIM
 
 #define _force_addr_calc(P)                   \
     do {                                      \
@@ -37,18 +51,26 @@ static ALWAYS_INLINE void _nop(void)
 
 static ALWAYS_INLINE void _clflush(void *addr)
 {
+#if EVSIM
+    sim_flush(addr);
+#else
     __asm__ __volatile__("clflush (%0)"
                          : 
                          : "r"(addr) 
                          : "memory");
+#endif
 }
 
 static ALWAYS_INLINE void _clflushopt(void *addr)
 {
+#if EVSIM
+    sim_flush(addr);
+#else
     __asm__ __volatile__("clflushopt (%0)"
                          : 
                          : "r"(addr) 
                          : "memory");
+#endif
 }
 
 static ALWAYS_INLINE void _mfence()
@@ -72,8 +94,29 @@ static ALWAYS_INLINE void compiler_barrier(void)
     __asm__ __volatile__("" ::: "memory");
 }
 
+static ALWAYS_INLINE void _pause(void)
+{
+    __asm__ __volatile__("pause" ::: "memory");
+}
+
+/*
+  tpause in C0.1 (ecx = 1, the faster wake-up) until the tsc reaches
+  @p deadline or the OS limit (IA32_UMWAIT_CONTROL) expires. needs WAITPKG,
+  encoded by hand for older assemblers
+*/
+static ALWAYS_INLINE void _tpause(u64 deadline)
+{
+    __asm__ __volatile__(".byte 0x66, 0x0f, 0xae, 0xf1"
+                         :
+                         : "c"(1), "a"((u32)deadline), "d"((u32)(deadline >> 32))
+                         : "memory", "cc");
+}
+
 static ALWAYS_INLINE u64 _rdtsc(void)
 {
+#if EVSIM
+    return sim_rdtsc();
+#else
     u64 rax;
     __asm__ __volatile__(
         "rdtsc\n\t"
@@ -83,6 +126,7 @@ static ALWAYS_INLINE u64 _rdtsc(void)
         :: "rdx", "memory", "cc"
     );
     return rax;
+#endif
 }
 
 /*
@@ -94,6 +138,10 @@ static ALWAYS_INLINE u64 _rdtsc(void)
 */
 static ALWAYS_INLINE u64 _rdtscp_aux(u32 *aux)
 {
+#if EVSIM
+    *aux = sim_core_id();
+    return sim_rdtsc();
+#else
     u64 rax;
     __asm__ __volatile__("rdtscp\n\t"
                          "shl $32, %%rdx\n\t"
@@ -104,11 +152,15 @@ static ALWAYS_INLINE u64 _rdtscp_aux(u32 *aux)
                          :
                          : "rcx", "rdx", "memory", "cc");
     return rax;
+#endif
 }
 
 // https://github.com/google/highwayhash/blob/master/highwayhash/tsc_timer.h
 static ALWAYS_INLINE u64 timer_start(void)
 {
+#if EVSIM
+    return sim_rdtsc();
+#else
     u64 t;
     __asm__ __volatile__("mfence\n\t"
                          "lfence\n\t"
@@ -120,10 +172,14 @@ static ALWAYS_INLINE u64 timer_start(void)
                          :
                          : "rdx", "memory", "cc");
     return t;
+#endif
 }
 
 static ALWAYS_INLINE u64 timer_stop(void)
 {
+#if EVSIM
+    return sim_rdtsc();
+#else
     u64 t;
     __asm__ __volatile__("rdtscp\n\t"
                          "shl $32, %%rdx\n\t"
@@ -133,6 +189,24 @@ static ALWAYS_INLINE u64 timer_stop(void)
                          :
                          : "rcx", "rdx", "memory", "cc");
     return t;
+#endif
+}
+
+// reads performance counter @p idx. the simulator has no PMU, so it
+// counts virtual cycles
+static ALWAYS_INLINE u64 _rdpmc(u32 idx)
+{
+#if EVSIM
+    (void)idx;
+    return sim_rdtsc();
+#else
+    u32 lo, hi;
+    __asm__ __volatile__("rdpmc"
+                         : "=a"(lo), "=d"(hi)
+                         : "c"(idx)
+                         : "memory");
+    return lo | ((u64)hi << 32);
+#endif
 }
 
 static ALWAYS_INLINE u64 _timer_warmup(void)
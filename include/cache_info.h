@@ -26,6 +26,7 @@ typedef struct { // all sizes in Bytes
 extern CacheInfo l1_info, l2_info, l3_info;
 
 extern u32 g_n_uncertain_l2_sets;
+extern u32 g_page_shift; // bits of a physical address known from a virtual one
 extern u64 g_l3_cnt;
 
 typedef struct {
@@ -38,6 +39,12 @@ typedef struct {
         l2_thresh,
         l3_thresh,
         interrupt_thresh;
+
+    // calibrated P(lat >= thresh) for hits and misses of a level (SPRT)
+    f64 l2_hit_otp,
+        l2_miss_otp,
+        l3_hit_otp,
+        l3_miss_otp;
 } CacheLats; // latencies
 
 i32 calc_unknown_sib(CacheInfo* c);
@@ -52,7 +59,7 @@ void init_cache_info(void);
 
 static u64 ALWAYS_INLINE cache_uncertainty(CacheInfo* c)
 {
-    u64 bits_under_ctrl = PAGE_SHIFT;
+    u64 bits_under_ctrl = g_page_shift;
     u64 set_bits_under_ctrl = bits_under_ctrl - c->n_cl_bits;
     if (set_bits_under_ctrl >= c->n_set_idx_bits) {
         return c->n_slices;
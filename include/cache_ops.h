@@ -73,6 +73,193 @@ static ALWAYS_INLINE void access_array(u8 **addrs, u64 size)
    }
 }
 
+// one window of prime_cands_pattern. dbl walks it back in the other direction
+static ALWAYS_INLINE void access_window(u8 **addrs, u64 size, bool bwd, bool dbl)
+{
+    if (bwd)
+        access_array_bwd(addrs, size);
+    else
+        access_array(addrs, size);
+
+    if (dbl) {
+        if (bwd)
+            access_array(addrs, size);
+        else
+            access_array_bwd(addrs, size);
+    }
+}
+
+/*
+  prime_cands_daniel with the traversal direction and a return walk over each
+  window as knobs, for the prime autotuner (prime.h). bwd && !dbl is
+  prime_cands_daniel
+*/
+static ALWAYS_INLINE void prime_cands_pattern(u8 **cands, u64 cnt, u64 repeat,
+                                              u64 stride, u64 block, bool bwd, bool dbl)
+{
+    if (bwd && !dbl) {
+        prime_cands_daniel(cands, cnt, repeat, stride, block);
+        return;
+    }
+
+    block = _min(block, cnt);
+    for (u64 s = 0; s < cnt; s += stride) {
+        for (u64 c = 0; c < repeat; c++) {
+            if (cnt >= block + s) {
+                access_window(&cands[s], block, bwd, dbl);
+            } else {
+                u32 rem = cnt - s;
+                access_window(&cands[s], rem, bwd, dbl);
+                access_window(cands, block - rem, bwd, dbl);
+            }
+        }
+    }
+}
+
+/*
+  page-index variants of the kernels above (see EvIdx): line i is
+  base + (idxs[i] << PAGE_SHIFT), decoded on the fly
+*/
+static ALWAYS_INLINE u8 *idx_line(u8 *base, u32 idx)
+{
+    return base + ((u64)idx << PAGE_SHIFT);
+}
+
+static inline void flush_idx(u8 *base, u32 *idxs, u64 size)
+{
+    for (u64 i = 0; i < size; i++)
+        _clflushopt(idx_line(base, idxs[i]));
+}
+
+static inline void access_idx_bwd(u8 *base, u32 *idxs, u64 size)
+{
+    for (u64 i = size; i > 0; i--)
+        maccess(idx_line(base, idxs[i - 1]));
+}
+
+static ALWAYS_INLINE void access_idx(u8 *base, u32 *idxs, u64 size)
+{
+    for (u64 i = 0; i < size; i++)
+        maccess(idx_line(base, idxs[i]));
+}
+
+static ALWAYS_INLINE void prime_idx_daniel(u8 *base, u32 *idxs, u64 cnt,
+                                           u64 repeat, u64 stride, u64 block)
+{
+    block = _min(block, cnt);
+    for (u64 s = 0; s < cnt; s += stride) {
+        for (u64 c = 0; c < repeat; c++) {
+            if (cnt >= block + s) {
+                access_idx_bwd(base, &idxs[s], block);
+            } else {
+                u32 rem = cnt - s;
+                access_idx_bwd(base, &idxs[s], rem);
+                access_idx_bwd(base, idxs, block - rem);
+            }
+        }
+    }
+}
+
+static ALWAYS_INLINE void access_idx_window(u8 *base, u32 *idxs, u64 size,
+                                            bool bwd, bool dbl)
+{
+    if (bwd)
+        access_idx_bwd(base, idxs, size);
+    else
+        access_idx(base, idxs, size);
+
+    if (dbl) {
+        if (bwd)
+            access_idx(base, idxs, size);
+        else
+            access_idx_bwd(base, idxs, size);
+    }
+}
+
+// prime_cands_pattern over a page index
+static ALWAYS_INLINE void prime_idx_pattern(u8 *base, u32 *idxs, u64 cnt, u64 repeat,
+                                            u64 stride, u64 block, bool bwd, bool dbl)
+{
+    if (bwd && !dbl) {
+        prime_idx_daniel(base, idxs, cnt, repeat, stride, block);
+        return;
+    }
+
+    block = _min(block, cnt);
+    for (u64 s = 0; s < cnt; s += stride) {
+        for (u64 c = 0; c < repeat; c++) {
+            if (cnt >= block + s) {
+                access_idx_window(base, &idxs[s], block, bwd, dbl);
+            } else {
+                u32 rem = cnt - s;
+                access_idx_window(base, &idxs[s], rem, bwd, dbl);
+                access_idx_window(base, idxs, block - rem, bwd, dbl);
+            }
+        }
+    }
+}
+
+/*
+  pointer-chasing layout (see evset_chain): every line of the evset holds the
+  next and prev line, so a traversal is one serialised chain of dependent
+  loads, with no index array to read and nothing for the prefetcher to run
+  ahead on
+*/
+typedef struct eviction_chain {
+    struct eviction_chain *next;
+    struct eviction_chain *prev;
+} evchain;
+
+// loads the link of @p node, the only access to the line
+static ALWAYS_INLINE evchain *chase_next(evchain *node)
+{
+#if EVSIM
+    (void)sim_access(node);
+    return node->next;
+#else
+    evchain *n;
+    __asm__ __volatile__("mov (%1), %0\n" : "=r"(n) : "r"(node) : "memory");
+    return n;
+#endif
+}
+
+static ALWAYS_INLINE evchain *chase_prev(evchain *node)
+{
+#if EVSIM
+    (void)sim_access(node);
+    return node->prev;
+#else
+    evchain *p;
+    __asm__ __volatile__("mov 8(%1), %0\n" : "=r"(p) : "r"(node) : "memory");
+    return p;
+#endif
+}
+
+// @p cnt hops from @p head, returns where it stopped
+static ALWAYS_INLINE evchain *chase_fwd(evchain *head, u64 cnt)
+{
+    for (u64 i = 0; i < cnt; i++)
+        head = chase_next(head);
+    return head;
+}
+
+// @p head first, then backwards from the tail
+static ALWAYS_INLINE evchain *chase_bwd(evchain *head, u64 cnt)
+{
+    for (u64 i = 0; i < cnt; i++)
+        head = chase_prev(head);
+    return head;
+}
+
+// latency of one walk over the whole chain, the chain counterpart of timing access_array
+static ALWAYS_INLINE u64 time_chase(evchain *head, u64 cnt, bool bwd)
+{
+    u64 start = lat_start();
+    evchain *end = bwd ? chase_bwd(head, cnt) : chase_fwd(head, cnt);
+    _force_addr_calc(end);
+    return lat_since(start);
+}
+
 void traverse_cands_mt(u8 **cands, u64 cnt, EvBuildConf* tconf);
 
 #ifdef __cplusplus
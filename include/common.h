@@ -37,6 +37,8 @@ typedef double f64;
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define PAGE_SIZE          (1<<12) // 4KiB
 #define PAGE_SHIFT         12      // for 4KiB regular pages
+#define HUGE_PAGE_SIZE     (1<<21) // 2MiB
+#define HUGE_PAGE_SHIFT    21
 #define CORE_PIN_ID        3
 #define MAX_ITERATIONS     1000
 #define DEF_LAT_REPS       350     // default n_iteration for caches' latency measurement
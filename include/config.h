@@ -9,6 +9,12 @@
 #define SANITY_CHECK_ALL_EVS 0
 #endif
 
+// run against the software cache simulator (sim.h) instead of hardware.
+// the simulated host is configured through $EVSIM_CONF
+#ifndef EVSIM
+#define EVSIM 0
+#endif
+
 // enable custom eviction percentage experiment (-G 3)
 #ifndef XP_EV_PCT
 #define XP_EV_PCT 0
@@ -54,6 +60,13 @@ typedef enum EvTestRes {
     EV_POS = 2
 } EvTestRes;
 
+typedef enum HugeMode {
+    HUGE_OFF = 0,
+    HUGE_GUEST,     // EvBuffers on 2MiB pages (TLB reach only)
+    HUGE_HOST       // host backs guest memory with 2MiB pages too: set bits
+                    // below HUGE_PAGE_SHIFT are known
+} HugeMode;
+
 typedef struct {
     CacheLevel cache_level;
     u32 num_threads;
@@ -65,6 +78,12 @@ typedef struct {
     u32 evsets_per_l2;         // -f N: eviction sets per L2 set
     bool granular;             // per-set evset construction and not per-offset
     u32 cand_scaling;          // cand scaling factor
+    u32 ev_algo;               // --algo: EvAlgoType for evset construction
+    f64 sprt_conf;             // --sprt: eviction test confidence, 0 = bounded test
+    u32 huge_pages;            // --huge/--host-huge: HugeMode
+    u32 timer_src;             // --timer: TimerSrc for latency measurements
+    u32 filter_batch;          // --filter: candidates per L2 filtering batch, 1 = sequential, 0 = auto
+    bool stats_json;           // --stats=json: hot-path counter report
     i32 vtop_freq;         // period vTop checking interval in microsecs
 } ArgConf;
 
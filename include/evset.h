@@ -10,24 +10,54 @@ extern "C" {
 #endif
 
 typedef enum {
-    STRAW_ZHAO = 0
+    STRAW_ZHAO = 0,
+    GROUP_TEST,     // group testing reduction
+    BIN_SEARCH,     // one line per binary search (Prime+Scope)
+    N_EV_ALGOS
 } EvAlgoType;
 
 typedef struct {
     void *buf;
-    u64 n_pages,
+    u64 n_pages,    // in 4KiB pages, whatever the backing
         ref_cnt;
+    u64 stride,     // distance between candidate lines of one page offset
+        skew,       // offset of the first candidate page
+        n_cands;
+    bool huge;      // mapped through mmap_huge
+    u64 n_released; // pages given back with evbuffer_release
 } EvBuffer;
 
+/*
+  compact form of an addrs array whose lines all live in one EvBuffer at the
+  same page offset: line i is base + (idxs[i] << PAGE_SHIFT). half the
+  footprint of u8* arrays in the probe loops
+*/
+typedef struct {
+    u8 *base;   // evb->buf + page offset
+    u32 *idxs;  // page index into evb->buf
+    u64 count,
+        cap;
+} EvIdx;
+
+// page-aligned candidates, shared read-only by the offset views of one set
+typedef struct {
+    u8 **bases;
+    u64 count,
+        ref_cnt;
+} EvCandPages;
+
 typedef struct {
     u32 cand_scale; // scaling factor for candidate set size (-c arg)
 
     EvBuffer *evb;
 
-    u8 **addrs;
+    u8 **addrs;     // NULL on a view until evcands_materialize
     u64 count,
         ref_cnt;
     CacheInfo* cache;
+
+    EvCandPages *pages; // set on offset views (evcands_view)
+    u32 offset;         // page offset of the view
 } EvCands;
  
 typedef struct _ev_build_conf {
@@ -49,6 +79,9 @@ typedef struct _ev_build_conf {
     u32 max_whole_ret;
     u32 block;
     u32 stride;
+    f64 sprt_conf;             // (0, 1): SPRT decision at this confidence
+    f64 p_hit_otp;             // P(lat >= lat_thresh) when not evicted
+    f64 p_miss_otp;            // P(lat >= lat_thresh) when evicted
     
     struct _evset *lower_ev;   // for L3
     
@@ -76,9 +109,17 @@ typedef struct _ev_build_conf {
     /* PRUNING ALGO CONF */
 } EvBuildConf;
 
+// one timing over the whole evset instead of one per line (--probe group)
+typedef struct {
+    u32 thresh,     // above: something was evicted. 0: not calibrated
+        base,       // median latency of the untouched set
+        miss;       // extra latency of one evicted line
+    bool exact;     // evictions seen, probe line by line until it is quiet again
+} EvGrpProbe;
+
 typedef struct _evset {
     /* EVSET CONF */
-    u8 **addrs;      // evset addresses
+    u8 **addrs;      // evset addresses, NULL while dropped (compact_color_evsets)
     u32 size; // num of addresses in evset
     u32 ev_cap; // cap_scaling * n_ways
     u8* target_addr;
@@ -91,6 +132,10 @@ typedef struct _evset {
 
     EvBuildConf *build_conf;
     CacheInfo *target_cache; // e.g. l2_info, l3_info
+
+    EvIdx idx;               // compact addrs, filled by evset_compact
+    struct eviction_chain *chain; // links in the lines, set by evset_chain
+    EvGrpProbe grp;
 } EvSet;
 
 typedef struct {
@@ -116,11 +161,6 @@ typedef struct {
     u64 last_topo_check;           // timestamp of last topology check
 } vtop_thread_pair;
 
-typedef struct eviction_chain {
-    struct eviction_chain *next;
-    struct eviction_chain *prev;
-} evchain;
-
 /*
   to be iteratively called by build_l2_evset to construct one evset
   for all uncertain sets in L2. further shifts for each offset to get all evsets
@@ -137,7 +177,9 @@ void *vtop_main_thread_worker(void *arg);
 
 EvCands ***build_evcands_all(EvBuildConf *conf, EvSet ***l2evsets);
 
-EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets);
+// pools only for the colors below @p n_used (0: all), see evcands_stream_colors
+EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets,
+                                  u32 n_used);
 
 /*
  * modified: https://github.com/zzrcxb/LLCFeasible/
@@ -160,23 +202,157 @@ EvRes test_eviction(u8 *target, u8 **cands, u64 cnt, EvBuildConf *tconf);
 EvTestRes test_eviction_detailed(u8 *target, u8 **cands, u64 cnt,
                                  EvBuildConf *tconf);
 
+// as test_eviction_detailed, reporting the valid trials used in @p n_trials
+EvTestRes test_eviction_counted(u8 *target, u8 **cands, u64 cnt,
+                                EvBuildConf *tconf, u32 *n_trials);
+
 bool build_evset_zhao(u8 *target, EvSet *evset);
 
+bool build_evset_gt(u8 *target, EvSet *evset);
+
+bool build_evset_bs(u8 *target, EvSet *evset);
+
+// dispatches on evset->build_conf->algo. true on error
+bool build_evset(u8 *target, EvSet *evset);
+
+// "zhao", "gt" or "bs"; -1 if unknown
+i32 ev_algo_parse(const char *name);
+
+const char *ev_algo_name(EvAlgoType algo);
+
 void addrs_traverse(u8 **cands, u64 cnt, EvBuildConf *tconf);
 
 EvRes verify_evset(EvSet* evset, u8* target);
 
+// candidates per filtering batch, 1: sequential. 0 until evcands_filter_init
+extern u32 g_filter_batch;
+
+// @p batch_sz candidates per test, 0: n_ways - 1
 void evcands_filter_batch(u8** addrs, u64 total_cands, u64* filtered_count,
-                          EvSet* filter_ev, EvBuildConf* conf);
+                          EvSet* filter_ev, EvBuildConf* conf, u64 batch_sz);
+
+/*
+  moves the candidates @p filter_ev evicts to the front of @p addrs and
+  returns their count. batches of @p batch_sz, or one test_eviction per
+  candidate when it is 1
+*/
+u64 evcands_filter(u8 **addrs, u64 cnt, EvSet *filter_ev, EvBuildConf *conf,
+                   u64 batch_sz);
+
+/*
+  sets g_filter_batch on first use: from --filter, or by timing each batch size
+  on a sample of @p addrs against @p filter_ev and re-testing the positives.
+  some uarchs (e.g. Ice Lake, large Xeon Platinum LLCs) lose lines in batches
+*/
+void evcands_filter_init(u8 **addrs, u64 cnt, EvSet *filter_ev, EvBuildConf *conf);
+
+// "auto" (0), "seq" (1) or a batch size; -1 if invalid
+i32 filter_batch_parse(const char *arg);
 
 u64 prune_evcands(u8 *target, u8 **cands, u64 cnt, EvBuildConf *tconf);
 
+/*
+  sorts @p cnt lines into the colors (uncertain L2 sets) of @p filters in one
+  sweep, testing each batch of @p batch_sz against all filters. trials that
+  migrated and samples over the interrupt threshold are dropped as in
+  test_eviction. colors[i] gets the color of addrs[i], or n_colors if it
+  could not be told
+*/
+void evcands_classify(u8 **addrs, u64 cnt, EvSet **filters, u32 n_colors,
+                      u32 *colors, EvBuildConf *conf, u64 batch_sz);
+
+/*
+  candidate pools of the first @p n_used of @p n_colors colors, color c at page
+  offset c, the others NULL. pages are faulted in and classified a chunk at a
+  time until every pool holds its share of the LLC candidates, and the ones no
+  pool takes are released again. NULL on error
+*/
+EvCands **evcands_stream_colors(EvBuildConf *conf, EvSet ***l2evsets,
+                                u32 n_colors, u32 n_used);
+
+/*
+  swaps the lines of @p evset that no longer evict its target for congruent
+  ones from evset->cands. true on error, the evset is then left unchanged
+*/
+bool repair_evset(EvSet *evset);
+
 EvSet* evset_shift(EvSet* from, u32 offset);
 
 EvCands* evcands_shift(EvCands* from, u32 offset);
 
+/*
+  lazy counterpart of evcands_shift: shares a page-base array with every
+  other view of @p from and only allocates addrs on evcands_materialize.
+  @p from must not be permuted concurrently while its first view is made
+*/
+EvCands *evcands_view(EvCands *from, u32 offset);
+
+// true on error. no-op for non-view or already materialized cands
+bool evcands_materialize(EvCands *cands);
+
+/*
+  encodes @p cnt addrs of @p evb into @p idx, reusing idx->idxs if it is large
+  enough. true on error: an addr outside evb or at a different page offset
+*/
+bool evidx_encode(EvIdx *idx, u8 **addrs, u64 cnt, EvBuffer *evb);
+
+void evidx_free(EvIdx *idx);
+
+static inline u8 *evidx_at(const EvIdx *idx, u64 i)
+{
+    return idx->base + ((u64)idx->idxs[i] << PAGE_SHIFT);
+}
+
+// (re)encodes evset->addrs; call again after addrs change. true on error
+bool evset_compact(EvSet *evset);
+
+/*
+  links the lines of @p evset into a circular evchain in addrs order, written
+  into the first 16 bytes of each line, and flushes them so that they are not
+  dirty. lines of different evsets never overlap, each line being congruent to
+  one set only. call again after addrs change. true on error
+*/
+bool evset_chain(EvSet *evset);
+
+// evset_chain over a color range, as compact_color_evsets. returns failures
+u32 chain_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                       u32 start_color, u32 num_colors);
+
+/*
+  evset_compact over a color range, as attach_helper_to_evsets. the pointer
+  arrays of the sets that compact are freed, the monitoring loops only go
+  through the index; expand_color_evsets brings them back. returns failures
+*/
+u32 compact_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                         u32 start_color, u32 num_colors);
+
+// rebuilds evset->addrs from the index if it was dropped. true on error
+bool evset_expand(EvSet *evset);
+
+// evset_expand over a color range, before the sets leave the monitoring loops
+u32 expand_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                        u32 start_color, u32 num_colors);
+
+// line @p i of @p evset, from the index once the pointer array is dropped
+static inline u8 *evset_at(EvSet *evset, u64 i)
+{
+    return evset->addrs ? evset->addrs[i] : evidx_at(&evset->idx, i);
+}
+
+static inline u8 *evcands_at(EvCands *cands, u64 i)
+{
+    return cands->addrs ? cands->addrs[i]
+                        : cands->pages->bases[i] + cands->offset;
+}
+
 EvBuffer *evbuffer_new(CacheInfo *cache, EvBuildConf *cand_conf);
 
+// room for @p n_cands candidate pages, faulted in only once they are touched
+EvBuffer *evbuffer_reserve(CacheInfo *cache, u64 n_cands);
+
+// gives candidate pages [first, first + cnt) back to the kernel. true on error
+bool evbuffer_release(EvBuffer *evb, u64 first, u64 cnt);
+
 EvCands *evcands_new(CacheInfo *cache, EvBuildConf *cands_config, EvBuffer *evb);
 
 // bool evcands_populate(u32 offset, EvCands *cands, EvBuildConf *config);
@@ -190,6 +366,13 @@ void evbuffer_free(EvBuffer *evb);
 void free_evset_complex(EvSet ****complex, u32 num_offsets,
                         u32 num_l2_sets, u32 evsets_per_l2);
 
+// frees every candidate complex build_evcands_all_para returned. only once no
+// evset built from them is used anymore
+void release_evcands_complexes(void);
+
+// complexes built and not released yet
+u32 evcands_complexes_held(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,6 +27,8 @@ typedef struct {
     EvCands*** l3_cands;
 
     u32 *idxs;                     // offset indices
+    struct _gran_pair_assignment *gran; // all pairs' work, for stealing
+    u32 n_pairs;
     u32 n_uncertain_l2_sets;
     u32 evsets_per_l2;
     EvBuildConf l3_conf;
@@ -69,10 +71,18 @@ typedef struct {
 } gran_work_assignment_t;
 
 // thread pair assignment
-typedef struct {
+typedef struct _gran_pair_assignment {
     gran_work_assignment_t *assignments;
     u32 n_assignments;
     u32 pair_idx;
+
+    // deque over assignments: the owner takes from head, other pairs steal from tail
+    pthread_mutex_t lock;
+    u32 head,
+        tail;
+    u32 n_done,
+        n_stolen;       // done items taken from other pairs
+    u64 busy_us;
 } gran_pair_assignment_t;
 
 typedef struct {
@@ -105,6 +115,11 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
 
 u32 find_optimal_vcpu_pairs(cpu_topology_t *topo, u32 n_requested_pairs, vcpu_pair_assignment_t *pair_assignments);
 
+// round-robin vCPU for threads pinned without vtop
+u32 get_next_core_id(u32 max_cores);
+
+void reset_core_id_counter(void);
+
 // main worker function for topology-aware parallel threads
 void *vtop_para_thread_worker(void *arg);
 
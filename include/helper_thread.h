@@ -2,115 +2,191 @@
 
 #include "common.h"
 #include "asm.h"
+#include "stats.h"
 #include <pthread.h>
+#include <stdatomic.h>
 
 struct _ev_build_conf;
 struct _evset;
 typedef struct _evset EvSet;
 
+#define HELPER_RING_SIZE 16 // power of two
+#define HELPER_IDLE_US 10000 // empty-ring time before the helper sleeps
+#define HELPER_POLLS (1 << 10) // empty-ring polls between clock reads
+
 typedef enum {
     HELPER_STOP,
     READ_SINGLE,
     TIME_SINGLE,
     READ_ARRAY,
-    TRAVERSE_CANDS
+    READ_IDX,
+    TRAVERSE_CANDS,
+    WAIT_UNTIL
 } helper_thread_action;
 
+struct helper_thread_read_array {
+    u8 **addrs;
+    u64 cnt, repeat, stride, block;
+    bool bwd, dbl;
+};
+
+// READ_ARRAY over a page index (EvIdx), u32 counts to stay in the slot
+struct helper_thread_read_idx {
+    u8 *base;
+    u32 *idxs;
+    u32 cnt, repeat, stride, block;
+    bool bwd, dbl;
+};
+
+struct _evtest_config;
+
+struct helper_thread_traverse_cands {
+    void (*traverse)(u8 **cands, u64 cnt, struct _ev_build_conf *c);
+    u8 **cands;
+    u64 cnt;
+    struct _ev_build_conf *tconfig;
+};
+
+// one ring slot, a cache line of its own
+typedef union {
+    struct {
+        helper_thread_action action;
+        u64 lat; // TIME_SINGLE result
+        union {
+            u8 *line;
+            struct helper_thread_read_array arr;
+            struct helper_thread_read_idx ridx;
+            struct helper_thread_traverse_cands trav;
+            u64 deadline; // WAIT_UNTIL, a tsc value
+        };
+    };
+    u8 _line[CL_SIZE];
+} helper_cmd;
+
+/*
+  single-producer/single-consumer command ring. the main thread fills slots
+  [head, head + n) and publishes them with one store to head, the helper runs
+  them in order and publishes tail once the whole batch is done. head, tail
+  and the slots sit on separate cache lines, so neither side spins on a line
+  the other one writes to in between. a batch holds at most HELPER_RING_SIZE
+  commands. a helper that finds the ring empty for HELPER_IDLE_US sets
+  sleeping and blocks on it (futex), the next submit wakes it. the gaps
+  between the commands of a build stay well below that, so only idle
+  periods pay for the wake-up
+*/
 typedef struct {
-    bool running;
-    volatile bool waiting;
-    volatile helper_thread_action action;
-    void * volatile payload;
-    u64 lat;
+    _Alignas(CL_SIZE) _Atomic u64 head;   // written by the main thread only
+    _Alignas(CL_SIZE) _Atomic u64 tail;   // written by the helper only
+    _Atomic u64 ready;
+    _Atomic u32 sleeping;
+    _Alignas(CL_SIZE) helper_cmd slots[HELPER_RING_SIZE];
+    _Alignas(CL_SIZE) bool running;
     pthread_t pid;
     i32 core_id;
 } helper_thread_ctrl;
 
 void *helper_thread_worker(void * _args);
 
+void helper_wake(helper_thread_ctrl *ctrl);
+
 static ALWAYS_INLINE void wait_helper_thread(helper_thread_ctrl *ctrl)
 {
-    while (!ctrl->waiting);
+    u64 head = atomic_load_explicit(&ctrl->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ctrl->tail, memory_order_acquire) != head);
 }
 
-static ALWAYS_INLINE bool start_helper_thread(helper_thread_ctrl *ctrl)
+/*
+  slot of the @p i-th command of the batch being filled. waits while it is
+  still owned by the helper (ring full)
+*/
+static ALWAYS_INLINE helper_cmd *helper_cmd_slot(helper_thread_ctrl *ctrl, u32 i)
 {
-    ctrl->waiting = false;
-    compiler_barrier();
+    assert(i < HELPER_RING_SIZE); // the helper never frees unsubmitted slots
+    u64 pos = atomic_load_explicit(&ctrl->head, memory_order_relaxed) + i;
+    while (pos - atomic_load_explicit(&ctrl->tail, memory_order_acquire) >= HELPER_RING_SIZE);
+    return &ctrl->slots[pos & (HELPER_RING_SIZE - 1)];
+}
+
+// hands the first @p n filled slots to the helper
+static ALWAYS_INLINE void helper_submit(helper_thread_ctrl *ctrl, u32 n)
+{
+    assert(n <= HELPER_RING_SIZE);
+    u64 head = atomic_load_explicit(&ctrl->head, memory_order_relaxed);
+    atomic_store_explicit(&ctrl->head, head + n, memory_order_seq_cst);
+    if (atomic_load_explicit(&ctrl->sleeping, memory_order_seq_cst))
+        helper_wake(ctrl);
+    stats_inc(ST_HELPER_TRIPS);
+}
+
+static ALWAYS_INLINE bool start_helper_thread_pinned(helper_thread_ctrl *ctrl, i32 core_id) {
+    atomic_store(&ctrl->head, 0);
+    atomic_store(&ctrl->tail, 0);
+    atomic_store(&ctrl->ready, 0);
+    atomic_store(&ctrl->sleeping, 0);
+    ctrl->core_id = core_id;
+
     if (pthread_create(&ctrl->pid, NULL, helper_thread_worker, ctrl)) {
         perror("Failed to start the helper thread!\n");
         return true;
     }
-    wait_helper_thread(ctrl);
+
+    while (!atomic_load_explicit(&ctrl->ready, memory_order_acquire));
     ctrl->running = true;
     return false;
 }
 
+static ALWAYS_INLINE bool start_helper_thread(helper_thread_ctrl *ctrl)
+{
+    return start_helper_thread_pinned(ctrl, ctrl->core_id);
+}
+
 static ALWAYS_INLINE void stop_helper_thread(helper_thread_ctrl *ctrl)
 {
     if (ctrl->running) {
-        ctrl->action = HELPER_STOP;
-        compiler_barrier();
-        ctrl->waiting = false;
+        helper_cmd_slot(ctrl, 0)->action = HELPER_STOP;
+        helper_submit(ctrl, 1);
         pthread_join(ctrl->pid, NULL);
         ctrl->running = false;
     }
 }
 
-static ALWAYS_INLINE bool start_helper_thread_pinned(helper_thread_ctrl *ctrl, i32 core_id) {
-    ctrl->waiting = false;
-    ctrl->core_id = core_id;
-    compiler_barrier();
-    
-    if (pthread_create(&ctrl->pid, NULL, helper_thread_worker, ctrl)) {
-        perror("Failed to start the helper thread!\n");
-        return true;
-    }
-    
-    wait_helper_thread(ctrl);
-    ctrl->running = true;
-    return false;
-}
-
 static ALWAYS_INLINE void
 helper_thread_read_single(u8 *target, helper_thread_ctrl *ctrl) {
     assert(ctrl->running);
-    ctrl->action = READ_SINGLE;
-    ctrl->payload = target;
-    compiler_barrier();
-    ctrl->waiting = false;
+    helper_cmd *cmd = helper_cmd_slot(ctrl, 0);
+    cmd->action = READ_SINGLE;
+    cmd->line = target;
+    helper_submit(ctrl, 1);
     wait_helper_thread(ctrl);
 }
 
 static ALWAYS_INLINE u64
 helper_thread_time_single(u8 *target, helper_thread_ctrl *ctrl) {
     assert(ctrl->running);
-    ctrl->action = TIME_SINGLE;
-    ctrl->payload = target;
-    compiler_barrier();
-    ctrl->waiting = false;
+    helper_cmd *cmd = helper_cmd_slot(ctrl, 0);
+    cmd->action = TIME_SINGLE;
+    cmd->line = target;
+    helper_submit(ctrl, 1);
     wait_helper_thread(ctrl);
     _mfence();
     _lfence();
-    return ctrl->lat;
+    return cmd->lat;
 }
 
-struct helper_thread_read_array {
-    u8 ** volatile addrs;
-    volatile u64 cnt, repeat, stride, block;
-    volatile bool bwd;
-};
-
-struct _evtest_config;
-
-struct helper_thread_traverse_cands {
-    void (*volatile traverse)(u8 **cands, u64 cnt, struct _ev_build_conf *c);
-    u8 ** volatile cands;
-    u64 volatile cnt;
-    struct _ev_build_conf * volatile tconfig;
-};
+/*
+  lets the helper sleep through a prime-probe window or a scan period rather
+  than poll the ring until it blocks (HELPER_IDLE_US). returns right away,
+  commands queued behind it run after @p deadline
+*/
+static ALWAYS_INLINE void
+helper_thread_park(helper_thread_ctrl *ctrl, u64 deadline) {
+    assert(ctrl->running);
+    helper_cmd *cmd = helper_cmd_slot(ctrl, 0);
+    cmd->action = WAIT_UNTIL;
+    cmd->deadline = deadline;
+    helper_submit(ctrl, 1);
+}
 
 void attach_helper_to_evsets(EvSet ***color_sets, u32 *color_counts,
                              u32 start_color, u32 num_colors,
                              helper_thread_ctrl *hctrl);
-
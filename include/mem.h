@@ -19,12 +19,14 @@ typedef struct {
     u32 thread_id;
 } memset_thread_arg_t;
 
+// cache line aligned, so the _Alignas(CL_SIZE) members hold on the heap too
 static inline void *_calloc(u64 n_elem, u64 elem_size)
 {
-    void *p = malloc(n_elem * elem_size);
+    void *p = NULL;
 
-    if (p)
-        memset(p, 0, n_elem * elem_size);
+    if (posix_memalign(&p, CL_SIZE, n_elem * elem_size))
+        return NULL;
+    memset(p, 0, n_elem * elem_size);
 
     return p;
 }
@@ -50,6 +52,34 @@ static ALWAYS_INLINE u8 *mmap_shared_init(void *addr, size_t size, u8 init)
     return ptr;
 }
 
+/*
+  2MiB-aligned mapping of @p size (a HUGE_PAGE_SIZE multiple). tries the
+  hugetlbfs pool first, then THP on an aligned anonymous mapping. THP is only
+  a hint, so callers check the backing (count_huge_backed) after faulting in
+*/
+static ALWAYS_INLINE u8 *mmap_huge(u64 size)
+{
+    u8 *ptr = (u8*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+        return ptr;
+
+    u64 span = size + HUGE_PAGE_SIZE;
+    u8 *raw = (u8*)mmap(NULL, span, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+
+    ptr = _ALIGN_UP(raw, HUGE_PAGE_SHIFT);
+    if (ptr > raw)
+        munmap(raw, ptr - raw);
+    if (raw + span > ptr + size)
+        munmap(ptr + size, (raw + span) - (ptr + size));
+
+    madvise(ptr, size, MADV_HUGEPAGE);
+    return ptr;
+}
+
 static void *para_memset_worker(void *arg)
 {
     memset_thread_arg_t *ctx = (memset_thread_arg_t *)arg;
@@ -57,12 +87,9 @@ static void *para_memset_worker(void *arg)
     return NULL;
 }
 
-static ALWAYS_INLINE u8 *mmap_shared_init_para(void *addr, size_t size, u8 init)
+// memset split across the configured threads; also faults the pages in
+static ALWAYS_INLINE u8 *memset_para(u8 *ptr, size_t size, u8 init)
 {
-    u8 *ptr = mmap_shared(addr, size);
-    if (!ptr)
-        return NULL;
-
     u32 n_threads = g_config.num_threads ? g_config.num_threads : n_system_cores();
 
     if (n_threads < 2) {
@@ -107,6 +134,24 @@ static ALWAYS_INLINE u8 *mmap_shared_init_para(void *addr, size_t size, u8 init)
     return ptr;
 }
 
+static ALWAYS_INLINE u8 *mmap_shared_init_para(void *addr, size_t size, u8 init)
+{
+    u8 *ptr = mmap_shared(addr, size);
+    if (!ptr)
+        return NULL;
+
+    return memset_para(ptr, size, init);
+}
+
+static ALWAYS_INLINE u8 *mmap_huge_init_para(size_t size, u8 init)
+{
+    u8 *ptr = mmap_huge(size);
+    if (!ptr)
+        return NULL;
+
+    return memset_para(ptr, size, init);
+}
+
 i32 ALWAYS_INLINE same_set_stride(CacheInfo* c)
 {
     return 1 << (c->n_cl_bits + c->n_set_idx_bits);
@@ -0,0 +1,47 @@
+// prime patterns of the monitoring loops (l3_evset_prime) and their autotuner
+#ifndef PRIME_H
+#define PRIME_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _evset;
+
+#define PRIME_PROFILE_PATH "data/prime.profile"
+
+typedef struct PrimePattern {
+    u32 repeat, block, stride; // as in prime_cands_daniel, 0: the whole set
+    bool bwd,                  // backward traversal of each window
+         dbl;                  // ... and a return walk in the other direction
+    u32 max_passes;            // l3_evset_prime passes until the set reads back resident
+} PrimePattern;
+
+// used by l3_evset_prime. init_def_l3_conf values until a profile is loaded
+extern PrimePattern g_prime;
+
+// one prime pass over @p evset, on the main and the helper thread
+void prime_pattern_run(struct _evset *evset, const PrimePattern *p);
+
+/*
+  times every pattern of the search space over @p evsets and picks the fastest
+  one that leaves all lines resident in at least PRIME_TUNE_RELIABLE of the
+  trials (else the most reliable one). evsets need a running helper.
+  true on error
+*/
+bool prime_tune(struct _evset **evsets, u32 n_evsets, u32 trials, PrimePattern *best);
+
+// host profile, tied to the CPU model and LLC geometry. true on error
+bool prime_profile_save(const char *path, const PrimePattern *p);
+
+// true if missing or written on another host
+bool prime_profile_load(const char *path, PrimePattern *p);
+
+void prime_pattern_str(const PrimePattern *p, char *buf, u32 len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PRIME_H
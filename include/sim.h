@@ -0,0 +1,116 @@
+/*
+  software model of a sliced, set-associative cache hierarchy.
+  built in with -DEVSIM=1 (cmake -DEVSIM=ON): asm.h then routes maccess,
+  clflush(opt) and the rdtsc family through this backend, so the evset
+  pipeline runs unchanged against a simulated host.
+*/
+#ifndef SIM_H
+#define SIM_H
+
+#include "common.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_MAX_CORES      64
+#define SIM_MAX_HASH_BITS  8
+#define SIM_PFN_BITS       28      // 1TiB of simulated physical memory
+#define SIM_CL_SHIFT       6
+#define SIM_CONF_ENV       "EVSIM_CONF"
+
+typedef enum SimRepl {
+    SIM_REPL_LRU = 0,
+    SIM_REPL_PLRU,   // bit-PLRU (MRU bits)
+    SIM_REPL_RAND
+} SimRepl;
+
+typedef enum SimHash {
+    SIM_HASH_SKX20 = 0, // l3_slice_skx_20, 20 slices
+    SIM_HASH_XOR,       // parity of masked PA bits, power-of-two slices
+    SIM_HASH_MOD        // mixed line number modulo n_slices
+} SimHash;
+
+typedef struct {
+    u32 n_cores;              // distinct private L1/L2 pairs
+    u32 l1_sets, l1_ways;
+    u32 l2_sets, l2_ways;
+    u32 llc_sets, llc_ways;   // llc_sets is per slice
+    u32 n_slices;
+    SimHash hash;
+    u64 hash_masks[SIM_MAX_HASH_BITS];
+    u32 n_hash_masks;
+    SimRepl l2_repl,
+            llc_repl;
+
+    // latencies in (virtual) cycles
+    u32 lat_l1, lat_l2, lat_llc, lat_dram,
+        lat_tsc;              // cost of one rdtsc(p)
+
+    // noise injection
+    u32 jitter;               // uniform [0, jitter] added to every access
+    f64 spike_p;              // probability of an interrupt-like spike
+    u32 spike_lat;
+    f64 evict_p;              // p. a random way in the touched LLC set is evicted
+    f64 bg_evict;             // background LLC evictions per 1M virtual cycles
+
+    u32 page_shift;           // host backing page size: 12 (4KiB) or 21 (2MiB)
+
+    u64 seed;
+} SimConf;
+
+typedef struct {
+    u64 accesses,
+        l1_hits,
+        l2_hits,
+        llc_hits,
+        snoops,     // served from another core's L2
+        dram,
+        flushes,
+        noise_evicts;
+} SimStats;
+
+// skx-like defaults (see sim_parse_conf for presets)
+void sim_def_conf(SimConf *conf);
+
+/*
+  comma separated key=value list, e.g. "preset=icx,slices=28,repl=plru".
+  keys: preset (skx|icx|spr), cores, slices, l2_sets, l2_ways, llc_sets,
+  llc_ways, hash (skx20|xor|mod), repl/l2_repl/llc_repl (lru|plru|rand),
+  l1/l2/llc/dram/tsc (latencies), jitter, spike, spike_lat, evict, bg, seed,
+  page (4k|2m host backing)
+  returns -1 on an unknown key or bad value
+*/
+i32 sim_parse_conf(const char *spec, SimConf *conf);
+
+// NULL: defaults overridden by $EVSIM_CONF. called lazily on first use
+void sim_init(const SimConf *conf);
+
+const SimConf *sim_conf(void);
+
+// returns the access latency and advances the calling thread's vTSC by it
+u64 sim_access(const void *p);
+
+void sim_flush(const void *p);
+
+u64 sim_rdtsc(void);
+
+u32 sim_core_id(void);
+
+// deterministic per-page frame assignment
+u64 sim_va_to_pa(const void *va);
+
+u32 sim_llc_slice(u64 pa);
+
+// emulates cpuid leaf 4 (deterministic cache parameters) for idx 0, 2 and 3
+void sim_cpuid4(u32 idx, u32 *eax, u32 *ebx, u32 *ecx, u32 *edx);
+
+void sim_get_stats(SimStats *out);
+
+void sim_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // SIM_H
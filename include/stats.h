@@ -0,0 +1,80 @@
+// hot-path counters of evset construction (--stats=json)
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+#include "asm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum StatId {
+    ST_EV_TESTS = 0,    // test_eviction calls
+    ST_TESTS_UNSURE,    // ... that ran out of trials undecided
+    ST_TRIALS_VALID,
+    ST_TRIALS_MIGRATED, // discarded: core changed during the trial
+    ST_TRIALS_INTR,     // discarded: over the interrupt threshold
+    ST_SEARCH_ITERS,    // reduction iterations (zhao) or tests (gt, bs)
+    ST_BACKTRACKS,
+    ST_PRUNE_TESTS,
+    ST_HELPER_TRIPS,    // command batches handed to a helper thread
+    ST_FILTER_CANDS,    // candidate lines filtered or classified
+    ST_EVSETS_BUILT,
+    ST_EVSETS_FAILED,
+    N_STATS
+} StatId;
+
+typedef enum StatPhase {
+    PH_LATS = 0,    // latency detection
+    PH_L2_BUILD,
+    PH_CANDS,       // LLC candidate filtering
+    PH_L3_BUILD,
+    N_PHASES
+} StatPhase;
+
+// one per thread, merged by stats_report
+typedef struct EvStats {
+    u64 cnt[N_STATS];
+    struct EvStats *next;
+} EvStats;
+
+extern bool g_stats_on;
+extern __thread EvStats *tl_stats;
+
+void stats_enable(void);
+
+// registers the calling thread's counters. true on error
+bool stats_thread_init(void);
+
+static ALWAYS_INLINE void stats_add(StatId id, u64 n)
+{
+    if (__builtin_expect(!g_stats_on, 1))
+        return;
+    if (__builtin_expect(!tl_stats, 0) && stats_thread_init())
+        return;
+    tl_stats->cnt[id] += n;
+}
+
+static ALWAYS_INLINE void stats_inc(StatId id)
+{
+    stats_add(id, 1);
+}
+
+// wall time of a phase, in us. phases that run more than once accumulate
+void stats_phase_add(StatPhase ph, u64 us);
+
+// counter @p id merged over all threads, and phase time in us
+u64 stats_get(StatId id);
+u64 stats_phase_get(StatPhase ph);
+
+// zeroes counters and phase times, between runs of one process (vbench)
+void stats_reset(void);
+
+// merges the counters of all threads so far and prints them as one JSON line
+void stats_report(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // STATS_H
@@ -0,0 +1,120 @@
+// live hotness samples in shared memory (--telemetry), and the reader side
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "common.h"
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEM_DEF_PATH "/dev/shm/vev-telemetry"
+#define TELEM_MAGIC 0x4d4c4554564556ull // "VEVTELM"
+#define TELEM_VERSION 2
+#define TELEM_N_SLOTS 16        // power of two
+#define TELEM_MAX_ENTRIES 128   // colors or sockets per sample
+
+typedef enum TelemKind {
+    TELEM_COLOR = 0,    // vset --live, vcolor --vset: one entry per color
+    TELEM_SOCKET,       // vset --lcas: one entry per socket
+} TelemKind;
+
+typedef struct {
+    i32 id;         // color index or socket id
+    u32 valid;      // 0: nothing monitored, e.g. a socket without vCPU pairs
+    f64 raw,        // eviction rate of this scan, [0, 1]
+        ewma;
+} TelemEntry;
+
+typedef struct {
+    u64 ts_ns;      // CLOCK_MONOTONIC at the end of the scan
+    u64 iter;       // scan count of the writer
+    u32 kind,       // TelemKind
+        n,          // entries in use
+        wait_us,    // prime-probe wait of the scan
+        over_avg_ns, // past the wait deadlines since the last sample
+        over_max_ns,
+        _rsvd;
+    TelemEntry e[TELEM_MAX_ENTRIES];
+} TelemSample;
+
+/*
+  one ring slot under a seqlock: seq is odd while the writer fills the sample,
+  and bumped to the next even value once it is done
+*/
+typedef struct {
+    _Atomic u64 seq;
+    u8 _pad[CL_SIZE - sizeof(u64)];
+    TelemSample s;
+} TelemSlot;
+
+typedef struct {
+    _Atomic u64 magic;          // set last by the writer
+    u32 version,
+        n_slots,
+        max_entries;
+    i32 pid;                    // writer
+    _Atomic u64 n_published;    // the latest sample is in slots[(n - 1) % n_slots]
+    u8 _pad[CL_SIZE - 4 * sizeof(u64)];
+    TelemSlot slots[TELEM_N_SLOTS];
+} TelemShm;
+
+/* WRITER */
+
+// creates (or replaces) the shared segment at @p path. true on error
+bool telem_open(const char *path);
+
+// no-op until telem_open. @p valid may be NULL (all valid), @p ids NULL (0..n-1)
+void telem_publish(TelemKind kind, u32 n, const i32 *ids, const f64 *raw,
+                   const f64 *ewma, const bool *valid, u32 wait_us);
+
+// deadline overshoot (wait_stats_take) to put in the next sample
+void telem_note_waits(u64 n, u64 sum_ns, u64 max_ns);
+
+void telem_close(void);
+
+/* READER */
+
+typedef struct {
+    const TelemShm *shm;
+    u64 size;
+} TelemReader;
+
+// maps the segment read-only. true on error or if no writer set it up
+bool telem_reader_open(TelemReader *r, const char *path);
+
+void telem_reader_close(TelemReader *r);
+
+// samples published so far, to poll for a new one
+static inline u64 telem_published(const TelemReader *r)
+{
+    return atomic_load_explicit(&r->shm->n_published, memory_order_acquire);
+}
+
+/*
+  copies the latest sample into @p out, without locks or syscalls. retries
+  while the writer is in the slot. true if nothing was published yet
+*/
+static inline bool telem_read_latest(const TelemReader *r, TelemSample *out)
+{
+    for (;;) {
+        u64 n = telem_published(r);
+        if (!n)
+            return true;
+
+        const TelemSlot *slot = &r->shm->slots[(n - 1) % TELEM_N_SLOTS];
+        u64 s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (s1 & 1)
+            continue;
+        memcpy(out, (const void *)&slot->s, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == s1)
+            return false;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TELEMETRY_H
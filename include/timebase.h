@@ -0,0 +1,85 @@
+// tsc rate and the cycle <-> time conversions built on it
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TB_DEF_HZ 2000000000ull // until tb_init, and under the simulator
+#define TB_SHIFT 32
+
+typedef enum TbSource {
+    TB_DEFAULT = 0,     // TB_DEF_HZ
+    TB_HYPERVISOR,      // cpuid 0x40000010: tsc kHz reported by the hypervisor
+    TB_CPUID_15,        // cpuid 0x15: crystal clock times the tsc ratio
+    TB_CPUID_16,        // cpuid 0x16: base frequency, only if calibration fails
+    TB_CALIBRATED,      // measured against CLOCK_MONOTONIC_RAW
+    N_TB_SOURCES
+} TbSource;
+
+/*
+  the multipliers are fixed point with TB_SHIFT fraction bits, so a conversion
+  is one multiply and one shift. each is updated with a single store when the
+  rate changes, readers never see a torn value
+*/
+typedef struct {
+    u64 hz,
+        ns_mult,    // cycles -> ns
+        us_mult,    // cycles -> us
+        cyc_mult;   // ns -> cycles
+    u64 gen;        // bumped on every rate change
+    TbSource src;
+    bool invariant; // cpuid 0x80000007, often hidden by hypervisors
+} Timebase;
+
+extern Timebase g_tb;
+
+/*
+  reads the tsc rate from cpuid and checks it against a short calibration,
+  using the calibrated rate when they disagree. runs once, later calls return
+  right away
+*/
+void tb_init(void);
+
+/*
+  compares the tsc with CLOCK_MONOTONIC_RAW since the last check and
+  recalibrates when they drift apart, e.g. after a live migration to a host
+  with another tsc rate. call from a control loop, it is cheap when nothing
+  changed. true if the rate changed
+*/
+bool tb_check(void);
+
+const char *tb_src_name(TbSource src);
+
+static inline u64 tb_cyc_to_ns(u64 cyc)
+{
+    return ((unsigned __int128)cyc * g_tb.ns_mult) >> TB_SHIFT;
+}
+
+static inline u64 tb_cyc_to_us(u64 cyc)
+{
+    return ((unsigned __int128)cyc * g_tb.us_mult) >> TB_SHIFT;
+}
+
+static inline u64 tb_ns_to_cyc(u64 ns)
+{
+    return ((unsigned __int128)ns * g_tb.cyc_mult) >> TB_SHIFT;
+}
+
+static inline u64 tb_us_to_cyc(u64 us)
+{
+    return tb_ns_to_cyc(us * 1000);
+}
+
+static inline u64 tb_ms_to_cyc(u64 ms)
+{
+    return tb_ns_to_cyc(ms * 1000000);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TIMEBASE_H
@@ -0,0 +1,173 @@
+// timing sources for latency measurements (_time_maccess, lat_start)
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "common.h"
+#include "asm.h"
+#include <linux/perf_event.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum TimerSrc {
+    TIMER_TSC = 0,  // serialized rdtsc/rdtscp
+    TIMER_PMC,      // rdpmc on a perf_event cycle counter (needs a vPMU)
+    TIMER_THREAD,   // counter incremented by a spinning thread
+    N_TIMER_SRCS,
+    TIMER_AUTO = N_TIMER_SRCS // calibrate and pick the lowest-noise source
+} TimerSrc;
+
+typedef struct {
+    i32 fd;
+    struct perf_event_mmap_page *page;
+    u64 mask; // counter width
+    bool ready,
+         failed;
+} PmcCtx;
+
+extern TimerSrc g_timer_src;
+extern volatile u64 g_timer_ticks;
+extern __thread PmcCtx tl_pmc;
+
+i32 timer_src_parse(const char *name);
+
+const char *timer_src_name(TimerSrc src);
+
+/*
+  selects @p src for _time_maccess and lat_start, calibrating when TIMER_AUTO. falls back to
+  TIMER_TSC when the source is unavailable. call before the cache latencies are
+  measured, so thresholds are in the unit of the chosen source
+*/
+void timer_init(TimerSrc src);
+
+// opens the calling thread's counter. true on error
+bool pmc_thread_init(void);
+
+/*
+  closes the calling thread's counter. threads that opened one get it closed
+  on exit, the main thread when the process exits (see timer_init)
+*/
+void pmc_thread_fini(void);
+
+/* DEADLINE WAITS */
+
+typedef struct {
+    u64 n,          // waits
+        sum_ns,     // overshoot past the deadline
+        max_ns;
+} WaitStats;
+
+/*
+  waits until the tsc reaches @p deadline without holding the cpu: sleeps on
+  CLOCK_MONOTONIC until a calibrated margin before it, then covers the rest
+  with tpause (WAITPKG) or a pause loop. returns the overshoot in tsc cycles
+*/
+u64 wait_until_tsc(u64 deadline);
+
+// overshoot of all threads' waits since the last call
+WaitStats wait_stats_take(void);
+
+static ALWAYS_INLINE u64 pmc_read(void)
+{
+#if EVSIM
+    return _rdpmc(0);
+#endif
+    struct perf_event_mmap_page *pc = tl_pmc.page;
+    u32 seq, idx;
+    u64 cnt;
+
+    do {
+        seq = pc->lock;
+        compiler_barrier();
+        idx = pc->index;
+        cnt = idx ? _rdpmc(idx - 1) : 0;
+        compiler_barrier();
+    } while (pc->lock != seq);
+
+    return cnt;
+}
+
+static ALWAYS_INLINE u64 pmc_time_maccess(u8 *line)
+{
+    if (__builtin_expect(!tl_pmc.ready, 0) && pmc_thread_init())
+        return ~0ull; // discarded by the interrupt threshold
+
+    u64 start, end;
+    _mfence();
+    _force_addr_calc(line);
+    _lfence();
+    start = pmc_read();
+    _lfence();
+    maccess(line);
+    _lfence();
+    end = pmc_read();
+    _mfence();
+
+    return (end - start) & tl_pmc.mask;
+}
+
+/*
+  a timed region in the unit of g_timer_src, which the latency thresholds are
+  calibrated in: lat_since(lat_start()) around the code to time
+*/
+static ALWAYS_INLINE u64 lat_start(void)
+{
+    if (g_timer_src == TIMER_PMC) {
+        if (__builtin_expect(!tl_pmc.ready, 0) && pmc_thread_init())
+            return 0;
+        _mfence();
+        _lfence();
+        u64 t = pmc_read();
+        _lfence();
+        return t;
+    }
+    if (g_timer_src == TIMER_THREAD) {
+        _mfence();
+        _lfence();
+        u64 t = g_timer_ticks;
+        _lfence();
+        return t;
+    }
+    return timer_start();
+}
+
+static ALWAYS_INLINE u64 lat_since(u64 start)
+{
+    if (g_timer_src == TIMER_PMC) {
+        if (!tl_pmc.ready)
+            return ~0ull; // discarded by the interrupt threshold
+        _lfence();
+        u64 t = pmc_read();
+        _mfence();
+        return (t - start) & tl_pmc.mask;
+    }
+    if (g_timer_src == TIMER_THREAD) {
+        _lfence();
+        u64 t = g_timer_ticks;
+        _mfence();
+        return t - start;
+    }
+    return timer_stop() - start;
+}
+
+static ALWAYS_INLINE u64 thread_time_maccess(u8 *line)
+{
+    u64 start, end;
+    _mfence();
+    _force_addr_calc(line);
+    _lfence();
+    start = g_timer_ticks;
+    _lfence();
+    maccess(line);
+    _lfence();
+    end = g_timer_ticks;
+    _mfence();
+
+    return end - start;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TIMER_H
@@ -6,6 +6,8 @@
 #include "../include/mem.h"
 #include "../vm_tools/vtop.h"
 #include "asm.h"
+#include "timer.h"
+#include "timebase.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,7 +41,7 @@ i32 print_usage_vcolor(char* progname);
 
 i32 print_usage_vpo(char* progname);
 
-u64 get_cpu_freq_hz(void);
+i32 print_usage_vbench(char* progname);
 
 i32 set_cpu_affinity(u16 core_id);
 
@@ -72,6 +74,10 @@ void free_cache_info(CacheInfo* c_info);
 
 u64 va_to_pa(void* va);
 
+// 2MiB chunks of [buf, buf + size) on one aligned physical frame (pagemap).
+// -1 if pagemap hides the PFNs (no CAP_SYS_ADMIN)
+i64 count_huge_backed(u8 *buf, u64 size);
+
 u32 va_to_l2color(void *va);
 
 u64 time_us(void);
@@ -93,6 +99,11 @@ u32 n_digits(u32 v);
 
 static ALWAYS_INLINE u64 _time_maccess(u8 *line)
 {
+    if (g_timer_src == TIMER_PMC)
+        return pmc_time_maccess(line);
+    if (g_timer_src == TIMER_THREAD)
+        return thread_time_maccess(line);
+
     u64 start, end;
     _mfence();
 
@@ -53,7 +53,6 @@ typedef struct {
 typedef struct {
     u32 tid;
     u32 wait_us;
-    u64 cycles_per_us;
     u32 iterations;
     EvSet ***color_sets;
     u32 *color_counts;
@@ -64,8 +63,28 @@ typedef struct {
     i32 core_helper;
     u64 *prime_times;
     u64 *probe_times;
+    struct l2c_pipe *pipe;  // pipelined scan state, set up by the worker
+    helper_thread_ctrl *hctrl;
 } l2c_occ_worker_arg;
 
+/*
+  persistent, pinned main/helper pairs running l2c_occ_worker scans on demand.
+  pairs pin themselves and attach their helper to the evsets once, then wait
+  for l2c_occ_pool_run. between runs the helpers block on their empty ring
+*/
+typedef struct {
+    l2c_occ_worker_arg *wargs;
+    pthread_t *threads;
+    void *args;
+    u32 n_pairs,
+        n_done;
+    u64 gen;        // bumped once per run
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t go,
+                   done;
+} l2c_occ_pool;
+
 extern bool lcas_mode;
 extern u32 lcas_period_ms;
 extern u32 scan_period_ms;
@@ -78,6 +97,9 @@ extern u64 retry;
 extern u64 wait_time_us;
 extern u64 og_wait_time_us;
 extern bool fix_wait;
+extern u32 pipeline_groups;
+extern bool probe_group;
+extern bool layout_chain;
 extern u32 heatmap_time_step_us;
 extern u32 heatmap_max_time_us;
 
@@ -87,6 +109,14 @@ i32 check_cgroup_hi_ready(void);
 
 void *l2c_occ_worker(void *arg);
 
+// starts a pair per @p wargs entry. true on error (no pair could be started)
+bool l2c_occ_pool_start(l2c_occ_pool *pool, l2c_occ_worker_arg *wargs, u32 n_pairs);
+
+// one scan (wargs[i].iterations each) on all pairs, returns when all are done
+void l2c_occ_pool_run(l2c_occ_pool *pool);
+
+void l2c_occ_pool_stop(l2c_occ_pool *pool);
+
 void write_eviction_freq_data(u32 *cycle_diffs, u64 n_samples, bool plot);
 
 void write_heatmap_data(heatmap_data_point *data, u32 n_time_slots, u32 n_ways,
@@ -117,6 +147,9 @@ f64 estimate_heatmap_runtime(u32 n_time_slots, u32 batch_prime_us,
 
 f64 estimate_l2color_runtime(u32 n_colors, u32 iterations, u32 wait_us);
 
+// read-back threshold of l3_evset_prime for the whole of @p evset
+u64 l3_prime_thresh(EvSet *evset);
+
 void l3_evset_prime(EvSet *evset, u64 threshold);
 
 i64 calibrate_grp_access_lat(u8 *target, EvSet *evset, EvBuildConf *tconf);
@@ -131,6 +164,9 @@ i32 check_mem_remap_cheat(void);
 
 void perf_prime_probe(void);
 
+// searches the prime pattern on fresh evsets and saves it to PRIME_PROFILE_PATH
+i32 tune_prime_pattern(u32 trials);
+
 i32 fraction_check(void);
 
 #ifdef __cplusplus
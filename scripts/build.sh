@@ -119,6 +119,8 @@ echo "  - vset (LLC set monitoring)"
 echo "  - vpo (poisoner tool)"
 echo "  - vcolor (cache/page coloring tool)"
 echo "  - vtest (test tool for \`vcolor\`'s filtered pages)"
+echo "  - vbench (construction benchmark scenarios)"
+echo "  - vtelem (reader of the --telemetry hotness samples)"
 echo ""
 echo "All executables are located in the build/ directory."
 echo "For further builds after changes, simply run \`make -j\` inside the build directory."
@@ -3,15 +3,25 @@
 #include <cpuid.h>
 #include <stdlib.h>
 
+#if EVSIM
+#define cpuid_leaf4(idx, a, b, c, d) sim_cpuid4(idx, &(a), &(b), &(c), &(d))
+#else
+#define cpuid_leaf4(idx, a, b, c, d) __cpuid_count(4, idx, a, b, c, d)
+#endif
+
 CacheInfo l1_info = {0}, // L1Data
           l2_info = {0},
           l3_info = {0};
 
 u32 g_n_uncertain_l2_sets = 0;
+u32 g_page_shift = PAGE_SHIFT;
 u64 g_l3_cnt = 0;
 
 void init_cache_info()
 {
+    // only host 2MiB backing makes the bits above 4KiB known in the HPA
+    g_page_shift = g_config.huge_pages == HUGE_HOST ? HUGE_PAGE_SHIFT : PAGE_SHIFT;
+
     init_l1_info(&l1_info);
     init_l2_info(&l2_info);
     init_l3_info(&l3_info);
@@ -23,14 +33,17 @@ void init_cache_info()
 
 i32 calc_unknown_sib(CacheInfo* c)
 {
-    return (c->n_cl_bits + c->n_set_idx_bits - PAGE_OFFSET_BITS);
+    i32 unknown = c->n_cl_bits + c->n_set_idx_bits - g_page_shift;
+    if (g_page_shift > PAGE_OFFSET_BITS && unknown < 0)
+        return 0; // fully indexed within a huge page
+    return unknown;
 }
 
 void init_l1_info(CacheInfo* l1)
 {
     u32 eax, ebx, ecx, edx;
     // L1d cache is indexed by __cpuid_count(4, 0, ...)
-    __cpuid_count(4, 0, eax, ebx, ecx, edx);
+    cpuid_leaf4(0, eax, ebx, ecx, edx);
 
     u32 line_size_minus_1 = (ebx & 0xFFF);
     u32 ways_minus_1 = (ebx >> 22) & 0x3FF;
@@ -57,7 +70,7 @@ void init_l2_info(CacheInfo* l2)
 {
     u32 eax, ebx, ecx, edx;
     // L2 is indexed by __cpuid_count(4, 2, ...)
-    __cpuid_count(4, 2, eax, ebx, ecx, edx); 
+    cpuid_leaf4(2, eax, ebx, ecx, edx); 
 
     u32 line_size_minus_1 = (ebx & 0xFFF);
     u32 ways_minus_1      = (ebx >> 22) & 0x3FF;
@@ -101,7 +114,7 @@ void init_l3_info(CacheInfo* l3)
 {
     u32 eax, ebx, ecx, edx;
     // L3 is indexed by __cpuid_count(4, 3, ...)
-    __cpuid_count(4, 3, eax, ebx, ecx, edx); 
+    cpuid_leaf4(3, eax, ebx, ecx, edx); 
 
     u32 line_size_minus_1 = (ebx & 0xFFF);
     u32 ways_minus_1 = (ebx >> 22) & 0x3FF;
@@ -4,12 +4,12 @@
 
 void traverse_cands_mt(u8 **cands, u64 cnt, EvBuildConf* tconf) 
 {
-    struct helper_thread_read_array *arr = malloc(sizeof(*arr));
-    assert(arr);
     u64 repeat = tconf->ev_repeat, block = tconf->block,
         stride = tconf->stride;
 
-    *arr = (struct helper_thread_read_array)
+    helper_cmd *cmd = helper_cmd_slot(tconf->hctrl, 0);
+    cmd->action = READ_ARRAY;
+    cmd->arr = (struct helper_thread_read_array)
     {
         .addrs = cands,
         .cnt = cnt,
@@ -18,11 +18,7 @@ void traverse_cands_mt(u8 **cands, u64 cnt, EvBuildConf* tconf)
         .stride = stride,
         .bwd = true
     };
-
-    tconf->hctrl->action = READ_ARRAY;
-    tconf->hctrl->payload = arr;
-    compiler_barrier();
-    tconf->hctrl->waiting = false;
+    helper_submit(tconf->hctrl, 1);
 
     //access_array(cands, cnt);
     prime_cands_daniel(cands, cnt, repeat, stride, block);
@@ -35,5 +31,4 @@ void traverse_cands_mt(u8 **cands, u64 cnt, EvBuildConf* tconf)
     }
 
     wait_helper_thread(tconf->hctrl);
-    free(arr);
 }
@@ -22,6 +22,12 @@ void init_def_args_conf(void)
     g_config.num_l2_sets = 0;      // default: all uncertain sets if granular
     g_config.evsets_per_l2 = 1;    // default evsets per L2 set
     g_config.cand_scaling = 0; // set to 0 to later tell whether user has changed it or not
+    g_config.ev_algo = 0;      // STRAW_ZHAO
+    g_config.sprt_conf = 0;    // bounded otc test
+    g_config.huge_pages = HUGE_OFF;
+    g_config.timer_src = 0;    // TIMER_TSC
+    g_config.filter_batch = 0; // calibrated
+    g_config.stats_json = false;
     g_config.vtop_freq = 2000000; // default periodic vTop check in microseconds
     graph_type = GRAPH_NONE;
     if (data_append) {
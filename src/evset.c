@@ -7,13 +7,17 @@
 #include "../include/bitwise.h"
 #include "../include/evset_para.h"
 #include "../include/config.h"
+#include "../include/stats.h"
 #include "../vm_tools/gpa_hpa.h"
 #include <stdatomic.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <limits.h>
+#include <math.h>
 
-#define FILTER_BATCH 1
+#define FILTER_CAL_SAMPLE 32 // expected congruent lines in the calibration sample
+#define FILTER_CAL_TOL 0.9
+#define SPRT_P_FLOOR 0.05 // keeps one odd sample from deciding an SPRT test
 
 // for cand filtering
 static pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -22,8 +26,33 @@ EvBuildConf def_l2_build_conf;
 EvBuildConf def_l3_build_conf;
 static helper_thread_ctrl hctrl;
 u32 n_unc_l2_sets;
+u32 g_filter_batch = 0;
 u32 g_evsets_per_offset[NUM_OFFSETS] = {0};
 
+// candidate complexes handed out so far. evsets keep pointing into them for
+// repair, so they are only freed on release_evcands_complexes
+typedef struct CandsRec {
+    EvCands ***complex;
+    u32 n_colors;
+    struct CandsRec *next;
+} CandsRec;
+
+static CandsRec *cands_recs = NULL;
+static pthread_mutex_t cands_recs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cands_register(EvCands ***complex, u32 n_colors)
+{
+    CandsRec *rec = _calloc(1, sizeof(*rec));
+    if (!rec)
+        return;
+    rec->complex = complex;
+    rec->n_colors = n_colors;
+    pthread_mutex_lock(&cands_recs_lock);
+    rec->next = cands_recs;
+    cands_recs = rec;
+    pthread_mutex_unlock(&cands_recs_lock);
+}
+
 static void print_cand_accuracy(EvCands ***cands_complex, EvSet ***l2evsets)
 {
     if (debug <= 0)
@@ -43,7 +72,7 @@ static void print_cand_accuracy(EvCands ***cands_complex, EvSet ***l2evsets)
         u64 t_hpa_l2 = cache_get_sib(t_hpa, &l2_info);
         u64 n_healthy = 0; // healthy if filter cand's L2 SIB matches filterev's target L2 SIB
         for (u32 k = 0; k < n_filtered; k++) {
-            u64 cand_hpa = va_to_hpa(cands->addrs[k]);
+            u64 cand_hpa = va_to_hpa(evcands_at(cands, k));
             u64 cand_l2 = cache_get_sib(cand_hpa, &l2_info);
             if (cand_l2 == t_hpa_l2)
                 n_healthy++;
@@ -65,32 +94,81 @@ void addrs_traverse(u8 **addrs, u64 cnt, EvBuildConf *tconf)
 static ALWAYS_INLINE
 void helper_thread_traverse_cands(u8 **cands, u64 cnt, EvBuildConf *tconf)
 {
-    struct helper_thread_traverse_cands *tcands = malloc(sizeof(*tcands));
-    assert(tcands);
-    
-    *tcands = (struct helper_thread_traverse_cands)
+    helper_cmd *cmd = helper_cmd_slot(tconf->hctrl, 0);
+    cmd->action = TRAVERSE_CANDS;
+    cmd->trav = (struct helper_thread_traverse_cands)
     {
         .traverse = tconf->cand_traverse,
         .cands = cands,
         .cnt = cnt,
         .tconfig = tconf
     };
-    
-    tconf->hctrl->action = TRAVERSE_CANDS;
-    tconf->hctrl->payload = tcands;
-    compiler_barrier();
-    tconf->hctrl->waiting = false;
+    helper_submit(tconf->hctrl, 1);
     wait_helper_thread(tconf->hctrl);
-    free(tcands);
+}
+
+/*
+  with known bits above the 4KiB page (HUGE_HOST), candidates of one page offset
+  only congruent in the set index are a same_set_stride apart. capped at the
+  huge page, past which the bits are unknown again.
+  L2 candidates are skewed by one L2 stride, which leaves them in another LLC
+  set index than the LLC candidates: otherwise traversing the L2 evset (lower_ev)
+  would land in the very LLC set under test
+*/
+static u64 evbuffer_stride(CacheInfo *cache, u64 *skew)
+{
+    *skew = 0;
+    if (g_page_shift <= PAGE_SHIFT)
+        return PAGE_SIZE;
+
+    u64 stride = same_set_stride(cache),
+        max_stride = 1ull << g_page_shift;
+    if (cache->level == L2 && same_set_stride(&l3_info) > same_set_stride(cache)) {
+        *skew = stride;
+        stride = _min((u64)same_set_stride(&l3_info), max_stride);
+    }
+
+    return _min(stride, max_stride);
+}
+
+static bool evbuffer_check_huge(EvBuffer *evb)
+{
+    u64 buf_size = evb->n_pages * PAGE_SIZE;
+    i64 n_huge = count_huge_backed(evb->buf, buf_size);
+    u64 n_chunks = buf_size >> HUGE_PAGE_SHIFT;
+
+    if (n_huge < 0) {
+        printf(WRN "pagemap hides PFNs; 2MiB backing of the EvBuffer is unverified\n");
+        return false;
+    }
+
+    if (verbose)
+        printf(V1 "EvBuffer: %lu/%lu chunks on 2MiB pages\n", n_huge, n_chunks);
+
+    if ((u64)n_huge == n_chunks)
+        return false;
+
+    if (g_page_shift > PAGE_SHIFT) { // candidates would not be congruent
+        fprintf(stderr, ERR "EvBuffer is not fully backed by 2MiB pages (%lu/%lu)\n",
+                n_huge, n_chunks);
+        return true;
+    }
+
+    printf(WRN "EvBuffer only partially on 2MiB pages (%lu/%lu)\n", n_huge, n_chunks);
+    return false;
 }
 
 EvBuffer *evbuffer_new(CacheInfo *cache, EvBuildConf *cand_conf)
 {
     u64 uncertainty = cache_uncertainty(cache);
-    u64 n_pages, buf_size;
+    u64 n_cands, stride, skew, buf_size;
+    bool huge = g_config.huge_pages != HUGE_OFF;
 
-    n_pages = uncertainty * cache->n_ways * cand_conf->cand_scale;
-    buf_size = n_pages * PAGE_SIZE;
+    n_cands = uncertainty * cache->n_ways * cand_conf->cand_scale;
+    stride = evbuffer_stride(cache, &skew);
+    buf_size = skew + n_cands * stride;
+    if (huge)
+        buf_size = _ALIGN_UP(buf_size, HUGE_PAGE_SHIFT);
 
     EvBuffer *evb = _calloc(1, sizeof(*evb));
     if (!evb) {
@@ -100,17 +178,29 @@ EvBuffer *evbuffer_new(CacheInfo *cache, EvBuildConf *cand_conf)
 
     void *pages = NULL;
     //pages = mmap_shared_init(NULL, buf_size, 0);
-    pages = mmap_shared_init_para(NULL, buf_size, 0);
+    if (huge)
+        pages = mmap_huge_init_para(buf_size, 0);
+    else
+        pages = mmap_shared_init_para(NULL, buf_size, 0);
 
     if (!pages) {
         fprintf(stderr, ERR "Failed to mmap %lu bytes for eviction buffer\n", buf_size);
         goto err;
     }
-    assert(_ALIGNED(pages, PAGE_SHIFT));
+    assert(_ALIGNED(pages, huge ? HUGE_PAGE_SHIFT : PAGE_SHIFT));
 
     evb->buf = pages;
-    evb->n_pages = n_pages;
+    evb->n_pages = buf_size / PAGE_SIZE;
     evb->ref_cnt = 0;
+    evb->stride = stride;
+    evb->skew = skew;
+    evb->n_cands = n_cands;
+    evb->huge = huge;
+
+    if (huge && evbuffer_check_huge(evb)) {
+        munmap(pages, buf_size);
+        goto err;
+    }
     return evb;
 
 err:
@@ -118,6 +208,49 @@ err:
     return NULL;
 }
 
+EvBuffer *evbuffer_reserve(CacheInfo *cache, u64 n_cands)
+{
+    u64 skew, stride = evbuffer_stride(cache, &skew);
+    u64 buf_size = skew + n_cands * stride;
+
+    EvBuffer *evb = _calloc(1, sizeof(*evb));
+    if (!evb) {
+        fprintf(stderr, ERR "Failed to allocate EvBuffer\n");
+        return NULL;
+    }
+
+    evb->buf = mmap_shared(NULL, buf_size);
+    if (!evb->buf) {
+        fprintf(stderr, ERR "Failed to mmap %lu bytes for eviction buffer\n", buf_size);
+        free(evb);
+        return NULL;
+    }
+
+    evb->n_pages = buf_size / PAGE_SIZE;
+    evb->stride = stride;
+    evb->skew = skew;
+    evb->n_cands = n_cands;
+    return evb;
+}
+
+bool evbuffer_release(EvBuffer *evb, u64 first, u64 cnt)
+{
+    u8 *page = (u8 *)evb->buf + evb->skew + first * evb->stride;
+
+    // shared anonymous memory: DONTNEED would only drop the PTEs, not the pages
+    for (u64 i = 0; i < cnt; ) {
+        u64 len = evb->stride == PAGE_SIZE ? cnt - i : 1;
+        if (madvise(page + i * evb->stride, len * PAGE_SIZE, MADV_REMOVE)) {
+            perror("madvise(MADV_REMOVE) of candidate pages");
+            return true;
+        }
+        i += len;
+    }
+
+    evb->n_released += cnt;
+    return false;
+}
+
 EvCands *evcands_new(CacheInfo *cache, EvBuildConf *cands_config, EvBuffer *evb)
 {
     EvCands *cands = _calloc(1, sizeof(*cands));
@@ -144,8 +277,8 @@ EvCands *evcands_new(CacheInfo *cache, EvBuildConf *cands_config, EvBuffer *evb)
 bool evcands_populate(u32 offset, EvCands *cands, EvBuildConf *config,
                       i32 thread_id, u32 filter_offset)
 {
-    u64 n_cands_init = cands->evb->n_pages;
-    u64 stride = PAGE_SIZE;
+    u64 n_cands_init = cands->evb->n_cands;
+    u64 stride = cands->evb->stride;
 
     u8 **addrs = _calloc(n_cands_init, sizeof(*addrs));
     if (!addrs) {
@@ -155,7 +288,7 @@ bool evcands_populate(u32 offset, EvCands *cands, EvBuildConf *config,
     }
 
     for (u64 n = 0; n < n_cands_init; n++) {
-        addrs[n] = cands->evb->buf + n * stride + offset;
+        addrs[n] = cands->evb->buf + cands->evb->skew + n * stride + offset;
         *addrs[n] = n;
     }
 
@@ -165,19 +298,11 @@ bool evcands_populate(u32 offset, EvCands *cands, EvBuildConf *config,
         return false;
     }
 
+    evcands_filter_init(addrs, n_cands_init, config->filter_ev, &def_l2_build_conf);
+
     u64 start = time_us();
-    u64 n_cands_filtered = 0;
-#if FILTER_BATCH // works best on e.g. SKX, Cascade
-    evcands_filter_batch(addrs, cands->evb->n_pages, &n_cands_filtered,
-                         config->filter_ev, &def_l2_build_conf);
-#else // sequential filtering. some uarchs like icelake and larger LLCs on Intel Xeon platinum aren't reliable with batch filtering
-    for (u32 i = 0; i < cands->evb->n_pages; i++) {
-        if (test_eviction(addrs[i], config->filter_ev->addrs, config->filter_ev->size, &def_l2_build_conf) == OK) {
-            _swap(addrs[n_cands_filtered], addrs[i]);
-                n_cands_filtered += 1;
-        }
-    }
-#endif
+    u64 n_cands_filtered = evcands_filter(addrs, n_cands_init, config->filter_ev,
+                                          &def_l2_build_conf, g_filter_batch);
 
     if (n_cands_filtered <= 0) {
         fprintf(stderr, ERR "Failed to filter out candidates!\n");
@@ -245,6 +370,213 @@ err:
     return NULL;
 }
 
+static EvCandPages *evcand_pages_new(EvCands *from)
+{
+    EvCandPages *pages = _calloc(1, sizeof(*pages));
+    if (!pages) {
+        fprintf(stderr, ERR "failed to alloc EvCandPages\n");
+        return NULL;
+    }
+
+    pages->bases = _calloc(from->count, sizeof(*pages->bases));
+    if (!pages->bases) {
+        fprintf(stderr, ERR "failed to alloc the page base array\n");
+        free(pages);
+        return NULL;
+    }
+
+    for (u64 i = 0; i < from->count; i++) {
+        pages->bases[i] = _ALIGN_DOWN(evcands_at(from, i), PAGE_SHIFT);
+    }
+
+    pages->count = from->count;
+    pages->ref_cnt = 1; // held by from
+    return pages;
+}
+
+EvCands *evcands_view(EvCands *from, u32 offset)
+{
+    if (!from->pages) {
+        from->pages = evcand_pages_new(from);
+        if (!from->pages)
+            return NULL;
+    }
+
+    EvCands *cands = _calloc(1, sizeof(*cands));
+    if (!cands) {
+        fprintf(stderr, ERR "failed to alloc EvCands");
+        return NULL;
+    }
+
+    cands->pages = from->pages;
+    cands->pages->ref_cnt += 1;
+    cands->offset = offset;
+    cands->count = from->pages->count;
+    cands->cache = from->cache;
+    cands->evb = from->evb;
+    cands->evb->ref_cnt += 1;
+    cands->ref_cnt = 0;
+    return cands;
+}
+
+bool evcands_materialize(EvCands *cands)
+{
+    if (cands->addrs || !cands->pages)
+        return false;
+
+    u8 **addrs = _calloc(cands->count, sizeof(*addrs));
+    if (!addrs) {
+        fprintf(stderr, ERR "failed to alloc the cands array\n");
+        return true;
+    }
+
+    for (u64 i = 0; i < cands->count; i++) {
+        addrs[i] = cands->pages->bases[i] + cands->offset;
+    }
+
+    cands->addrs = addrs;
+    return false;
+}
+
+bool evidx_encode(EvIdx *idx, u8 **addrs, u64 cnt, EvBuffer *evb)
+{
+    if (!evb || !evb->buf)
+        return true;
+
+    if (cnt > idx->cap) {
+        u32 *idxs = realloc(idx->idxs, cnt * sizeof(*idxs));
+        if (!idxs) {
+            fprintf(stderr, ERR "failed to alloc the page index array\n");
+            return true;
+        }
+        idx->idxs = idxs;
+        idx->cap = cnt;
+    }
+
+    u8 *buf = evb->buf;
+    u64 offset = cnt ? (u64)(addrs[0] - buf) & (PAGE_SIZE - 1) : 0;
+    for (u64 i = 0; i < cnt; i++) {
+        u64 delta = addrs[i] - buf;
+        if (addrs[i] < buf || (delta >> PAGE_SHIFT) >= evb->n_pages ||
+            (delta & (PAGE_SIZE - 1)) != offset) {
+            idx->count = 0;
+            return true;
+        }
+        idx->idxs[i] = (u32)(delta >> PAGE_SHIFT);
+    }
+
+    idx->base = buf + offset;
+    idx->count = cnt;
+    return false;
+}
+
+void evidx_free(EvIdx *idx)
+{
+    free(idx->idxs);
+    *idx = (EvIdx){0};
+}
+
+bool evset_compact(EvSet *evset)
+{
+    if (!evset->cands)
+        return true;
+
+    if (evidx_encode(&evset->idx, evset->addrs, evset->size, evset->cands->evb)) {
+        evidx_free(&evset->idx);
+        return true;
+    }
+    return false;
+}
+
+bool evset_chain(EvSet *evset)
+{
+    u64 n = evset->size;
+    evset->chain = NULL;
+    if (!n)
+        return true;
+
+    for (u64 i = 0; i < n; i++) {
+        evchain *node = (evchain *)evset_at(evset, i);
+        node->next = (evchain *)evset_at(evset, (i + 1) % n);
+        node->prev = (evchain *)evset_at(evset, (i + n - 1) % n);
+    }
+    // written back now rather than on the first eviction of a probe
+    for (u64 i = 0; i < n; i++)
+        _clflushopt(evset_at(evset, i));
+    _mfence();
+
+    evset->chain = (evchain *)evset_at(evset, 0);
+    return false;
+}
+
+u32 chain_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                       u32 start_color, u32 num_colors)
+{
+    u32 n_fail = 0;
+    for (u32 idx = 0; idx < num_colors; idx++) {
+        u32 color = start_color + idx;
+        for (u32 s = 0; s < color_counts[color]; s++) {
+            EvSet *ev = color_sets[color][s];
+            if (ev && ev->size > 0 && evset_chain(ev))
+                n_fail++;
+        }
+    }
+    return n_fail;
+}
+
+u32 compact_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                         u32 start_color, u32 num_colors)
+{
+    u32 n_fail = 0;
+    for (u32 idx = 0; idx < num_colors; idx++) {
+        u32 color = start_color + idx;
+        for (u32 s = 0; s < color_counts[color]; s++) {
+            EvSet *ev = color_sets[color][s];
+            if (!ev || ev->size == 0)
+                continue;
+            if (evset_compact(ev)) {
+                n_fail++;
+            } else {
+                free(ev->addrs);
+                ev->addrs = NULL;
+            }
+        }
+    }
+    return n_fail;
+}
+
+bool evset_expand(EvSet *evset)
+{
+    if (evset->addrs)
+        return false;
+    if (evset->idx.count != evset->size)
+        return true;
+
+    evset->addrs = _calloc(_max(evset->ev_cap, evset->size), sizeof(u8*));
+    if (!evset->addrs) {
+        fprintf(stderr, ERR "failed to allocate evset addresses\n");
+        return true;
+    }
+    for (u32 i = 0; i < evset->size; i++)
+        evset->addrs[i] = evidx_at(&evset->idx, i);
+    return false;
+}
+
+u32 expand_color_evsets(EvSet ***color_sets, u32 *color_counts,
+                        u32 start_color, u32 num_colors)
+{
+    u32 n_fail = 0;
+    for (u32 idx = 0; idx < num_colors; idx++) {
+        u32 color = start_color + idx;
+        for (u32 s = 0; s < color_counts[color]; s++) {
+            EvSet *ev = color_sets[color][s];
+            if (ev && ev->size > 0 && evset_expand(ev))
+                n_fail++;
+        }
+    }
+    return n_fail;
+}
+
 EvCands ***build_evcands_all(EvBuildConf *conf, EvSet ***l2evsets)
 {
     u64 start, end;
@@ -287,124 +619,149 @@ EvCands ***build_evcands_all(EvBuildConf *conf, EvSet ***l2evsets)
                 }
                 cands_complex[n][i] = cands;
             } else {
-                cands_complex[n][i] = evcands_shift(cands_complex[0][i], offset);
-                if (debug > 2) {
+                cands_complex[n][i] = evcands_view(cands_complex[0][i], offset);
+                if (debug > 2 && cands_complex[n][i]) {
                     EvCands* cc = cands_complex[n][i];
                     u16 n_display = _min(2, cc->count);
                     sep();
                     printf(D3 "There is %lu candidates; displaying %u\n", cc->count, n_display);
                     for (u16 c = 0; c < n_display; c++) {
                         printf("cands_complex[%u][%u]->addrs[%u]: HPA 0x%lx\n", 
-                                n, i, c, va_to_hpa(cc->addrs[c]));
+                                n, i, c, va_to_hpa(evcands_at(cc, c)));
                     }
                 }
             }
         }
     }
     end = time_us();
+    stats_phase_add(PH_CANDS, end - start);
     printf(INFO "Built EvCands complex | %.3fms\n", (end - start) / 1e3);
 
     print_cand_accuracy(cands_complex, l2evsets);
+    cands_register(cands_complex, n_unc_l2_sets);
     return cands_complex;
 }
 
-typedef struct {
-    u32 start_idx;
-    u32 end_idx;
-    u32 thread_idx;
-    EvCands *base_cands;
-    EvCands ***cands_complex;
-    EvSet ***l2evsets;
-    EvBuildConf *conf;
-} cand_para_arg_t;
-
-static bool build_single_cand(u32 idx, u32 thread_idx, EvCands *base_cands,
-                              EvCands ***cands_complex, EvSet ***l2evsets,
-                              EvBuildConf *conf)
+void release_evcands_complexes(void)
 {
-    u32 offset = idx * CL_SIZE;
-    EvBuildConf c = *conf;
-    c.filter_ev = l2evsets[idx][idx];
-    c.filter_ev->build_conf = &def_l2_build_conf;
+    pthread_mutex_lock(&cands_recs_lock);
+    CandsRec *rec = cands_recs;
+    cands_recs = NULL;
+    pthread_mutex_unlock(&cands_recs_lock);
 
-    EvCands *cand = evcands_new(&l3_info, &c, base_cands->evb);
-    if (!cand)
-        return false;
+    while (rec) {
+        for (u32 n = 0; n < NUM_OFFSETS; n++) {
+            for (u32 c = 0; c < rec->n_colors; c++)
+                evcands_free(rec->complex[n][c]); // views before or after base
+            free(rec->complex[n]);
+        }
+        free(rec->complex);
 
-    if (evcands_populate(offset, cand, &c, thread_idx, offset)) {
-        free(cand->addrs);
-        free(cand);
-        return false;
+        CandsRec *next = rec->next;
+        free(rec);
+        rec = next;
     }
+}
 
-    cands_complex[idx][idx] = cand;
-    return true;
+u32 evcands_complexes_held(void)
+{
+    u32 n = 0;
+    pthread_mutex_lock(&cands_recs_lock);
+    for (CandsRec *rec = cands_recs; rec; rec = rec->next)
+        n++;
+    pthread_mutex_unlock(&cands_recs_lock);
+    return n;
 }
 
+typedef struct {
+    u64 start_idx;
+    u64 end_idx;
+    u32 thread_idx;
+    u32 n_colors;
+    EvBuffer *evb;
+    u32 *colors;
+    EvSet ***l2evsets;
+} cand_para_arg_t;
+
 static void *cand_para_worker(void *arg)
 {
     cand_para_arg_t *ctx = (cand_para_arg_t *)arg;
     pin_thread_by_pid(pthread_self(), ctx->thread_idx);
-    for (u32 idx = ctx->start_idx; idx < ctx->end_idx; idx++) {
-        build_single_cand(idx, ctx->thread_idx, ctx->base_cands,
-                          ctx->cands_complex, ctx->l2evsets, ctx->conf);
-    }
 
-    return NULL;
-}
-
-EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets)
-{
-    u64 start, end;
+    // own page offset per thread, so the threads don't share LLC sets
+    u32 o = ctx->thread_idx % NUM_OFFSETS;
+    EvBuffer *evb = ctx->evb;
+    u64 cnt = ctx->end_idx - ctx->start_idx;
+    u8 **addrs = _calloc(cnt, sizeof(*addrs));
+    EvSet **filters = _calloc(ctx->n_colors, sizeof(*filters));
+    if (!addrs || !filters) {
+        fprintf(stderr, ERR "Failed to allocate the candidate array | n_pages: %lu\n", cnt);
+        goto out;
+    }
 
-    start = time_us();
-    EvCands *base_cands = evcands_new(&l3_info, conf, NULL);
-    if (!base_cands) {
-        fprintf(stderr, ERR "Failed to allocate EvBuffer\n");
-        return NULL;
+    for (u64 n = 0; n < cnt; n++) {
+        u64 p = ctx->start_idx + n;
+        addrs[n] = evb->buf + evb->skew + p * evb->stride + o * CL_SIZE;
+        *addrs[n] = p;
     }
-    end = time_us();
 
-    if (verbose)
-        printf(V1 "Allocated EvCands complex | %.3fms\n",
-              (end - start) / 1e3);
+    for (u32 c = 0; c < ctx->n_colors; c++) {
+        filters[c] = ctx->l2evsets[o][c];
+        filters[c]->build_conf = &def_l2_build_conf;
+    }
 
-    n_unc_l2_sets = g_n_uncertain_l2_sets;
+    u64 start = time_us();
+    evcands_classify(addrs, cnt, filters, ctx->n_colors,
+                     &ctx->colors[ctx->start_idx], &def_l2_build_conf, g_filter_batch);
+    u64 end = time_us();
 
-    start = time_us();
+    u64 n_unk = 0;
+    for (u64 n = 0; n < cnt; n++)
+        n_unk += ctx->colors[ctx->start_idx + n] >= ctx->n_colors;
 
-    EvCands ***cands_complex = _calloc(NUM_OFFSETS, sizeof(*cands_complex));
-    for (u32 n = 0; n < NUM_OFFSETS; n++) {
-        cands_complex[n] = _calloc(n_unc_l2_sets, sizeof(EvCands*));
+    if (verbose) {
+        pthread_mutex_lock(&print_mutex);
+        printf("├─ Thread %3u: Classified %lu candidate lines, %lu unclassified | %.3fms"
+               " (V1: page offset: 0x%x)\n", ctx->thread_idx, cnt, n_unk,
+               (end - start) / 1e3, o * (u32)CL_SIZE);
+        pthread_mutex_unlock(&print_mutex);
     }
 
+out:
+    free(addrs);
+    free(filters);
+    return NULL;
+}
 
+// colors[n] for pages [first, first + cnt) of @p evb, split across the cores
+static void classify_pages_para(EvBuffer *evb, EvSet ***l2evsets, u32 n_colors,
+                                u32 *colors, u64 first, u64 cnt)
+{
     u32 n_threads = g_config.num_threads ? g_config.num_threads : n_system_cores();
-    if (n_threads > n_unc_l2_sets)
-        n_threads = n_unc_l2_sets;
-
-    printf(INFO "Using %u cores to construct EvCands complex in parallel\n", n_threads);
+    n_threads = _max(_min(n_threads, cnt / 256), 1u);
 
     pthread_t tids[n_threads];
     cand_para_arg_t targs[n_threads];
 
-    u32 base_load = n_unc_l2_sets / n_threads;
-    u32 remainder = n_unc_l2_sets % n_threads;
-    u32 curr_idx = 0;
+    u64 base_load = cnt / n_threads;
+    u64 remainder = cnt % n_threads;
+    u64 curr_idx = first;
 
     for (u32 t = 0; t < n_threads; t++) {
-        u32 cnt = base_load + (t < remainder ? 1 : 0);
+        u64 load = base_load + (t < remainder ? 1 : 0);
         targs[t].start_idx = curr_idx;
-        targs[t].end_idx = curr_idx + cnt;
+        targs[t].end_idx = curr_idx + load;
         targs[t].thread_idx = t;
-        targs[t].base_cands = base_cands;
-        targs[t].cands_complex = cands_complex;
+        targs[t].n_colors = n_colors;
+        targs[t].evb = evb;
+        targs[t].colors = colors;
         targs[t].l2evsets = l2evsets;
-        targs[t].conf = conf;
-        curr_idx += cnt;
+        curr_idx += load;
 
         if (pthread_create(&tids[t], NULL, cand_para_worker, &targs[t])) {
             fprintf(stderr, ERR "failed to create candidate thread %u\n", t);
+            for (u64 n = curr_idx - load; n < first + cnt; n++)
+                colors[n] = n_colors;
             n_threads = t;
             break;
         }
@@ -413,20 +770,177 @@ EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets)
     for (u32 t = 0; t < n_threads; t++) {
         pthread_join(tids[t], NULL);
     }
+}
 
-    bool complete = true;
-    for (u32 i = 0; i < n_unc_l2_sets; i++) {
-        if (!cands_complex[i][i]) {
-            complete = false;
-            break;
+// hands the pages of [first, first + cnt) with colors[n] == n_colors back
+static u64 release_pages(EvBuffer *evb, u32 *colors, u32 n_colors,
+                         u64 first, u64 cnt)
+{
+    u64 n_released = 0;
+    for (u64 n = first; n < first + cnt; n++) {
+        if (colors[n] < n_colors)
+            continue;
+
+        u64 run = n;
+        while (run < first + cnt && colors[run] >= n_colors)
+            run++;
+
+        if (evbuffer_release(evb, n, run - n))
+            return n_released;
+
+        n_released += run - n;
+        n = run;
+    }
+    return n_released;
+}
+
+EvCands **evcands_stream_colors(EvBuildConf *conf, EvSet ***l2evsets,
+                                u32 n_colors, u32 n_used)
+{
+    u64 start = time_us();
+    bool stream = g_config.huge_pages == HUGE_OFF; // 2MiB backing can't be split
+    u64 n_full = cache_uncertainty(&l3_info) * l3_info.n_ways * conf->cand_scale;
+    u64 target = _max(n_full / n_colors, 1ul),
+        n_cands = stream ? 2 * n_full : n_full,
+        chunk = stream ? _max(n_full / 8, 1024ul) : n_full;
+
+    EvBuffer *evb = stream ? evbuffer_reserve(&l3_info, n_cands)
+                           : evbuffer_new(&l3_info, conf);
+    u32 *colors = _calloc(n_cands, sizeof(*colors));
+    u64 *counts = _calloc(n_colors + 1, sizeof(*counts));
+    EvCands **res = _calloc(n_colors, sizeof(*res));
+    if (!evb || !colors || !counts || !res) {
+        fprintf(stderr, ERR "Failed to allocate the color buckets\n");
+        goto err;
+    }
+    n_cands = evb->n_cands;
+
+    if (n_colors > 1 && !g_filter_batch) {
+        u64 n_sample = _min(chunk, n_cands);
+        u8 **sample = _calloc(n_sample, sizeof(*sample));
+        if (!sample) {
+            fprintf(stderr, ERR "Failed to allocate the filter calibration sample\n");
+            goto err;
         }
+
+        for (u64 n = 0; n < n_sample; n++) {
+            sample[n] = evb->buf + evb->skew + n * evb->stride;
+            *sample[n] = n;
+        }
+        evcands_filter_init(sample, n_sample, l2evsets[0][0], &def_l2_build_conf);
+        free(sample);
     }
 
-    if (!complete) {
+    printf(INFO "Sorting candidate pages into %u colors | %u in use, %lu pages each\n",
+           n_colors, n_used, target);
+
+    u64 n_seen = 0, n_released = 0, n_full_pools = 0;
+    while (n_seen < n_cands && n_full_pools < n_used) {
+        u64 cnt = _min(chunk, n_cands - n_seen);
+        classify_pages_para(evb, l2evsets, n_colors, colors, n_seen, cnt);
+
+        // first come first kept, until a pool has its target
+        for (u64 n = n_seen; n < n_seen + cnt; n++) {
+            u32 c = colors[n];
+            if (c >= n_used || counts[c] >= target) {
+                colors[n] = n_colors;
+                continue;
+            }
+            n_full_pools += ++counts[c] == target;
+        }
+
+        if (stream)
+            n_released += release_pages(evb, colors, n_colors, n_seen, cnt);
+        n_seen += cnt;
+
+        if (verbose)
+            printf(V1 "Streamed %lu/%lu candidate pages | %lu/%u pools full\n",
+                   n_seen, n_cands, n_full_pools, n_used);
+    }
+
+    // color c at page offset c, as the per-color filtering used to leave it
+    for (u32 c = 0; c < n_used; c++) {
+        if (!counts[c]) {
+            fprintf(stderr, ERR "Failed to filter out candidates for color %u!\n", c);
+            goto err;
+        }
+
+        res[c] = evcands_new(&l3_info, conf, evb);
+        if (!res[c])
+            goto err;
+
+        res[c]->addrs = _calloc(counts[c], sizeof(u8 *));
+        if (!res[c]->addrs) {
+            fprintf(stderr, ERR "Failed to allocate the candidate array | n_pages: %lu\n",
+                    counts[c]);
+            goto err;
+        }
+    }
+
+    for (u64 n = 0; n < n_seen; n++) {
+        u32 c = colors[n];
+        if (c >= n_colors)
+            continue;
+        res[c]->addrs[res[c]->count++] = evb->buf + evb->skew + n * evb->stride
+                                         + (c % NUM_OFFSETS) * CL_SIZE;
+    }
+
+    if (verbose)
+        for (u32 c = 0; c < n_used; c++)
+            printf(V1 "Color %2u: %lu candidate lines\n", c, res[c]->count);
+
+    u64 n_kept = 0;
+    for (u32 c = 0; c < n_used; c++)
+        n_kept += counts[c];
+
+    u64 end = time_us();
+    printf(INFO "Classified %lu candidate pages: kept %lu, released %lu (%.1f MiB) | %.3fms\n",
+           n_seen, n_kept, n_released, n_released * PAGE_SIZE / (f64)(1 << 20),
+           (end - start) / 1e3);
+
+    free(colors);
+    free(counts);
+    return res;
+
+err:
+    if (evb && !evb->ref_cnt) // not held by a pool yet
+        evbuffer_free(evb);
+    else if (res)
+        for (u32 c = 0; c < n_colors; c++)
+            evcands_free(res[c]); // the last one frees evb
+    free(res);
+    free(colors);
+    free(counts);
+    return NULL;
+}
+
+EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets,
+                                  u32 n_used)
+{
+    u64 start, end;
+
+    n_unc_l2_sets = g_n_uncertain_l2_sets;
+    if (!n_used || n_used > n_unc_l2_sets)
+        n_used = n_unc_l2_sets;
+
+    start = time_us();
+
+    EvCands ***cands_complex = _calloc(NUM_OFFSETS, sizeof(*cands_complex));
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        cands_complex[n] = _calloc(n_unc_l2_sets, sizeof(EvCands*));
+    }
+
+    EvCands **colors = evcands_stream_colors(conf, l2evsets, n_unc_l2_sets, n_used);
+    if (!colors) {
         fprintf(stderr, ERR "Failed to populate evcands\n");
         return NULL;
     }
 
+    for (u32 i = 0; i < n_unc_l2_sets; i++) {
+        cands_complex[i][i] = colors[i];
+    }
+    free(colors);
+
     for (u32 i = 0; i < n_unc_l2_sets; i++) {
         if (!cands_complex[i][i])
             continue;
@@ -434,7 +948,7 @@ EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets)
             if (n == i)
                 continue;
             u32 offset = n * CL_SIZE;
-            cands_complex[n][i] = evcands_shift(cands_complex[i][i], offset);
+            cands_complex[n][i] = evcands_view(cands_complex[i][i], offset);
             if (debug > 2 && cands_complex[n][i]) {
                 EvCands *cc = cands_complex[n][i];
                 u16 n_display = _min(2, cc->count);
@@ -442,28 +956,147 @@ EvCands ***build_evcands_all_para(EvBuildConf *conf, EvSet ***l2evsets)
                 printf(D3 "There is %lu candidates; displaying %u\n", cc->count, n_display);
                 for (u16 c = 0; c < n_display; c++) {
                     printf("cands_complex[%u][%u]->addrs[%u]: HPA 0x%lx\n",
-                           n, i, c, va_to_hpa(cc->addrs[c]));
+                           n, i, c, va_to_hpa(evcands_at(cc, c)));
                 }
             }
         }
     }
 
     end = time_us();
+    stats_phase_add(PH_CANDS, end - start);
     printf(INFO "Built EvCands Complex in Parallel | %.3fms\n", (end - start) / 1e3);
 
     print_cand_accuracy(cands_complex, l2evsets);
+    cands_register(cands_complex, n_unc_l2_sets);
     return cands_complex;
 }
 
-EvTestRes test_eviction_detailed(u8 *target, u8 **cands, u64 cnt,
-                                 EvBuildConf *tconf)
+// one prime/traverse/time round. false if the sample is unusable
+static ALWAYS_INLINE bool eviction_trial(u8 *target, u8 **cands, u64 cnt,
+                                         EvBuildConf *tconf, u64 *lat)
+{
+    u32 aux_before, aux_after;
+    _rdtscp_aux(&aux_before);
+
+    _clflushopt(target); // insertion age
+
+    if (tconf->flush_cands) {
+        flush_array(cands, cnt);
+    }
+
+    _lfence();
+    _mfence();
+
+    // load target line
+    for (u32 j = 0; j < tconf->access_cnt; j++) {
+        if (tconf->lower_ev) { // for L3/LLC
+            addrs_traverse(tconf->lower_ev->addrs, tconf->lower_ev->size, tconf);
+        }
+
+        _lfence();
+        maccess(target);
+        _lfence();
+
+        if (tconf->need_helper) {
+            helper_thread_read_single(target, tconf->hctrl);
+            maccess(target);
+        }
+    }
+
+    _lfence();
+
+    if (tconf->foreign_evictor) {
+        helper_thread_traverse_cands(cands, cnt, tconf);
+    } else {
+        tconf->cand_traverse(cands, cnt, tconf);
+    }
+
+    _lfence();
+
+    *lat = _time_maccess(target);
+    _rdtscp_aux(&aux_after);
+    //printf(V1 "Trial - Lat: %lu\n", *lat);
+
+    bool migrated = aux_before != aux_after,
+         intr = *lat > g_lats.interrupt_thresh;
+    stats_inc(migrated ? ST_TRIALS_MIGRATED : intr ? ST_TRIALS_INTR : ST_TRIALS_VALID);
+    return !migrated && !intr;
+}
+
+/*
+  Wald's sequential probability ratio test on over-threshold samples.
+  H0 (not evicted) and H1 (evicted) predict an over-threshold sample with the
+  calibrated p_hit_otp and p_miss_otp, the latter capped at the eviction rate
+  the bounded test accepts (upp_bnd / trials), so both accept the same sets.
+  stops once the log-likelihood ratio crosses log(conf / (1 - conf)) either
+  way; the trial budget is the one of the bounded test (trials * unsure_retry)
+*/
+static EvTestRes test_eviction_sprt(u8 *target, u8 **cands, u64 cnt,
+                                    EvBuildConf *tconf, u32 *n_trials)
+{
+    // an evicting set only needs to evict as often as the bounded test asks
+    f64 p_ev = tconf->trials ? (f64)tconf->upp_bnd / tconf->trials : 1.0;
+    f64 p0 = _min(_max(tconf->p_hit_otp, SPRT_P_FLOOR), 1.0 - SPRT_P_FLOOR),
+        p1 = _min(_max(_min(tconf->p_miss_otp, p_ev), SPRT_P_FLOOR), 1.0 - SPRT_P_FLOOR);
+    if (p1 <= p0) { // calibration unusable
+        p0 = SPRT_P_FLOOR;
+        p1 = 1.0 - SPRT_P_FLOOR;
+    }
+
+    f64 bnd = log(tconf->sprt_conf / (1.0 - tconf->sprt_conf)),
+        step_over = log(p1 / p0),
+        step_under = log((1.0 - p1) / (1.0 - p0)),
+        llr = 0;
+    u32 unsure_retry = tconf->unsure_retry ? tconf->unsure_retry : 1;
+    u32 max_trials = tconf->trials * _max(tconf->test_scale, 1u) * unsure_retry,
+        max_attempts = max_trials * 4,
+        valid_trials = 0;
+    EvTestRes res = EV_NEG_UNSURE;
+
+    for (u32 attempts = 0; valid_trials < max_trials && attempts < max_attempts;
+         attempts++) {
+        u64 lat;
+        if (!eviction_trial(target, cands, cnt, tconf, &lat))
+            continue;
+
+        valid_trials++;
+        llr += lat >= tconf->lat_thresh ? step_over : step_under;
+
+        if (llr >= bnd) {
+            res = EV_POS;
+            break;
+        }
+        if (llr <= -bnd) {
+            res = EV_NEG;
+            break;
+        }
+    }
+
+    if (res != EV_POS && res != EV_NEG) {
+        res = llr > 0 ? EV_POS_UNSURE : EV_NEG_UNSURE;
+        stats_inc(ST_TESTS_UNSURE);
+    }
+
+    if (n_trials)
+        *n_trials = valid_trials;
+    return res;
+}
+
+EvTestRes test_eviction_counted(u8 *target, u8 **cands, u64 cnt,
+                                EvBuildConf *tconf, u32 *n_trials)
 {
+    stats_inc(ST_EV_TESTS);
+    if (tconf->sprt_conf > 0 && tconf->sprt_conf < 1)
+        return test_eviction_sprt(target, cands, cnt, tconf, n_trials);
+
     //u8 *tlb_target = (u8 *)((((u64)target) & ~(PAGE_SIZE - 1)) + (PAGE_SIZE / 2));
     u32 otc = 0; // over-threshold count
     u32 trials = tconf->trials;
     u32 low_bnd = tconf->low_bnd;
     u32 upp_bnd = tconf->upp_bnd;
     u32 unsure_retry = tconf->unsure_retry ? tconf->unsure_retry : 1;
+    u32 used = 0;
+    EvTestRes res;
     
     if (tconf->test_scale > 1) {
         trials *= tconf->test_scale;
@@ -478,72 +1111,51 @@ EvTestRes test_eviction_detailed(u8 *target, u8 **cands, u64 cnt,
         u32 max_attempts = trials * 4;
 
         while (valid_trials < trials && attempts < max_attempts) {
-            u32 aux_before, aux_after;
+            u64 lat;
             attempts++;
-            _rdtscp_aux(&aux_before);
-
-            _clflushopt(target); // insertion age
-
-            if (tconf->flush_cands) {
-                flush_array(cands, cnt);
-            }
-
-            _lfence();
-            _mfence();
-
-            // load target line
-            for (u32 j = 0; j < tconf->access_cnt; j++) {
-                if (tconf->lower_ev) { // for L3/LLC
-                    addrs_traverse(tconf->lower_ev->addrs, tconf->lower_ev->size, tconf);
-                }
-
-                _lfence();
-                maccess(target);
-                _lfence();
-
-                if (tconf->need_helper) {
-                    helper_thread_read_single(target, tconf->hctrl);
-                    maccess(target);
-                }
-            }
-
-            _lfence();
-
-            if (tconf->foreign_evictor) {
-                helper_thread_traverse_cands(cands, cnt, tconf);
-            } else {
-                tconf->cand_traverse(cands, cnt, tconf);
-            }
-
-            _lfence();
-
-            u64 lat = _time_maccess(target);
-            _rdtscp_aux(&aux_after);
-            //printf(V1 "Trial [%u] - Lat: %lu\n", valid_trials, lat);
-
-            if (aux_before != aux_after || lat > g_lats.interrupt_thresh)
+            if (!eviction_trial(target, cands, cnt, tconf, &lat))
                 continue;
 
             valid_trials++;
+            used++;
             if (lat >= tconf->lat_thresh)
                 otc++;
 
-            if (otc >= upp_bnd)
-                return EV_POS;
+            if (otc >= upp_bnd) {
+                res = EV_POS;
+                goto out;
+            }
         }
 
         if (valid_trials < trials / 2)
             continue;
 
-        if (otc >= upp_bnd)
-            return EV_POS;
-        if (otc < low_bnd)
-            return EV_NEG;
+        if (otc >= upp_bnd) {
+            res = EV_POS;
+            goto out;
+        }
+        if (otc < low_bnd) {
+            res = EV_NEG;
+            goto out;
+        }
     }
 
     if (otc >= (low_bnd + upp_bnd) / 2)
-        return EV_POS_UNSURE;
-    return EV_NEG_UNSURE;
+        res = EV_POS_UNSURE;
+    else
+        res = EV_NEG_UNSURE;
+    stats_inc(ST_TESTS_UNSURE);
+
+out:
+    if (n_trials)
+        *n_trials = used;
+    return res;
+}
+
+EvTestRes test_eviction_detailed(u8 *target, u8 **cands, u64 cnt,
+                                 EvBuildConf *tconf)
+{
+    return test_eviction_counted(target, cands, cnt, tconf, NULL);
 }
 
 EvRes test_eviction(u8 *target, u8 **cands, u64 cnt, EvBuildConf *tconf)
@@ -563,7 +1175,7 @@ EvRes verify_evset(EvSet* evset, u8* target)
 
 // modified: https://github.com/zzrcxb/LLCFeasible/
 void evcands_filter_batch(u8** addrs, u64 total_cands, u64* filtered_count, 
-                          EvSet* filter_ev, EvBuildConf* conf)
+                          EvSet* filter_ev, EvBuildConf* conf, u64 batch_sz)
 {
     if (!filter_ev) {
         //*filtered_count = total_cands;
@@ -571,8 +1183,10 @@ void evcands_filter_batch(u8** addrs, u64 total_cands, u64* filtered_count,
         return;
     }
     
-    u64 batch_sz = filter_ev->target_cache->n_ways;
-    if (batch_sz > 2) batch_sz -= 1;
+    if (!batch_sz) {
+        batch_sz = filter_ev->target_cache->n_ways;
+        if (batch_sz > 2) batch_sz -= 1;
+    }
     
     u32* otcs = _calloc(batch_sz, sizeof(u32));
     if (!otcs) {
@@ -610,6 +1224,247 @@ void evcands_filter_batch(u8** addrs, u64 total_cands, u64* filtered_count,
     free(otcs);
 }
 
+/*
+  with batches of at least FILTER_BITWISE_BATCH lines, bit k of a line's color
+  is told apart by two complementary unions: the filter lines of every color
+  with bit k set, and of every color with it clear. L2 sets of different colors
+  are disjoint, so traversing a union evicts exactly the batch lines of its
+  colors. that is 2*log2(n_colors) tests per batch, but each traverses half of
+  all filters, which only pays off for large batches. smaller ones (the
+  calibrated filter_batch on hosts where large batches are unreliable) test
+  each color's filter in turn. either way, a line evicted by both or neither
+  union of a bit, or by other than one filter, is left unclassified
+*/
+#define FILTER_BITWISE_BATCH(n_colors, n_ways) ((n_colors) * (n_ways) / 4)
+
+// upp_bnd of conf->trials, scaled to the @p n_valid samples that were kept
+static bool classify_pos(u32 otc, u32 n_valid, EvBuildConf *conf)
+{
+    return (u64)otc * conf->trials > (u64)conf->upp_bnd * n_valid;
+}
+
+void evcands_classify(u8 **addrs, u64 cnt, EvSet **filters, u32 n_colors,
+                      u32 *colors, EvBuildConf *conf, u64 batch_sz)
+{
+    if (n_colors <= 1) {
+        memset(colors, 0, cnt * sizeof(*colors));
+        return;
+    }
+    stats_add(ST_FILTER_CANDS, cnt);
+
+    u64 n_ways = filters[0]->target_cache->n_ways;
+    bool bitwise = batch_sz >= FILTER_BITWISE_BATCH(n_colors, n_ways);
+
+    u32 n_bits = 0;
+    while ((1u << n_bits) < n_colors)
+        n_bits++;
+    u32 n_tests = bitwise ? 2 * n_bits : n_colors;
+
+    u8 ***unions = _calloc(n_tests, sizeof(*unions));
+    u64 *union_cnt = _calloc(n_tests, sizeof(*union_cnt));
+    u32 *otcs = _calloc(n_tests * batch_sz, sizeof(*otcs)),
+        *valid = _calloc(n_tests * batch_sz, sizeof(*valid));
+    u64 *lats = _calloc(batch_sz, sizeof(*lats));
+    if (!unions || !union_cnt || !otcs || !valid || !lats) {
+        fprintf(stderr, ERR "Failed to allocate the classifier buffers\n");
+        goto fail;
+    }
+
+    // bitwise test 2k + p evicts the colors whose bit k is p, else test c color c
+    for (u32 j = 0; j < n_tests; j++) {
+        u64 total = 0;
+        for (u32 c = 0; c < n_colors; c++)
+            if (bitwise ? ((c >> (j / 2)) & 1) == (j & 1) : c == j)
+                total += filters[c]->size;
+
+        unions[j] = _calloc(total, sizeof(**unions));
+        if (!unions[j]) {
+            fprintf(stderr, ERR "Failed to allocate the classifier buffers\n");
+            goto fail;
+        }
+
+        for (u32 c = 0; c < n_colors; c++) {
+            if (bitwise ? ((c >> (j / 2)) & 1) != (j & 1) : c != j)
+                continue;
+            memcpy(&unions[j][union_cnt[j]], filters[c]->addrs,
+                   filters[c]->size * sizeof(**unions));
+            union_cnt[j] += filters[c]->size;
+        }
+    }
+
+    for (u64 s = 0; s < cnt; s += batch_sz) {
+        u64 cur_batch_sz = _min(batch_sz, cnt - s);
+        memset(otcs, 0, n_tests * batch_sz * sizeof(*otcs));
+        memset(valid, 0, n_tests * batch_sz * sizeof(*valid));
+
+        // interleave the unions within a trial, so slow drift hits all alike
+        for (u32 t = 0; t < conf->trials; t++) {
+            for (u32 j = 0; j < n_tests; j++) {
+                u32 aux_before, aux_after;
+                _rdtscp_aux(&aux_before);
+                access_array(&addrs[s], cur_batch_sz);
+                _lfence();
+                addrs_traverse(unions[j], union_cnt[j], conf);
+                _lfence();
+                for (u32 i = 0; i < cur_batch_sz; i++)
+                    lats[i] = _time_maccess(addrs[s + i]);
+                _rdtscp_aux(&aux_after);
+
+                // as eviction_trial: drop migrated trials and interrupted samples
+                if (aux_before != aux_after)
+                    continue;
+                for (u32 i = 0; i < cur_batch_sz; i++) {
+                    if (lats[i] > g_lats.interrupt_thresh)
+                        continue;
+                    valid[j * batch_sz + i]++;
+                    otcs[j * batch_sz + i] += lats[i] > conf->lat_thresh;
+                }
+            }
+        }
+
+        for (u32 i = 0; i < cur_batch_sz; i++) {
+            u32 color = 0;
+            for (u32 j = 0; j < n_tests && color < n_colors; j++)
+                if (valid[j * batch_sz + i] < conf->trials / 2)
+                    color = n_colors; // too few samples left to tell
+
+            const u32 *o = &otcs[i], *v = &valid[i];
+            if (color < n_colors && bitwise) {
+                for (u32 k = 0; k < n_bits && color < n_colors; k++) {
+                    u64 c0 = (2 * k) * batch_sz, c1 = c0 + batch_sz;
+                    bool clr = classify_pos(o[c0], v[c0], conf),
+                         set = classify_pos(o[c1], v[c1], conf);
+                    color = clr == set ? n_colors : color | (u32)set << k;
+                }
+            } else if (color < n_colors) {
+                u32 n_pos = 0;
+                for (u32 c = 0; c < n_colors; c++) {
+                    if (classify_pos(o[c * batch_sz], v[c * batch_sz], conf)) {
+                        color = c;
+                        n_pos++;
+                    }
+                }
+                color = n_pos == 1 ? color : n_colors;
+            }
+            colors[s + i] = _min(color, n_colors);
+        }
+    }
+
+    goto out;
+
+fail:
+    for (u64 i = 0; i < cnt; i++)
+        colors[i] = n_colors;
+out:
+    if (unions)
+        for (u32 j = 0; j < n_tests; j++)
+            free(unions[j]);
+    free(unions);
+    free(union_cnt);
+    free(otcs);
+    free(valid);
+    free(lats);
+}
+
+u64 evcands_filter(u8 **addrs, u64 cnt, EvSet *filter_ev,
+                   EvBuildConf *conf, u64 batch_sz)
+{
+    u64 n_pos = 0;
+    stats_add(ST_FILTER_CANDS, cnt);
+    if (batch_sz > 1) {
+        evcands_filter_batch(addrs, cnt, &n_pos, filter_ev, conf, batch_sz);
+        return n_pos;
+    }
+
+    for (u64 i = 0; i < cnt; i++) {
+        if (test_eviction(addrs[i], filter_ev->addrs, filter_ev->size, conf) == OK) {
+            _swap(addrs[n_pos], addrs[i]);
+            n_pos += 1;
+        }
+    }
+    return n_pos;
+}
+
+/*
+  filters a sample with every batch size and re-tests each positive on its
+  own. the fastest size within FILTER_CAL_TOL of the best confirmed yield,
+  and with as few unconfirmed positives, wins. falls back to sequential
+*/
+static u64 filter_batch_calibrate(u8 **addrs, u64 cnt, EvSet *filter_ev,
+                                  EvBuildConf *conf)
+{
+    u64 n_ways = filter_ev->target_cache->n_ways;
+    u64 sizes[] = { 1, n_ways / 2, n_ways - 1, 2 * n_ways, 4 * n_ways, 8 * n_ways };
+    u32 n_sizes = sizeof(sizes) / sizeof(*sizes);
+    u64 n_conf[n_sizes], n_pos[n_sizes], lat[n_sizes], best_conf = 0;
+
+    cnt = _min(cnt, FILTER_CAL_SAMPLE * cache_uncertainty(filter_ev->target_cache));
+    u8 **sample = _calloc(cnt, sizeof(*sample));
+    if (!sample) {
+        fprintf(stderr, ERR "Failed to allocate the filter calibration sample\n");
+        return 1;
+    }
+
+    for (u32 b = 0; b < n_sizes; b++) {
+        memcpy(sample, addrs, cnt * sizeof(*sample));
+
+        u64 start = time_us();
+        n_pos[b] = evcands_filter(sample, cnt, filter_ev, conf, sizes[b]);
+        lat[b] = time_us() - start;
+
+        n_conf[b] = 0;
+        for (u64 i = 0; i < n_pos[b]; i++)
+            n_conf[b] += test_eviction(sample[i], filter_ev->addrs, filter_ev->size,
+                                       conf) == OK;
+        best_conf = _max(best_conf, n_conf[b]);
+
+        if (verbose)
+            printf(V1 "filter batch %3lu: %3lu/%3lu positives confirmed | %.3fms\n",
+                   sizes[b], n_conf[b], n_pos[b], lat[b] / 1e3);
+    }
+    free(sample);
+
+    u64 best = 1, best_lat = UINT64_MAX;
+    for (u32 b = 0; b < n_sizes; b++) {
+        bool yield = n_conf[b] >= best_conf * FILTER_CAL_TOL,
+             precise = n_conf[b] >= n_pos[b] * FILTER_CAL_TOL;
+        if (n_conf[b] && yield && precise && lat[b] < best_lat) {
+            best = sizes[b];
+            best_lat = lat[b];
+        }
+    }
+    return best;
+}
+
+void evcands_filter_init(u8 **addrs, u64 cnt, EvSet *filter_ev, EvBuildConf *conf)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&lock);
+    if (!g_filter_batch && g_config.filter_batch) {
+        g_filter_batch = g_config.filter_batch;
+    } else if (!g_filter_batch) {
+        g_filter_batch = filter_batch_calibrate(addrs, cnt, filter_ev, conf);
+        if (g_filter_batch > 1)
+            printf(INFO "Candidate filtering: batches of %u (calibrated)\n", g_filter_batch);
+        else
+            printf(INFO "Candidate filtering: sequential (calibrated)\n");
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+i32 filter_batch_parse(const char *arg)
+{
+    if (!strcasecmp(arg, "auto"))
+        return 0;
+    if (!strcasecmp(arg, "seq"))
+        return 1;
+
+    char *end;
+    long n = strtol(arg, &end, 10);
+    return *end || n < 1 || n > INT32_MAX ? -1 : (i32)n;
+}
+
 u64 prune_evcands(u8 *target, u8 **cands, u64 cnt, EvBuildConf *tconf)
 {
     u64 start_ns = time_us();
@@ -617,6 +1472,7 @@ u64 prune_evcands(u8 *target, u8 **cands, u64 cnt, EvBuildConf *tconf)
         _swap(target, cands[i]);
         EvRes tres = tconf->test(target, cands, cnt, tconf);
         _swap(target, cands[i]);
+        stats_inc(ST_PRUNE_TESTS);
         if (tres == FAIL) {
             cnt -= 1;
             _swap(cands[i], cands[cnt]);
@@ -760,6 +1616,9 @@ void init_def_l2_conf(EvBuildConf* conf)
     
     /* TESTING CONF */
     conf->lat_thresh = g_lats.l2_thresh;
+    conf->sprt_conf = g_config.sprt_conf;
+    conf->p_hit_otp = g_lats.l2_hit_otp;
+    conf->p_miss_otp = g_lats.l2_miss_otp;
     conf->trials = 10;
     conf->low_bnd = 3;
     conf->upp_bnd = 7;
@@ -778,7 +1637,7 @@ void init_def_l2_conf(EvBuildConf* conf)
     /* TESTING CONF */
     
     /* ALGO CONF */
-    conf->algo = STRAW_ZHAO;
+    conf->algo = (EvAlgoType)g_config.ev_algo;
     conf->cap_scaling = 2;
     conf->verify_retry = 5;
     conf->retry_timeout = 20;
@@ -806,6 +1665,9 @@ void init_def_l3_conf(EvBuildConf* conf, EvSet* l2ev, helper_thread_ctrl *hctrl)
     
     // TEST CONF (tconf)
     conf->lat_thresh = g_lats.l3_thresh;
+    conf->sprt_conf = g_config.sprt_conf;
+    conf->p_hit_otp = g_lats.l3_hit_otp;
+    conf->p_miss_otp = g_lats.l3_miss_otp;
     conf->trials = 4;
     conf->low_bnd = 2;
     conf->upp_bnd = 2;
@@ -825,7 +1687,7 @@ void init_def_l3_conf(EvBuildConf* conf, EvSet* l2ev, helper_thread_ctrl *hctrl)
     /* TEST CONF */
     
     /* ALGORITHM CONF */
-    conf->algo = STRAW_ZHAO;
+    conf->algo = (EvAlgoType)g_config.ev_algo;
     conf->cap_scaling = 2;
     conf->verify_retry = 10;
     conf->retry_timeout = 1000;
@@ -869,97 +1731,326 @@ bool build_evset_zhao(u8 *target, EvSet *evset)
             exp_evsz, (void*)target_cache, n_ways, max_bctr, num_carried_cong, 
             lower, upper, n_bctr, iters, is_reset, migrated);
     }
-    
-    // until we have enough addrs or reach max_bctr
+    
+    // until we have enough addrs or reach max_bctr
+    while (evsz < evset->ev_cap && n_bctr < max_bctr) {
+        u32 offset = 0;
+        if (build_conf->slack && evsz > num_carried_cong) {
+            offset = evsz - num_carried_cong;
+        }
+
+        if (evsz > 0 && !is_reset && evsz < n_ways) {
+            u32 rem = n_ways - evsz; // rem > 0
+            cnt = (upper * rem + lower) / (rem + 1);
+            if (cnt == upper) {
+                cnt -= 1;
+            }
+        } else {
+            cnt = (upper + lower) / 2;
+        }
+
+        is_reset = false;
+        u8 **cands_o = cands + offset;
+        bool has_pos = false;
+        
+        while (upper - lower > 1) {
+            if (verbose > 2)
+                printf(V3 "BS: lower=%ld upper=%ld cnt=%ld\n", lower, upper, cnt);
+            EvRes res = build_conf->test(target, cands_o, cnt - offset, build_conf);
+            
+            if (res == OK) {
+                upper = cnt;
+                has_pos = true;
+            } else {
+                lower = cnt;
+                //has_neg = true;
+            }
+            cnt = (upper + lower) / 2;
+        }
+        
+        if (!has_pos && 
+            build_conf->test(target, cands_o, upper - offset, build_conf) == FAIL) {
+            n_bctr += 1;
+            is_reset = true;
+        } else {
+            // found a cong line, add to evset
+            _swap(cands[evsz], cands[upper - 1]);
+            evsz += 1;
+            if (verbose > 2)
+                printf(V3 "Added congruent VA %p, size now: %lu\n", 
+                       cands[evsz-1], evsz);
+        }
+
+        if (evsz >= exp_evsz && build_conf->test(target, cands, evsz, build_conf) == OK) {
+            evsz = prune_evcands(target, cands, evsz, build_conf);
+            if (evsz >= exp_evsz) {
+                break; // only if we still have enough after pruning
+            }
+            n_bctr += 1; // otherwise count as backtrack
+        }
+
+        lower = evsz;
+        
+        if (is_reset || (build_conf->slack && evsz > num_carried_cong)) {
+            if (upper >= migrated) {
+                migrated = n_cands - 1;
+            }
+
+            u64 step = 3 * (1 << target_cache->unknown_sib) / 2;
+            for (u64 i = 0; i < step && upper < migrated; upper++, migrated--, i++) {
+                _swap(cands[upper], cands[migrated]);
+            }
+        }
+
+        if (upper <= lower) {
+            upper = lower + 1;
+            if (upper > n_cands) {
+                fprintf(stderr, ERR "Upper > n_cands in evset build\n");
+                break;
+            }
+        }
+        iters++;
+    }
+
+    evset->size = evsz;
+    memcpy(evset->addrs, cands, sizeof(*cands) * evsz);
+    stats_add(ST_SEARCH_ITERS, iters);
+    stats_add(ST_BACKTRACKS, n_bctr);
+
+    if (verbose > 1)
+        printf("     Built evset. size: %lu | iterations: %ld | backtracks: %ld\n", 
+               evsz, iters, n_bctr);
+    
+    return false;
+}
+
+/*
+  Group testing reduction (Vila et al., Theory and Practice of Finding
+  Eviction Sets). the candidate list must evict the target as a whole;
+  it is split into n_ways+1 groups and any group whose removal keeps the
+  eviction working is dropped. removed groups stack up behind the kept
+  lines, so a false positive is undone by restoring the last group.
+  kept lines end up at the front of cands, like build_evset_zhao
+*/
+bool build_evset_gt(u8 *target, EvSet *evset)
+{
+    u8 **cands = evset->cands->addrs;
+    EvBuildConf *build_conf = evset->build_conf;
+    u64 n_cands = evset->cands->count;
+
+    if (n_cands <= 1) {
+        return true;
+    }
+
+    u32 n_ways = evset->target_cache->n_ways,
+        exp_evsz = n_ways + build_conf->extra_cong;
+    u64 max_bctr = build_conf->max_backtrack;
+    u64 n = n_cands, n_bctr = 0, iters = 0, depth = 0;
+    bool done = false;
+
+    if (build_conf->test(target, cands, n, build_conf) == FAIL) {
+        if (verbose > 1)
+            printf(V2 "GT: candidates (%lu) do not evict the target\n", n);
+        return true;
+    }
+
+    // sizes of the removed groups, most recent last
+    u64 *removed = _calloc(n_cands, sizeof(u64));
+    if (!removed) {
+        fprintf(stderr, ERR "failed to allocate group stack\n");
+        return true;
+    }
+
+    while (!done && n_bctr < max_bctr) {
+        bool reduced = false;
+
+        if (n <= exp_evsz) {
+            if (n >= n_ways && build_conf->test(target, cands, n, build_conf) == OK) {
+                done = true;
+                break;
+            }
+        } else {
+            u64 n_groups = _min(n, (u64)exp_evsz + 1);
+            for (u64 g = 0; g < n_groups; g++) {
+                u64 lo = n * g / n_groups,
+                    hi = n * (g + 1) / n_groups,
+                    len = hi - lo;
+
+                // move the group to the tail and test without it
+                for (u64 i = 0; i < len; i++)
+                    _swap(cands[lo + i], cands[n - len + i]);
+
+                iters++;
+                if (build_conf->test(target, cands, n - len, build_conf) == OK) {
+                    n -= len;
+                    removed[depth++] = len;
+                    reduced = true;
+                    break;
+                }
+
+                for (u64 i = 0; i < len; i++)
+                    _swap(cands[lo + i], cands[n - len + i]);
+            }
+
+            if (verbose > 2)
+                printf(V3 "GT: %lu lines left\n", n);
+        }
+
+        if (!reduced) {
+            // no group can go, or too few lines left: a removal was wrong
+            n_bctr += 1;
+            if (depth == 0)
+                break;
+            n += removed[--depth];
+        }
+    }
+
+    free(removed);
+    stats_add(ST_SEARCH_ITERS, iters);
+    stats_add(ST_BACKTRACKS, n_bctr);
+
+    if (!done) {
+        if (verbose > 1)
+            printf(V2 "GT: reduction failed at %lu lines, backtracks: %lu\n", n, n_bctr);
+        return true;
+    }
+
+    evset->size = n;
+    memcpy(evset->addrs, cands, sizeof(*cands) * n);
+
+    if (verbose > 1)
+        printf("     Built evset. size: %lu | tests: %lu | backtracks: %lu\n",
+               n, iters, n_bctr);
+
+    return false;
+}
+
+/*
+  Binary search for one congruent line at a time (Prime+Scope, Purnal et
+  al.): the shortest evicting prefix of cands ends with a congruent line,
+  which is moved next to the ones already found. O(w log n) tests; a lost
+  line drops the most recent find instead of migrating candidates
+*/
+bool build_evset_bs(u8 *target, EvSet *evset)
+{
+    u8 **cands = evset->cands->addrs;
+    EvBuildConf *build_conf = evset->build_conf;
+    u64 n_cands = evset->cands->count,
+        evsz = 0;
+
+    if (n_cands <= 1) {
+        return true;
+    }
+
+    u32 exp_evsz = evset->target_cache->n_ways + build_conf->extra_cong;
+    u64 max_bctr = build_conf->max_backtrack;
+    u64 upper = n_cands, n_bctr = 0, iters = 0;
+    bool done = false;
+
+    // extra lines beyond exp_evsz absorb replacement noise, pruned at the end
     while (evsz < evset->ev_cap && n_bctr < max_bctr) {
-        u32 offset = 0;
-        if (build_conf->slack && evsz > num_carried_cong) {
-            offset = evsz - num_carried_cong;
+        if (evsz >= exp_evsz &&
+            build_conf->test(target, cands, evsz, build_conf) == OK) {
+            evsz = prune_evcands(target, cands, evsz, build_conf);
+            if (evsz >= exp_evsz) {
+                done = true;
+                break;
+            }
+            n_bctr += 1;
         }
 
-        if (evsz > 0 && !is_reset && evsz < n_ways) {
-            u32 rem = n_ways - evsz; // rem > 0
-            cnt = (upper * rem + lower) / (rem + 1);
-            if (cnt == upper) {
-                cnt -= 1;
-            }
-        } else {
-            cnt = (upper + lower) / 2;
+        // found lines move to the front, so the shortest evicting prefix
+        // only shrinks; widen it again only when it stops evicting
+        if (upper <= evsz)
+            upper = n_cands;
+        if (build_conf->test(target, cands, upper, build_conf) == FAIL) {
+            n_bctr += 1;
+            if (upper < n_cands)
+                upper = n_cands;
+            else if (evsz > 0)
+                evsz -= 1;
+            continue;
         }
 
-        is_reset = false;
-        u8 **cands_o = cands + offset;
-        bool has_pos = false;
-        
+        // test(lower) is assumed to fail, test(upper) evicts
+        u64 lower = evsz;
         while (upper - lower > 1) {
+            u64 cnt = (upper + lower) / 2;
             if (verbose > 2)
-                printf(V3 "BS: lower=%ld upper=%ld cnt=%ld\n", lower, upper, cnt);
-            EvRes res = build_conf->test(target, cands_o, cnt - offset, build_conf);
-            
-            if (res == OK) {
+                printf(V3 "BS: lower=%lu upper=%lu cnt=%lu\n", lower, upper, cnt);
+            if (build_conf->test(target, cands, cnt, build_conf) == OK)
                 upper = cnt;
-                has_pos = true;
-            } else {
+            else
                 lower = cnt;
-                //has_neg = true;
-            }
-            cnt = (upper + lower) / 2;
-        }
-        
-        if (!has_pos && 
-            build_conf->test(target, cands_o, upper - offset, build_conf) == FAIL) {
-            n_bctr += 1;
-            is_reset = true;
-        } else {
-            // found a cong line, add to evset
-            _swap(cands[evsz], cands[upper - 1]);
-            evsz += 1;
-            if (verbose > 2)
-                printf(V3 "Added congruent VA %p, size now: %lu\n", 
-                       cands[evsz-1], evsz);
+            iters++;
         }
 
-        if (evsz >= exp_evsz && build_conf->test(target, cands, evsz, build_conf) == OK) {
-            evsz = prune_evcands(target, cands, evsz, build_conf);
-            if (evsz >= exp_evsz) {
-                break; // only if we still have enough after pruning
-            }
-            n_bctr += 1; // otherwise count as backtrack
-        }
+        _swap(cands[evsz], cands[upper - 1]);
+        evsz += 1;
 
-        lower = evsz;
-        
-        if (is_reset || (build_conf->slack && evsz > num_carried_cong)) {
-            if (upper >= migrated) {
-                migrated = n_cands - 1;
-            }
+        if (verbose > 2)
+            printf(V3 "Added congruent VA %p, size now: %lu\n",
+                   cands[evsz - 1], evsz);
+    }
 
-            u64 step = 3 * (1 << target_cache->unknown_sib) / 2;
-            for (u64 i = 0; i < step && upper < migrated; upper++, migrated--, i++) {
-                _swap(cands[upper], cands[migrated]);
-            }
-        }
+    stats_add(ST_SEARCH_ITERS, iters);
+    stats_add(ST_BACKTRACKS, n_bctr);
 
-        if (upper <= lower) {
-            upper = lower + 1;
-            if (upper > n_cands) {
-                fprintf(stderr, ERR "Upper > n_cands in evset build\n");
-                break;
-            }
-        }
-        iters++;
+    if (!done) {
+        if (verbose > 1)
+            printf(V2 "BS: failed with %lu lines, backtracks: %lu\n", evsz, n_bctr);
+        return true;
     }
 
     evset->size = evsz;
     memcpy(evset->addrs, cands, sizeof(*cands) * evsz);
 
     if (verbose > 1)
-        printf("     Built evset. size: %lu | iterations: %ld | backtracks: %ld\n", 
+        printf("     Built evset. size: %lu | tests: %lu | backtracks: %lu\n",
                evsz, iters, n_bctr);
-    
+
     return false;
 }
 
+static bool (*const ev_algos[N_EV_ALGOS])(u8 *target, EvSet *evset) = {
+    [STRAW_ZHAO]  = build_evset_zhao,
+    [GROUP_TEST]  = build_evset_gt,
+    [BIN_SEARCH]  = build_evset_bs,
+};
+
+static const char *const ev_algo_names[N_EV_ALGOS] = {
+    [STRAW_ZHAO]  = "zhao",
+    [GROUP_TEST]  = "gt",
+    [BIN_SEARCH]  = "bs",
+};
+
+bool build_evset(u8 *target, EvSet *evset)
+{
+    EvAlgoType algo = evset->build_conf->algo;
+    if ((u32)algo >= N_EV_ALGOS) {
+        fprintf(stderr, ERR "unknown evset algorithm %u\n", (u32)algo);
+        return true;
+    }
+
+    bool err = ev_algos[algo](target, evset);
+    stats_inc(err ? ST_EVSETS_FAILED : ST_EVSETS_BUILT);
+    return err;
+}
+
+i32 ev_algo_parse(const char *name)
+{
+    for (u32 i = 0; i < N_EV_ALGOS; i++) {
+        if (strcasecmp(name, ev_algo_names[i]) == 0)
+            return (i32)i;
+    }
+    return -1;
+}
+
+const char *ev_algo_name(EvAlgoType algo)
+{
+    return (u32)algo < N_EV_ALGOS ? ev_algo_names[algo] : "?";
+}
+
 /*
   single L2 evset with retries if needed
   @return eviction set on success, NULL on failure after n_retries
@@ -1029,11 +2120,10 @@ static bool validate_l2_evsets(EvSet **evsets, u32 count, EvBuildConf *conf)
     return true;
 }
 
-EvSet* build_single_l2_evset(EvCands* cands, u8* target, u32 set_idx, 
-                             u8** all_addrs, u64 n_all_addrs) 
+static EvSet *build_l2_evset_from(EvCands *cands, u8 *target, u32 set_idx,
+                                  u8 **all_addrs, u64 n_all_addrs,
+                                  EvBuildConf *conf)
 {
-    init_def_l2_conf(&def_l2_build_conf);
-    EvBuildConf* conf = &def_l2_build_conf;
     bool local_cands = false;
 
     if (!cands) {
@@ -1069,7 +2159,7 @@ EvSet* build_single_l2_evset(EvCands* cands, u8* target, u32 set_idx,
     
     evset->target_addr = target;
     evset->size = 0;
-    evset->ev_cap = def_l2_build_conf.cap_scaling * l2_info.n_ways;
+    evset->ev_cap = conf->cap_scaling * l2_info.n_ways;
     evset->addrs = _calloc(evset->ev_cap, sizeof(u8*));
     if (!evset->addrs) {
         fprintf(stderr, ERR "failed to allocate evset addresses\n");
@@ -1095,7 +2185,7 @@ EvSet* build_single_l2_evset(EvCands* cands, u8* target, u32 set_idx,
         evset->size = 0;
         evset->target_addr = curr_target;
         
-        if (build_evset_zhao(curr_target, evset)) {
+        if (build_evset(curr_target, evset)) {
             fprintf(stderr, WRN "failed to build eviction set %u\n", set_idx);
             n_ret--;
             
@@ -1148,6 +2238,329 @@ EvSet* build_single_l2_evset(EvCands* cands, u8* target, u32 set_idx,
     return evset;
 }
 
+EvSet* build_single_l2_evset(EvCands* cands, u8* target, u32 set_idx, 
+                             u8** all_addrs, u64 n_all_addrs) 
+{
+    init_def_l2_conf(&def_l2_build_conf);
+    return build_l2_evset_from(cands, target, set_idx, all_addrs, n_all_addrs,
+                               &def_l2_build_conf);
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    EvSet **evsets;     // published, one per distinct L2 color
+    u32 n_sets,
+        n_pairs,
+        n_built,
+        in_flight,      // builds started but not yet published or dropped
+        n_attempts,
+        max_attempts;
+    EvCands *pool;      // shared, read-only while workers run
+} l2_para_ctx;
+
+typedef struct {
+    u32 tid;
+    i32 core;
+    l2_para_ctx *ctx;
+    EvCands *cands;     // the pair's working copy of the pool, freed per round
+} l2_para_arg_t;
+
+// flattened addrs of evsets[from:to)
+static u8 **l2_flat_addrs(EvSet **evsets, u32 from, u32 to, u64 *n_addrs)
+{
+    u64 n = 0;
+    for (u32 i = from; i < to; i++)
+        n += evsets[i]->size;
+
+    *n_addrs = n;
+    if (n == 0)
+        return NULL;
+
+    u8 **addrs = _calloc(n, sizeof(*addrs));
+    if (!addrs)
+        return NULL;
+
+    n = 0;
+    for (u32 i = from; i < to; i++) {
+        memcpy(&addrs[n], evsets[i]->addrs, evsets[i]->size * sizeof(*addrs));
+        n += evsets[i]->size;
+    }
+    return addrs;
+}
+
+static bool l2_same_color(EvSet *a, EvSet *b, EvBuildConf *conf)
+{
+    return test_eviction_detailed(a->target_addr, b->addrs, b->size, conf) != EV_NEG ||
+           test_eviction_detailed(b->target_addr, a->addrs, a->size, conf) != EV_NEG;
+}
+
+static void *l2_para_worker(void *arg)
+{
+    l2_para_arg_t *w = arg;
+    l2_para_ctx *ctx = w->ctx;
+    EvBuildConf *conf = &def_l2_build_conf;
+
+    pin_thread_by_pid(pthread_self(), w->core);
+
+    // private copy of the pool, rotated so pairs start on different targets
+    EvCands *cands = _calloc(1, sizeof(*cands));
+    if (!cands)
+        return NULL;
+    *cands = *ctx->pool;
+    cands->pages = NULL;
+    cands->addrs = _calloc(ctx->pool->count, sizeof(*cands->addrs));
+    if (!cands->addrs) {
+        free(cands);
+        return NULL;
+    }
+    w->cands = cands;
+    u64 rot = ctx->pool->count * w->tid / ctx->n_pairs;
+    for (u64 c = 0; c < cands->count; c++)
+        cands->addrs[c] = ctx->pool->addrs[(c + rot) % cands->count];
+
+    while (true) {
+        pthread_mutex_lock(&ctx->lock);
+        // the missing colors are already being built by other pairs
+        if (ctx->n_built + ctx->in_flight >= ctx->n_sets ||
+            ctx->n_attempts >= ctx->max_attempts) {
+            pthread_mutex_unlock(&ctx->lock);
+            break;
+        }
+        ctx->n_attempts++;
+        ctx->in_flight++;
+        u32 seen = ctx->n_built;
+        u64 n_prev = 0;
+        u8 **prev = l2_flat_addrs(ctx->evsets, 0, seen, &n_prev);
+        pthread_mutex_unlock(&ctx->lock);
+
+        // a target no published evset evicts is a color nobody has yet
+        u8 *target = NULL;
+        bool picked = pick_l2_target(cands, NULL, prev, n_prev, conf, &target);
+        free(prev);
+
+        EvSet *ev = picked ? build_l2_evset_from(cands, target, seen, NULL, 0, conf)
+                           : NULL;
+        bool verified = false;
+        for (u32 r = 0; ev && r < 3 && !verified; r++)
+            verified = verify_evset(ev, ev->target_addr) == OK;
+
+        if (!verified) {
+            if (ev) {
+                free(ev->addrs);
+                free(ev);
+            }
+            pthread_mutex_lock(&ctx->lock);
+            ctx->in_flight--;
+            pthread_mutex_unlock(&ctx->lock);
+
+            if (!picked) {
+                if (verbose > 1)
+                    printf(V2 "L2 pair %u: no target of a new color left\n", w->tid);
+                break;
+            }
+            continue;
+        }
+
+        // another pair may have published this color since the snapshot
+        pthread_mutex_lock(&ctx->lock);
+        ctx->in_flight--;
+        bool dup = ctx->n_built >= ctx->n_sets;
+        for (u32 i = seen; i < ctx->n_built && !dup; i++)
+            dup = l2_same_color(ev, ctx->evsets[i], conf);
+        if (!dup)
+            ctx->evsets[ctx->n_built++] = ev;
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (dup) {
+            if (verbose > 1)
+                printf(V2 "L2 pair %u: dropped a duplicate color\n", w->tid);
+            free(ev->addrs);
+            free(ev);
+            continue;
+        }
+
+        if (verbose > 1)
+            printf(V2 "L2 pair %u: built a new color (size: %u)\n", w->tid, ev->size);
+
+        // its lines are of a taken color now
+        for (u32 k = 0; k < ev->size; k++) {
+            for (u64 c = 0; c < cands->count; c++) {
+                if (cands->addrs[c] == ev->addrs[k]) {
+                    _swap(cands->addrs[c], cands->addrs[cands->count - 1]);
+                    cands->count--;
+                    break;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+  main vCPU of each of the first @p n_pairs pairs, picked as
+  build_l3_evsets_para_gran does (vtop pairs or round robin). the helper
+  vCPU of a pair stays idle, it shares the L2. returns the pairs found
+*/
+static u32 l2_para_cores(u32 n_pairs, i32 *cores)
+{
+    i32 n_cores = n_system_cores();
+    n_pairs = _min(n_pairs, (u32)n_cores / 2);
+
+    if (vtop) {
+        cpu_topology_t *topo = get_vcpu_topo();
+        vcpu_pair_assignment_t *vcpu_pairs = topo ? _calloc(n_pairs, sizeof(*vcpu_pairs)) : NULL;
+        u32 valid = vcpu_pairs ? find_optimal_vcpu_pairs(topo, n_pairs, vcpu_pairs) : 0;
+        if (valid) {
+            if (valid < n_pairs)
+                printf(WRN "vTop: found only %u valid vCPU pairs; reducing from requested %u pairs.\n",
+                       valid, n_pairs);
+            for (u32 t = 0; t < valid; t++)
+                cores[t] = vcpu_pairs[t].main_vcpu;
+            free(vcpu_pairs);
+            free(topo);
+            return valid;
+        }
+        fprintf(stderr, WRN "vTop: no vCPU pairs found, proceeding w/o vTop\n");
+        free(vcpu_pairs);
+        free(topo);
+    }
+
+    reset_core_id_counter();
+    for (u32 t = 0; t < n_pairs; t++) {
+        cores[t] = get_next_core_id(n_cores);
+        (void)get_next_core_id(n_cores); // the pair's helper
+    }
+    return n_pairs;
+}
+
+/*
+  builds @p n_sets L2 evsets of distinct colors with one thread per core
+  pair (L2 is private, so pairs do not disturb each other). only failed or
+  duplicate colors are retried; the whole complex is never restarted
+*/
+static EvSet **build_l2_evsets_para(u32 n_sets, u32 n_pairs)
+{
+    EvBuildConf *conf = &def_l2_build_conf;
+    pthread_t *tids = NULL;
+    l2_para_arg_t *targs = NULL;
+    i32 *cores = NULL;
+    l2_para_ctx ctx = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .n_sets = n_sets,
+        .n_pairs = n_pairs,
+        .max_attempts = n_sets * conf->n_retries,
+    };
+
+    ctx.evsets = _calloc(n_sets, sizeof(EvSet*));
+    ctx.pool = evcands_new(&l2_info, conf, NULL);
+    if (!ctx.evsets || !ctx.pool) {
+        fprintf(stderr, ERR "Failed to allocate parallel L2 build state\n");
+        goto err;
+    }
+
+    if (evcands_populate(0, ctx.pool, conf, -1, 0)) {
+        fprintf(stderr, ERR "Failed to populate eviction candidates\n");
+        goto err;
+    }
+
+    tids = _calloc(n_pairs, sizeof(*tids));
+    targs = _calloc(n_pairs, sizeof(*targs));
+    cores = _calloc(n_pairs, sizeof(*cores));
+    if (!tids || !targs || !cores) {
+        fprintf(stderr, ERR "Failed to allocate L2 thread state\n");
+        goto err;
+    }
+
+    n_pairs = l2_para_cores(n_pairs, cores);
+    if (!n_pairs) {
+        fprintf(stderr, ERR "Need at least 2 cores to build L2 evsets in parallel\n");
+        goto err;
+    }
+    ctx.n_pairs = n_pairs;
+    printf(INFO "Using %u core pairs to build %u L2 colors in parallel\n", n_pairs, n_sets);
+
+    for (u32 round = 0; round <= conf->max_whole_ret; round++) {
+        u32 n_started = 0;
+        for (u32 t = 0; t < n_pairs; t++) {
+            targs[t] = (l2_para_arg_t){ .tid = t, .core = cores[t], .ctx = &ctx };
+            if (pthread_create(&tids[t], NULL, l2_para_worker, &targs[t])) {
+                fprintf(stderr, ERR "failed to create L2 thread %u\n", t);
+                break;
+            }
+            n_started++;
+        }
+
+        for (u32 t = 0; t < n_started; t++)
+            pthread_join(tids[t], NULL);
+
+        // the copies die with the round, the evsets fall back to the pool
+        for (u32 i = 0; i < ctx.n_built; i++)
+            ctx.evsets[i]->cands = ctx.pool;
+        for (u32 t = 0; t < n_started; t++) {
+            if (targs[t].cands) {
+                free(targs[t].cands->addrs);
+                free(targs[t].cands);
+            }
+        }
+
+        if (ctx.n_built == n_sets &&
+            validate_l2_evsets(ctx.evsets, n_sets, conf))
+            break;
+
+        // drop the later of every dependent pair and failed self-tests
+        u32 kept = 0;
+        for (u32 i = 0; i < ctx.n_built; i++) {
+            EvSet *ev = ctx.evsets[i];
+            bool bad = verify_evset(ev, ev->target_addr) == FAIL;
+            for (u32 j = 0; j < kept && !bad; j++)
+                bad = l2_same_color(ev, ctx.evsets[j], conf);
+
+            if (bad) {
+                free(ev->addrs);
+                free(ev);
+            } else {
+                ctx.evsets[kept++] = ev;
+            }
+        }
+
+        if (verbose)
+            printf(V1 "L2 para round %u: %u/%u colors kept, retrying the rest\n",
+                   round, kept, n_sets);
+
+        for (u32 i = kept; i < ctx.n_built; i++)
+            ctx.evsets[i] = NULL;
+        ctx.n_built = kept;
+        ctx.n_attempts = 0;
+    }
+
+    if (ctx.n_built != n_sets) {
+        printf(WRN "Couldn't build all uncertain sets (%u/%u) after max retries (%u).\n",
+               ctx.n_built, n_sets, conf->max_whole_ret);
+        goto err;
+    }
+
+    // the pool stays with the evsets, see repair_evset and evset_compact
+    free(tids);
+    free(targs);
+    free(cores);
+    return ctx.evsets;
+
+err:
+    free(tids);
+    free(targs);
+    free(cores);
+    if (ctx.evsets) {
+        for (u32 i = 0; i < ctx.n_built; i++) {
+            free(ctx.evsets[i]->addrs);
+            free(ctx.evsets[i]);
+        }
+        free(ctx.evsets);
+    }
+    evcands_free(ctx.pool);
+    return NULL;
+}
+
 EvSet ***build_l2_evset(u32 num_sets)
 {
     u64 all_start = 0,
@@ -1183,6 +2596,37 @@ EvSet ***build_l2_evset(u32 num_sets)
     u8 **built_evset_addrs = NULL;
     u64 n_built_evset_addrs = 0;
 
+    u32 n_threads = g_config.num_threads ? g_config.num_threads : n_system_cores();
+    u32 n_pairs = _min(n_threads / 2, uncertain_sets_to_build);
+    if (n_pairs > 1) {
+        EvSet **built = build_l2_evsets_para(uncertain_sets_to_build, n_pairs);
+        if (!built)
+            return NULL;
+
+        l2_evset_complex = _calloc(n_offsets, sizeof(EvSet**));
+        if (!l2_evset_complex) {
+            fprintf(stderr, ERR "Failed to allocate evset complex\n");
+            return NULL;
+        }
+
+        l2_evset_complex[0] = built;
+        for (u32 n = 1; n < n_offsets; n++) {
+            l2_evset_complex[n] = _calloc(uncertain_sets_to_build, sizeof(EvSet*));
+            if (!l2_evset_complex[n]) {
+                fprintf(stderr, ERR "Failed to allocate evset array for offset %u\n", n);
+                continue;
+            }
+
+            for (u32 i = 0; i < uncertain_sets_to_build; i++)
+                l2_evset_complex[n][i] = evset_shift(built[i], n * l2_info.cl_size);
+        }
+
+        printf(SUC "Built %u/%u total sets (%u/%u uncertain sets; rest are shifted)\n",
+               uncertain_sets_to_build * n_offsets, total_sets_possible,
+               uncertain_sets_to_build, uncertain_sets_to_build);
+        goto built;
+    }
+
     while (whole_ret <= max_whole_ret) {
         if (l2_evset_complex != NULL) {
             if (verbose)
@@ -1428,6 +2872,7 @@ EvSet ***build_l2_evset(u32 num_sets)
     if (built_evset_addrs)
         free(built_evset_addrs);
 
+built:
     if (debug > 0) {
         srand(time(0)); // in case for d3: random shifted evset
         
@@ -1532,11 +2977,101 @@ EvSet ***build_l2_evset(u32 num_sets)
     }
     
     all_end = time_us();
+    stats_phase_add(PH_L2_BUILD, all_end - all_start);
     printf(INFO "Completed L2 evsets build | %.3fms\n", (all_end - all_start) / 1e3);
     return l2_evset_complex;
 }
 
 
+/*
+  repairs an evset that stopped evicting its target (e.g. a few lines were
+  remapped) without a rebuild: the pool lines that aren't members are appended
+  in doubling chunks until the set evicts again, the shortest evicting prefix
+  is binary searched and pruning drops the members that no longer contribute
+*/
+bool repair_evset(EvSet *evset)
+{
+    EvBuildConf *conf = evset->build_conf;
+    EvCands *pool = evset->cands;
+    u8 *target = evset->target_addr;
+    u64 old_size = evset->size;
+
+    if (conf->test(target, evset->addrs, old_size, conf) == OK)
+        return false; // false alarm
+
+    if (!pool || (!pool->addrs && evcands_materialize(pool)) || !pool->count)
+        return true;
+
+    u8 **work = _calloc(old_size + pool->count, sizeof(*work));
+    if (!work) {
+        fprintf(stderr, ERR "failed to allocate evset repair buffer\n");
+        return true;
+    }
+    memcpy(work, evset->addrs, old_size * sizeof(*work));
+
+    u64 n = old_size,
+        next = 0,
+        chunk = evset->target_cache->n_ways;
+    bool evicts = false;
+    while (!evicts && next < pool->count) {
+        u64 grown = n;
+        for (; next < pool->count && grown - n < chunk; next++) {
+            u8 *addr = pool->addrs[next];
+            if (addr != target && !addr_in_list(addr, evset->addrs, old_size))
+                work[grown++] = addr;
+        }
+        if (grown == n)
+            break;
+
+        evicts = conf->test(target, work, grown, conf) == OK;
+        if (!evicts) {
+            n = grown;
+            chunk *= 2;
+        } else {
+            // the set evicts first somewhere in (n, grown]
+            u64 lo = n, hi = grown;
+            while (hi - lo > 1) {
+                u64 mid = lo + (hi - lo) / 2;
+                if (conf->test(target, work, mid, conf) == OK)
+                    hi = mid;
+                else
+                    lo = mid;
+            }
+            n = hi;
+        }
+    }
+
+    bool err = true;
+    if (!evicts)
+        goto out;
+
+    n = prune_evcands(target, work, n, conf);
+    if (n > evset->ev_cap || conf->test(target, work, n, conf) != OK)
+        goto out;
+
+    if (verbose) {
+        u64 kept = 0;
+        for (u64 i = 0; i < n; i++)
+            kept += addr_in_list(work[i], evset->addrs, old_size);
+        printf(V1 "Repaired evset: kept %lu/%lu lines, %lu replaced | size: %lu\n",
+               kept, old_size, n - kept, n);
+    }
+
+    memcpy(evset->addrs, work, n * sizeof(*work));
+    evset->size = n;
+    err = false;
+
+    // the index and the chain still describe the old lines
+    if (evset->idx.count)
+        evset_compact(evset);
+    if (evset->chain)
+        evset_chain(evset);
+
+out:
+    free(work);
+    return err;
+}
+
 bool final_l3_evset(EvSet* l3ev)
 {
     u64 timeout_start = time_us();
@@ -1546,7 +3081,7 @@ bool final_l3_evset(EvSet* l3ev)
     u32 ret = l3ev->build_conf->verify_retry;
     for (u32 r = 0; r < ret; r++) {
         l3ev->size = 0; // reset
-        bool build_err = build_evset_zhao(target, l3ev);
+        bool build_err = build_evset(target, l3ev);
 
         if (build_err) continue;
         
@@ -1559,6 +3094,10 @@ bool final_l3_evset(EvSet* l3ev)
                 printf("     " V2 "Built evset's verification failed. Size: %u | retry %u/%u \n", 
                        l3ev->size, r + 1, ret);
             }
+            if (l3ev->size && !repair_evset(l3ev)) {
+                can_evict = true;
+                break;
+            }
         }
 
         if (!l3ev->cands || l3ev->cands->count == 0) {
@@ -1585,6 +3124,7 @@ EvSet** build_single_l3_evset(void)
 {
     u64 l3ev_build_start = 0, l3ev_build_end = 0,
         l2_build_start = 0, l2_build_end = 0,
+        cands_start = 0, cands_end = 0,
         topo_start = 0, topo_end = 0,
         all_start = 0, all_end = 0;
 
@@ -1607,6 +3147,7 @@ EvSet** build_single_l3_evset(void)
     l2_build_start = time_us();
     l2_evset = build_single_l2_evset(NULL, NULL, 0, NULL, 0);
     l2_build_end = time_us();
+    stats_phase_add(PH_L2_BUILD, l2_build_end - l2_build_start);
 
     if (!l2_evset) {
         fprintf(stderr, ERR "Failed to build L2 evset\n");
@@ -1668,6 +3209,7 @@ EvSet** build_single_l3_evset(void)
     
     u32 n_built_evsets = 0;
     
+    cands_start = time_us();
     EvCands* l3_cands = evcands_new(&l3_info, &def_l3_build_conf, NULL);
     if (!l3_cands) {
         fprintf(stderr, ERR "failed to allocate L3 cands\n");
@@ -1689,6 +3231,8 @@ EvSet** build_single_l3_evset(void)
         evcands_free(l3_cands);
         return NULL;
     }
+    cands_end = time_us();
+    stats_phase_add(PH_CANDS, cands_end - cands_start);
 
     u64 n_filtered = l3_cands->count;
     if (n_filtered <= 1) {
@@ -1765,6 +3309,7 @@ EvSet** build_single_l3_evset(void)
     l3ev_build_start = time_us();
     bool build_error = final_l3_evset(l3_evset);
     l3ev_build_end = time_us();
+    stats_phase_add(PH_L3_BUILD, l3ev_build_end - l3ev_build_start);
     
     if (build_error) {
         fprintf(stderr, ERR "failed to build L3 eviction set (evset size: %u)\n", 
@@ -2021,6 +3566,10 @@ EvSet **build_evsets_at(u32 offset, EvBuildConf *conf, CacheInfo *cache,
         }
     }
 
+    // offset views get their own array only once a pair actually builds here
+    if (evcands_materialize(cands))
+        goto err;
+
     cands_backup = cands->addrs;
     cands_sz_backup = cands->count;
 
@@ -2160,6 +3709,11 @@ void evcands_free(EvCands *cands)
     if (cands->addrs)
         free(cands->addrs);
 
+    if (cands->pages && --cands->pages->ref_cnt == 0) {
+        free(cands->pages->bases);
+        free(cands->pages);
+    }
+
     free(cands);
 }
 
@@ -2169,12 +3723,17 @@ void free_evset_complex(EvSet ****complex, u32 num_offsets,
     if (!complex)
         return;
     for (u32 off = 0; off < num_offsets; off++) {
+        if (!complex[off])
+            continue;
         for (u32 c = 0; c < num_l2_sets; c++) {
+            if (!complex[off][c])
+                continue; // offset or set that was never built
             for (u32 e = 0; e < evsets_per_l2; e++) {
                 EvSet *ev = complex[off][c][e];
                 if (ev) {
                     if (ev->addrs)
                         free(ev->addrs);
+                    evidx_free(&ev->idx);
                     if (ev->build_conf && ev->build_conf != &def_l3_build_conf &&
                         ev->build_conf != &def_l2_build_conf)
                         free(ev->build_conf);
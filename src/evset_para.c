@@ -252,6 +252,7 @@ gran_pair_assignment_t* calc_gran_assignments(u32 n_pairs, u32 n_offsets, u32 n_
             
             pair_assignments[pair].n_assignments = pair_work_count;
             pair_assignments[pair].pair_idx = pair;
+            pair_assignments[pair].tail = pair_work_count;
             
             // copy work assignments to this pair
             for (u32 i = 0; i < pair_work_count && current_work_idx < total_work; i++) {
@@ -264,6 +265,9 @@ gran_pair_assignment_t* calc_gran_assignments(u32 n_pairs, u32 n_offsets, u32 n_
         }
     }
     
+    for (u32 pair = 0; pair < n_pairs; pair++)
+        pthread_mutex_init(&pair_assignments[pair].lock, NULL);
+
     free(all_work);
     return pair_assignments;
 }
@@ -273,11 +277,75 @@ void free_gran_assignments(gran_pair_assignment_t *assignments, u32 n_pairs)
     if (!assignments) return;
     
     for (u32 i = 0; i < n_pairs; i++) {
+        pthread_mutex_destroy(&assignments[i].lock);
         free(assignments[i].assignments);
     }
     free(assignments);
 }
 
+// takes an item from the back of @p victim, preferring one of @p l2_set_idx (-1: any)
+static bool gran_steal_from(gran_pair_assignment_t *victim, i64 l2_set_idx,
+                            gran_work_assignment_t *work)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&victim->lock);
+    for (u32 k = victim->tail; k > victim->head; k--) {
+        if (l2_set_idx < 0 || victim->assignments[k - 1].l2_set_idx == l2_set_idx) {
+            victim->tail--;
+            *work = victim->assignments[k - 1];
+            victim->assignments[k - 1] = victim->assignments[victim->tail];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return found;
+}
+
+/*
+  next work item of pair @p tp: its own items in order, then items stolen from
+  the other pairs. a thief first looks for the L2 set it built last, whose
+  candidates and L2 evset it has warm, then takes from the fullest deque
+*/
+static bool gran_next_work(thread_pair *tp, i64 last_l2_set,
+                           gran_work_assignment_t *work)
+{
+    gran_pair_assignment_t *own = &tp->gran[tp->thread_idx];
+
+    pthread_mutex_lock(&own->lock);
+    bool found = own->head < own->tail;
+    if (found)
+        *work = own->assignments[own->head++];
+    pthread_mutex_unlock(&own->lock);
+    if (found)
+        return true;
+
+    for (u32 v = 0; last_l2_set >= 0 && v < tp->n_pairs; v++) {
+        if (v != tp->thread_idx && gran_steal_from(&tp->gran[v], last_l2_set, work))
+            goto stolen;
+    }
+
+    while (true) {
+        u32 victim = tp->n_pairs, most = 0;
+        for (u32 v = 0; v < tp->n_pairs; v++) {
+            u32 left = tp->gran[v].tail - tp->gran[v].head; // racy hint only
+            if (v != tp->thread_idx && left > most) {
+                most = left;
+                victim = v;
+            }
+        }
+        if (victim == tp->n_pairs)
+            return false;
+        if (gran_steal_from(&tp->gran[victim], -1, work))
+            goto stolen;
+    }
+
+stolen:
+    own->n_stolen++;
+    return true;
+}
+
 void *evset_thread_worker_gran(void *arg)
 {
     thread_pair *tp = (thread_pair *)arg;
@@ -306,11 +374,15 @@ void *evset_thread_worker_gran(void *arg)
     init_def_l3_conf(&tp->l3_conf, NULL, &tp->helper_ctrl);
     tp->total_built = 0;
     
-    // process all pre-assigned work using granular build_evsets_at
-    for (u32 i = 0; i < my_assignment->n_assignments; i++) {
-        u32 offset_idx = my_assignment->assignments[i].offset_idx;
-        u32 l2_set_idx = my_assignment->assignments[i].l2_set_idx;
+    // own assignments first, then steal from the pairs that are behind
+    gran_work_assignment_t work;
+    i64 last_l2_set = -1;
+    while (gran_next_work(tp, last_l2_set, &work)) {
+        u64 work_start = time_us();
+        u32 offset_idx = work.offset_idx;
+        u32 l2_set_idx = work.l2_set_idx;
         u32 offset = offset_idx * CL_SIZE;
+        last_l2_set = l2_set_idx;
         
         // setup L3 config for this specific L2 set
         init_def_l3_conf(&tp->l3_conf, tp->l2evsets[offset_idx][l2_set_idx], &tp->helper_ctrl);
@@ -343,13 +415,16 @@ void *evset_thread_worker_gran(void *arg)
                        tp->thread_idx, offset, l2_set_idx, l3_evsets[0]->size);
             }
         }
+
+        my_assignment->n_done++;
+        my_assignment->busy_us += time_us() - work_start;
     }
     
     stop_helper_thread(&tp->helper_ctrl);
     
-    printf(SUC "Thread pair %u completed: %lu/%u evsets built\n",
+    printf(SUC "Thread pair %u completed: %lu/%u evsets built (%u stolen assignments)\n",
            tp->thread_idx, tp->total_built,
-           my_assignment->n_assignments * tp->evsets_per_l2);
+           my_assignment->n_done * tp->evsets_per_l2, my_assignment->n_stolen);
     
     return NULL;
 }
@@ -440,7 +515,7 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
     
     // build L3 candidates for selected offsets
     //EvCands ***l3_cands = build_evcands_all(&def_l3_build_conf, l2evsets);
-    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets);
+    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets, n_l2_sets);
     if (!l3_cands) {
         fprintf(stderr, ERR "failed to build L3/LLC candidates\n");
         return NULL;
@@ -524,6 +599,8 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
         pairs[i].n_uncertain_l2_sets = n_unc_l2_sets;
         pairs[i].evsets_per_l2 = g_config.evsets_per_l2;
         pairs[i].idxs = (u32*)&pair_assignments[i]; // assign specific work
+        pairs[i].gran = pair_assignments;
+        pairs[i].n_pairs = n_pairs;
 
         // pinning based on vtop or default
         if (vtop && vcpu_pairs && i < valid_vcpu_pairs) {
@@ -536,7 +613,6 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
         pairs[i].core_id_helper = pairs[i].helper_ctrl.core_id;
 
         pairs[i].helper_ctrl.running = false;
-        pairs[i].helper_ctrl.waiting = false;
     }
     
     printf(INFO "Starting %u thread pairs for granular L3 evset construction\n", n_pairs);
@@ -574,6 +650,15 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
     
     u64 end_time = time_us();
 
+    printf(INFO "Pair utilisation:\n");
+    for (u32 i = 0; i < n_pairs; i++) {
+        gran_pair_assignment_t *pa = &pair_assignments[i];
+        printf("  Pair %2u: %3u/%3u assignments (%u stolen) | busy %.1f%%\n",
+               i, pa->n_done, pa->n_assignments, pa->n_stolen,
+               end_time > start_time
+                   ? pa->busy_us * 100.0 / (end_time - start_time) : 0.0);
+    }
+
     if (debug > 1) {
         printf(D2 "Granular eviction sets:\n");
         
@@ -640,6 +725,7 @@ EvSet**** build_l3_evsets_para_gran(u32 n_l2_sets, u32 n_offsets,
 
 
     
+    stats_phase_add(PH_L3_BUILD, end_time - start_time);
     printf(SUC "granular construction completed | %.3fms\n",
           (end_time - start_time) / 1e3);
     u32 total_possible = n_l2_sets * n_offsets * g_config.evsets_per_l2;
@@ -920,7 +1006,7 @@ EvSet**** build_l3_evsets_para(u32 n_offset)
     init_def_l3_conf(&def_l3_build_conf, NULL, NULL);
     
     //EvCands ***l3_cands = build_evcands_all(&def_l3_build_conf, l2evsets);
-    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets);
+    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets, 0);
     if (!l3_cands) {
         fprintf(stderr, ERR "failed to build L3/LLC candidates\n");
         return NULL;
@@ -966,7 +1052,6 @@ EvSet**** build_l3_evsets_para(u32 n_offset)
         pairs[i].core_id_helper = get_next_core_id(n_cores);
 
         pairs[i].helper_ctrl.running = false;
-        pairs[i].helper_ctrl.waiting = false;
     }
     
     printf(INFO "Starting %u thread pairs for L3 evset construction\n", n_pairs);
@@ -995,6 +1080,7 @@ EvSet**** build_l3_evsets_para(u32 n_offset)
     
     u64 end_time = time_us();
     
+    stats_phase_add(PH_L3_BUILD, end_time - start_time);
     printf(SUC "Parallel evset construction completed | %.3fms\n", 
           (end_time - start_time) / 1e3);
     u32 tot_possible = n_offset * cache_uncertainty(&l3_info);
@@ -1120,7 +1206,7 @@ EvSet**** build_l3_evsets_para_vtop(u32 n_offset)
     init_def_l3_conf(&def_l3_build_conf, NULL, NULL);
     
     //EvCands ***l3_cands = build_evcands_all(&def_l3_build_conf, l2evsets);
-    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets);
+    EvCands ***l3_cands = build_evcands_all_para(&def_l3_build_conf, l2evsets, 0);
     if (!l3_cands) {
         //already printed within evcands_populate
         //fprintf(stderr, ERR "failed to allocate or filter L3/LLC candidates\n");
@@ -1337,6 +1423,7 @@ EvSet**** build_l3_evsets_para_vtop(u32 n_offset)
         total_built += pairs[i].total_built;
     }
     
+    stats_phase_add(PH_L3_BUILD, end_time - start_time);
     printf(SUC "Parallel topology-aware construction completed | %.3fs\n",
           (end_time - start_time) / 1e6);
     printf(SUC "Total built: %lu/%lu L3 evsets\n",
@@ -3,6 +3,44 @@
 #include "../include/cache_ops.h"
 #include "../include/asm.h"
 #include "../include/evset.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+void helper_wake(helper_thread_ctrl *ctrl)
+{
+    if (atomic_exchange(&ctrl->sleeping, 0))
+        syscall(SYS_futex, &ctrl->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*
+  head once it moves past @p tail. polls for HELPER_IDLE_US, then blocks until
+  helper_submit wakes it: the head store and the sleeping load on one side,
+  and the sleeping store and head load here, are seq_cst, so either the
+  producer sees sleeping or this side sees the new head
+*/
+static u64 helper_next(helper_thread_ctrl *ctrl, u64 tail)
+{
+    u64 head, idle_from = 0;
+    u32 polls = 0;
+
+    while ((head = atomic_load_explicit(&ctrl->head, memory_order_acquire)) == tail) {
+        if (++polls % HELPER_POLLS)
+            continue;
+
+        u64 now = time_us();
+        if (!idle_from)
+            idle_from = now;
+        if (now - idle_from < HELPER_IDLE_US)
+            continue;
+
+        atomic_store(&ctrl->sleeping, 1);
+        if (atomic_load(&ctrl->head) == tail)
+            syscall(SYS_futex, &ctrl->sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+        atomic_store(&ctrl->sleeping, 0);
+        idle_from = 0;
+    }
+    return head;
+}
 
 void *helper_thread_worker(void * _args) {
     helper_thread_ctrl *ctrl = _args;
@@ -16,35 +54,54 @@ void *helper_thread_worker(void * _args) {
         }
     }
 
+    u64 tail = 0;
+    atomic_store_explicit(&ctrl->ready, 1, memory_order_release);
+
     while (true) {
-        ctrl->waiting = true;
-        while (ctrl->waiting);
-        switch (ctrl->action) {
-            case HELPER_STOP: {
-                return NULL;
-            }
-            case READ_SINGLE: {
-                maccess((u8 *)ctrl->payload);
-                break;
-            }
-            case TIME_SINGLE: {
-                u8 *ptr = (u8 *)ctrl->payload;
-                ctrl->lat = _time_maccess(ptr);
-                break;
-            }
-            case READ_ARRAY: {
-                struct helper_thread_read_array *arr = ctrl->payload;
+        u64 head = helper_next(ctrl, tail);
 
-                prime_cands_daniel(arr->addrs, arr->cnt, arr->repeat,
-                                   arr->stride, arr->block);
-                break;
-            }
-            case TRAVERSE_CANDS: {
-                struct helper_thread_traverse_cands *cmd = ctrl->payload;
-                cmd->traverse(cmd->cands, cmd->cnt, cmd->tconfig);
-                break;
+        // the whole batch runs before it is handed back
+        for (; tail != head; tail++) {
+            helper_cmd *cmd = &ctrl->slots[tail & (HELPER_RING_SIZE - 1)];
+            switch (cmd->action) {
+                case HELPER_STOP: {
+                    atomic_store_explicit(&ctrl->tail, tail + 1, memory_order_release);
+                    return NULL;
+                }
+                case READ_SINGLE: {
+                    maccess(cmd->line);
+                    break;
+                }
+                case TIME_SINGLE: {
+                    cmd->lat = _time_maccess(cmd->line);
+                    break;
+                }
+                case READ_ARRAY: {
+                    struct helper_thread_read_array *arr = &cmd->arr;
+
+                    prime_cands_pattern(arr->addrs, arr->cnt, arr->repeat,
+                                        arr->stride, arr->block, arr->bwd, arr->dbl);
+                    break;
+                }
+                case READ_IDX: {
+                    struct helper_thread_read_idx *ri = &cmd->ridx;
+
+                    prime_idx_pattern(ri->base, ri->idxs, ri->cnt, ri->repeat,
+                                      ri->stride, ri->block, ri->bwd, ri->dbl);
+                    break;
+                }
+                case TRAVERSE_CANDS: {
+                    struct helper_thread_traverse_cands *tc = &cmd->trav;
+                    tc->traverse(tc->cands, tc->cnt, tc->tconfig);
+                    break;
+                }
+                case WAIT_UNTIL: {
+                    wait_until_tsc(cmd->deadline);
+                    break;
+                }
             }
         }
+        atomic_store_explicit(&ctrl->tail, tail, memory_order_release);
     }
 }
 
@@ -9,6 +9,10 @@
 
 CacheLats g_lats = {0};
 
+// calibration samples, kept until the thresholds are known (see lat_otp)
+static i32 *l2_samples, *l3_samples, *dram_samples;
+static u32 n_l2_samples, n_l3_samples, n_dram_samples;
+
 static ALWAYS_INLINE i32 compare_lats(const void *lhs, const void *rhs) 
 {
     const i32 *l = (const i32 *)lhs, *r = (const i32 *)rhs;
@@ -147,6 +151,11 @@ void init_dram_lat(u32 reps)
 
     g_lats.dram = median;
 
+    free(dram_samples);
+    dram_samples = lats_arr; // unset entries stay 0 and are skipped
+    n_dram_samples = reps;
+    lats_arr = NULL;
+
 err:
     free(target);
     free(lats_arr);
@@ -223,6 +232,10 @@ void init_l2_lat(u32 reps)
         fprintf(stderr, ERR "too many context switches during l2 latency detection\n");
     } else {
         median = calc_median(measurements, lat_cnt);
+        free(l2_samples);
+        l2_samples = measurements;
+        n_l2_samples = lat_cnt;
+        measurements = NULL;
     }
     g_lats.l2 = median;
     
@@ -239,7 +252,9 @@ void init_l3_lat(u32 reps)
     
     for (u32 attempt = 0; attempt < max_ret; attempt++) {
         u32 aux1, aux2;
-        u32 ev_size = 2.5 * l2_info.n_ways * g_n_uncertain_l2_sets;
+        // 4KiB stride: cover every L2 color whatever backs the buffer
+        u32 l2_colors = 1u << (l2_info.n_cl_bits + l2_info.n_set_idx_bits - PAGE_OFFSET_BITS);
+        u32 ev_size = 2.5 * l2_info.n_ways * l2_colors;
         u32 buf_size = (ev_size + 2) * PAGE_SIZE;
         u8 *ev_buf = _calloc(buf_size, 1);
         i32 *measurements = _calloc(reps, sizeof(i32));
@@ -301,7 +316,9 @@ void init_l3_lat(u32 reps)
         g_lats.l3 = median;
         
         free(ev_buf);
-        free(measurements);
+        free(l3_samples);
+        l3_samples = measurements;
+        n_l3_samples = lat_cnt;
         return; // success
     }
     
@@ -310,8 +327,25 @@ void init_l3_lat(u32 reps)
     exit(EXIT_FAILURE);
 }
 
+// fraction of (non-zero) samples at or above thresh
+static f64 lat_otp(i32 *samples, u32 cnt, u64 thresh)
+{
+    u32 n = 0, over = 0;
+    for (u32 i = 0; i < cnt; i++) {
+        if (samples[i] <= 0)
+            continue;
+        n++;
+        if ((u64)samples[i] >= thresh)
+            over++;
+    }
+    return n ? (f64)over / n : 0.0;
+}
+
 void init_cache_lats_thresh(u32 reps)
 {
+    // thresholds below are in the unit of the chosen source
+    timer_init((TimerSrc)g_config.timer_src);
+
     // setting up interrupt threshold first, because it's
     // used to sanity check measurements for upcoming functions
     init_dram_lat(reps); 
@@ -330,4 +364,15 @@ void init_cache_lats_thresh(u32 reps)
     if (g_lats.l3_thresh > (u32)g_lats.l3 * 2.5) {
         g_lats.l3_thresh = g_lats.l3 * 2; // adjust abnormal cases
     }
+
+    g_lats.l2_hit_otp = lat_otp(l2_samples, n_l2_samples, g_lats.l2_thresh);
+    g_lats.l2_miss_otp = lat_otp(l3_samples, n_l3_samples, g_lats.l2_thresh);
+    g_lats.l3_hit_otp = lat_otp(l3_samples, n_l3_samples, g_lats.l3_thresh);
+    g_lats.l3_miss_otp = lat_otp(dram_samples, n_dram_samples, g_lats.l3_thresh);
+
+    free(l2_samples);
+    free(l3_samples);
+    free(dram_samples);
+    l2_samples = l3_samples = dram_samples = NULL;
+    n_l2_samples = n_l3_samples = n_dram_samples = 0;
 }
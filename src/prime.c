@@ -0,0 +1,327 @@
+#include "../include/prime.h"
+#include "../include/evset.h"
+#include "../include/cache_ops.h"
+#include "../include/cache_info.h"
+#include "../include/helper_thread.h"
+#include "../include/lats.h"
+#include "../include/utils.h"
+#include <string.h>
+
+#define PRIME_MAX_PASSES 10
+#define PRIME_TUNE_RELIABLE 0.98
+#define PRIME_TUNE_MAX_REPEAT 3
+
+PrimePattern g_prime = {
+    .repeat = 1,
+    .block = 24,
+    .stride = 12,
+    .bwd = true,
+    .dbl = false,
+    .max_passes = PRIME_MAX_PASSES,
+};
+
+// block/stride points of the search, 0 is the whole set. the first is the default
+static const struct { u32 block, stride; } tune_grid[] = {
+    {24, 12}, {0, 0}, {0, 1}, {0, 2}, {0, 4},
+    {2, 1}, {2, 2}, {4, 1}, {4, 2}, {4, 4}, {8, 1}, {8, 2}, {8, 4}, {8, 8},
+};
+
+void prime_pattern_str(const PrimePattern *p, char *buf, u32 len)
+{
+    char block[12] = "all", stride[12] = "all";
+    if (p->block)
+        snprintf(block, sizeof(block), "%u", p->block);
+    if (p->stride)
+        snprintf(stride, sizeof(stride), "%u", p->stride);
+
+    snprintf(buf, len, "repeat %u, block %s, stride %s, %s%s, %u pass%s",
+             p->repeat, block, stride, p->bwd ? "bwd" : "fwd",
+             p->dbl ? " + return walk" : "", p->max_passes,
+             p->max_passes > 1 ? "es" : "");
+}
+
+// traverse_cands_mt with the pattern instead of the build config
+void prime_pattern_run(EvSet *evset, const PrimePattern *p)
+{
+    EvBuildConf *conf = evset->build_conf;
+    u64 cnt = evset->size,
+        block = p->block ? p->block : cnt,
+        stride = p->stride ? p->stride : cnt;
+
+    // a compacted evset may have dropped its pointer array (evset.h)
+    EvIdx *idx = evset->idx.count == cnt ? &evset->idx : NULL;
+
+    helper_cmd *cmd = helper_cmd_slot(conf->hctrl, 0);
+    if (idx) {
+        cmd->action = READ_IDX;
+        cmd->ridx = (struct helper_thread_read_idx)
+        {
+            .base = idx->base,
+            .idxs = idx->idxs,
+            .cnt = cnt,
+            .repeat = p->repeat,
+            .block = block,
+            .stride = stride,
+            .bwd = p->bwd,
+            .dbl = p->dbl
+        };
+    } else {
+        cmd->action = READ_ARRAY;
+        cmd->arr = (struct helper_thread_read_array)
+        {
+            .addrs = evset->addrs,
+            .cnt = cnt,
+            .repeat = p->repeat,
+            .block = block,
+            .stride = stride,
+            .bwd = p->bwd,
+            .dbl = p->dbl
+        };
+    }
+    helper_submit(conf->hctrl, 1);
+
+    if (idx)
+        prime_idx_pattern(idx->base, idx->idxs, cnt, p->repeat, stride, block,
+                          p->bwd, p->dbl);
+    else
+        prime_cands_pattern(evset->addrs, cnt, p->repeat, stride, block, p->bwd, p->dbl);
+    if (cnt < l2_info.n_ways && conf->lower_ev) {
+        addrs_traverse(conf->lower_ev->addrs, conf->lower_ev->size,
+                       conf->lower_ev->build_conf);
+        _lfence();
+        if (idx)
+            access_idx_bwd(idx->base, idx->idxs, cnt);
+        else
+            access_array_bwd(evset->addrs, cnt);
+    }
+
+    wait_helper_thread(conf->hctrl);
+}
+
+/*
+  one prime as l2c_occ_scan does it, then a probe in the same order.
+  1 if every line stayed resident, 0 if not, -1 if a probe was interrupted
+*/
+static i32 prime_trial(EvSet *ev, const PrimePattern *p, u64 *cycles)
+{
+    EvSet *lower = ev->build_conf->lower_ev;
+
+    flush_array(ev->addrs, ev->size);
+    _lfence();
+    if (lower)
+        addrs_traverse(lower->addrs, lower->size, lower->build_conf);
+    _lfence();
+
+    u64 start = _rdtsc();
+    prime_pattern_run(ev, p);
+    _lfence();
+    *cycles = _rdtsc() - start;
+
+    i32 resident = 1;
+    for (i32 i = ev->size - 1; i >= 0; i--) {
+        u64 lat = _time_maccess(ev->addrs[i]);
+        if (lat >= g_lats.interrupt_thresh)
+            return -1;
+        if (lat >= g_lats.l3_thresh)
+            resident = 0;
+    }
+    return resident;
+}
+
+// reliability and median cycles of one pattern over all evsets
+static void prime_eval(EvSet **evsets, u32 n_evsets, u32 trials, const PrimePattern *p,
+                       u64 *cyc, f64 *reliability, u64 *median)
+{
+    u64 n_valid = 0, n_resident = 0;
+    for (u32 t = 0; t < trials; t++) {
+        for (u32 e = 0; e < n_evsets; e++) {
+            u64 cycles;
+            i32 res = prime_trial(evsets[e], p, &cycles);
+            if (res < 0)
+                continue;
+            cyc[n_valid++] = cycles;
+            n_resident += res;
+        }
+    }
+
+    *reliability = n_valid ? (f64)n_resident / n_valid : 0;
+    if (n_valid) {
+        qsort(cyc, n_valid, sizeof(*cyc), compare_u64);
+        *median = cyc[n_valid / 2];
+    } else {
+        *median = UINT64_MAX;
+    }
+}
+
+bool prime_tune(EvSet **evsets, u32 n_evsets, u32 trials, PrimePattern *best)
+{
+    if (!n_evsets || !trials) {
+        fprintf(stderr, ERR "no evsets to tune the prime pattern on\n");
+        return true;
+    }
+
+    u64 *cyc = _calloc((u64)trials * n_evsets, sizeof(*cyc));
+    if (!cyc) {
+        fprintf(stderr, ERR "failed to allocate prime tuning samples\n");
+        return true;
+    }
+
+    u32 n_points = sizeof(tune_grid) / sizeof(*tune_grid);
+    f64 best_rel = -1, def_rel = 0;
+    u64 best_cyc = UINT64_MAX, def_cyc = 0;
+    bool reliable_found = false;
+    char desc[96];
+
+    for (u32 g = 0; g < n_points; g++) {
+        for (u32 repeat = 1; repeat <= PRIME_TUNE_MAX_REPEAT; repeat++) {
+            for (u32 dir = 0; dir < 4; dir++) {
+                PrimePattern p = {
+                    .repeat = repeat,
+                    .block = tune_grid[g].block,
+                    .stride = tune_grid[g].stride,
+                    .bwd = !(dir & 1),
+                    .dbl = dir & 2,
+                    .max_passes = 1,
+                };
+
+                f64 rel;
+                u64 med;
+                prime_eval(evsets, n_evsets, trials, &p, cyc, &rel, &med);
+
+                if (g == 0 && repeat == 1 && dir == 0) {
+                    def_rel = rel;
+                    def_cyc = med;
+                }
+
+                if (verbose > 1) {
+                    prime_pattern_str(&p, desc, sizeof(desc));
+                    printf(V2 "prime %-50s | %8lu cycles | resident %6.2f%%\n",
+                           desc, med, rel * 100);
+                }
+
+                bool reliable = rel >= PRIME_TUNE_RELIABLE, better;
+                if (reliable)
+                    better = !reliable_found || med < best_cyc;
+                else
+                    better = !reliable_found &&
+                             (rel > best_rel || (rel == best_rel && med < best_cyc));
+
+                if (better) {
+                    *best = p;
+                    best_rel = rel;
+                    best_cyc = med;
+                    reliable_found |= reliable;
+                }
+            }
+        }
+    }
+    free(cyc);
+
+    // unreliable in one pass: keep re-priming until the set reads back resident
+    if (!reliable_found) {
+        best->max_passes = PRIME_MAX_PASSES;
+        printf(WRN "no prime pattern leaves all lines resident in %.0f%% of the trials\n",
+               PRIME_TUNE_RELIABLE * 100);
+    }
+
+    printf(INFO "Default prime pattern: %lu cycles, resident %.2f%%\n", def_cyc, def_rel * 100);
+    prime_pattern_str(best, desc, sizeof(desc));
+    printf(SUC "Tuned prime pattern (%s): %lu cycles, resident %.2f%%\n",
+           desc, best_cyc, best_rel * 100);
+    return false;
+}
+
+static void host_id(char *cpu, u32 cpu_len, char *llc, u32 llc_len)
+{
+    snprintf(cpu, cpu_len, "unknown");
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            char *val = strchr(line, ':');
+            if (strncmp(line, "model name", 10) || !val)
+                continue;
+            val += 1 + strspn(val + 1, " \t");
+            val[strcspn(val, "\n")] = 0;
+            snprintf(cpu, cpu_len, "%s", val);
+            break;
+        }
+        fclose(f);
+    }
+
+    snprintf(llc, llc_len, "%ux%ux%u", l3_info.n_sets_one_slice, l3_info.n_ways,
+             l3_info.n_slices);
+}
+
+bool prime_profile_save(const char *path, const PrimePattern *p)
+{
+    if (ensure_data_dir() == -1)
+        return true;
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, ERR "cannot write prime profile %s\n", path);
+        return true;
+    }
+
+    char cpu[128], llc[48];
+    host_id(cpu, sizeof(cpu), llc, sizeof(llc));
+    fprintf(f, "# prime pattern tuned by vset --tune-prime\n");
+    fprintf(f, "cpu=%s\nllc=%s\n", cpu, llc);
+    fprintf(f, "repeat=%u\nblock=%u\nstride=%u\nbwd=%u\ndbl=%u\nmax_passes=%u\n",
+            p->repeat, p->block, p->stride, p->bwd, p->dbl, p->max_passes);
+    fclose(f);
+
+    printf(INFO "Prime profile written to: %s\n", path);
+    return false;
+}
+
+bool prime_profile_load(const char *path, PrimePattern *p)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return true;
+
+    char cpu[128], llc[48], line[256];
+    host_id(cpu, sizeof(cpu), llc, sizeof(llc));
+
+    PrimePattern loaded = *p;
+    bool same_host = true;
+    while (fgets(line, sizeof(line), f)) {
+        char *val = strchr(line, '=');
+        if (line[0] == '#' || !val)
+            continue;
+        *val++ = 0;
+        val[strcspn(val, "\n")] = 0;
+
+        if (!strcmp(line, "cpu"))
+            same_host &= !strcmp(val, cpu);
+        else if (!strcmp(line, "llc"))
+            same_host &= !strcmp(val, llc);
+        else if (!strcmp(line, "repeat"))
+            loaded.repeat = strtoul(val, NULL, 10);
+        else if (!strcmp(line, "block"))
+            loaded.block = strtoul(val, NULL, 10);
+        else if (!strcmp(line, "stride"))
+            loaded.stride = strtoul(val, NULL, 10);
+        else if (!strcmp(line, "bwd"))
+            loaded.bwd = strtoul(val, NULL, 10);
+        else if (!strcmp(line, "dbl"))
+            loaded.dbl = strtoul(val, NULL, 10);
+        else if (!strcmp(line, "max_passes"))
+            loaded.max_passes = strtoul(val, NULL, 10);
+    }
+    fclose(f);
+
+    if (!same_host) {
+        printf(WRN "%s was tuned on another host, ignoring it\n", path);
+        return true;
+    }
+    if (!loaded.repeat || !loaded.max_passes) {
+        fprintf(stderr, ERR "invalid prime profile %s\n", path);
+        return true;
+    }
+
+    *p = loaded;
+    return false;
+}
@@ -0,0 +1,689 @@
+/*
+* software LLC simulator backend (see include/sim.h)
+*/
+#include "../include/sim.h"
+#include "../include/mem.h"
+#include "../vm_tools/gpa_hpa.h"
+#include <pthread.h>
+#include <strings.h>
+
+typedef struct {
+    u64 tag;     // line number + 1, 0 is invalid
+    u64 stamp;   // LRU: last use tick, PLRU: MRU bit
+    bool shared; // LLC only: line may live in several private caches
+} SimLine;
+
+typedef struct {
+    u32 n_sets, n_ways;
+    SimRepl repl;
+    SimLine *lines;
+} SimCache;
+
+typedef struct {
+    SimCache l1, l2;
+} SimCore;
+
+typedef struct {
+    u32 core;
+    u64 vtsc;
+    u64 bg_tsc;  // vtsc at the last background eviction step
+    f64 bg_acc;  // fractional background evictions carried over
+    bool init;
+} SimThread;
+
+static struct {
+    SimConf conf;
+    SimCache llc;
+    SimCore *cores[SIM_MAX_CORES];
+    SimStats stats;
+    bool core_busy[SIM_MAX_CORES];
+    u64 tick;
+    u64 rng;
+    pthread_key_t core_key; // releases a thread's core on exit
+    pthread_mutex_t lock;
+} sim;
+
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+static bool sim_ready = false;
+static __thread SimThread st;
+
+// Maurice et al., "Reverse engineering Intel last-level cache complex addressing"
+static const u64 def_xor_masks[3] = {
+    0x1b5f575440ULL, 0x2eb5faa880ULL, 0x3cccc93100ULL
+};
+
+static inline u64 mix64(u64 x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline u64 sim_rand(void)
+{
+    sim.rng ^= sim.rng << 13;
+    sim.rng ^= sim.rng >> 7;
+    sim.rng ^= sim.rng << 17;
+    return sim.rng;
+}
+
+static inline f64 sim_rand_f64(void)
+{
+    return (f64)(sim_rand() >> 11) / (f64)(1ULL << 53);
+}
+
+static bool cache_alloc(SimCache *c, u32 n_sets, u32 n_ways, SimRepl repl)
+{
+    c->n_sets = n_sets;
+    c->n_ways = n_ways;
+    c->repl = repl;
+    c->lines = _calloc((u64)n_sets * n_ways, sizeof(SimLine));
+    return c->lines != NULL;
+}
+
+static inline SimLine *cache_set(SimCache *c, u32 set)
+{
+    return &c->lines[(u64)set * c->n_ways];
+}
+
+static inline i32 cache_lookup(SimCache *c, u32 set, u64 tag)
+{
+    SimLine *s = cache_set(c, set);
+    for (u32 w = 0; w < c->n_ways; w++)
+        if (s[w].tag == tag)
+            return (i32)w;
+    return -1;
+}
+
+static inline void cache_touch(SimCache *c, u32 set, u32 way)
+{
+    SimLine *s = cache_set(c, set);
+    if (c->repl == SIM_REPL_PLRU) {
+        s[way].stamp = 1;
+        for (u32 w = 0; w < c->n_ways; w++)
+            if (!s[w].stamp)
+                return;
+        // all MRU bits set, keep only the last one
+        for (u32 w = 0; w < c->n_ways; w++)
+            s[w].stamp = (w == way);
+    } else {
+        s[way].stamp = ++sim.tick;
+    }
+}
+
+// inserts tag and returns the evicted line (tag 0 if an invalid way was used)
+static SimLine cache_fill(SimCache *c, u32 set, u64 tag, bool shared)
+{
+    SimLine *s = cache_set(c, set);
+    u32 victim = 0;
+    bool found = false;
+
+    for (u32 w = 0; w < c->n_ways; w++) {
+        if (!s[w].tag) {
+            victim = w;
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        switch (c->repl) {
+        case SIM_REPL_PLRU:
+            for (u32 w = 0; w < c->n_ways; w++) {
+                if (!s[w].stamp) {
+                    victim = w;
+                    break;
+                }
+            }
+            break;
+        case SIM_REPL_RAND:
+            victim = sim_rand() % c->n_ways;
+            break;
+        default:
+            for (u32 w = 1; w < c->n_ways; w++)
+                if (s[w].stamp < s[victim].stamp)
+                    victim = w;
+            break;
+        }
+    }
+
+    SimLine old = s[victim];
+    s[victim].tag = tag;
+    s[victim].stamp = 0;
+    s[victim].shared = shared;
+    cache_touch(c, set, victim);
+    return old;
+}
+
+static inline void cache_inval(SimCache *c, u32 set, u64 tag)
+{
+    i32 w = cache_lookup(c, set, tag);
+    if (w >= 0) {
+        SimLine *s = cache_set(c, set);
+        s[w].tag = 0;
+        s[w].stamp = 0;
+        s[w].shared = false;
+    }
+}
+
+u64 sim_va_to_pa(const void *va)
+{
+    u32 shift = sim.conf.page_shift;
+    u64 vpn = (u64)va >> shift;
+    u64 pfn = mix64(vpn ^ sim.conf.seed) &
+              ((1ULL << (SIM_PFN_BITS - (shift - PAGE_SHIFT))) - 1);
+    return (pfn << shift) | ((u64)va & ((1ULL << shift) - 1));
+}
+
+u32 sim_llc_slice(u64 pa)
+{
+    switch (sim.conf.hash) {
+    case SIM_HASH_SKX20:
+        return l3_slice_skx_20((i64)pa) % sim.conf.n_slices;
+    case SIM_HASH_XOR: {
+        u32 slice = 0;
+        for (u32 i = 0; i < sim.conf.n_hash_masks; i++)
+            slice |= (u32)(__builtin_popcountll(pa & sim.conf.hash_masks[i]) & 1) << i;
+        return slice % sim.conf.n_slices;
+    }
+    default:
+        return mix64((pa >> SIM_CL_SHIFT) ^ ~sim.conf.seed) % sim.conf.n_slices;
+    }
+}
+
+static inline u32 llc_index(u64 pa)
+{
+    u32 set = (pa >> SIM_CL_SHIFT) & (sim.conf.llc_sets - 1);
+    return sim_llc_slice(pa) * sim.conf.llc_sets + set;
+}
+
+static inline u64 tag_to_pa(u64 tag)
+{
+    return sim_va_to_pa((void *)((tag - 1) << SIM_CL_SHIFT));
+}
+
+static SimCore *core_new(void)
+{
+    SimCore *c = _calloc(1, sizeof(SimCore));
+    if (!c)
+        return NULL;
+    if (!cache_alloc(&c->l1, sim.conf.l1_sets, sim.conf.l1_ways, SIM_REPL_LRU) ||
+        !cache_alloc(&c->l2, sim.conf.l2_sets, sim.conf.l2_ways, sim.conf.l2_repl)) {
+        free(c->l1.lines);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void release_core(void *arg)
+{
+    pthread_mutex_lock(&sim.lock);
+    sim.core_busy[(u64)arg - 1] = false;
+    pthread_mutex_unlock(&sim.lock);
+}
+
+// caller holds the lock. threads get the lowest idle core, like pinning would
+static SimCore *self_core(void)
+{
+    if (!st.init) {
+        u32 core = 0;
+        while (core < sim.conf.n_cores - 1 && sim.core_busy[core])
+            core++;
+        sim.core_busy[core] = true;
+        st.core = core;
+        st.init = true;
+        pthread_setspecific(sim.core_key, (void *)(u64)(core + 1));
+    }
+    if (!sim.cores[st.core]) {
+        sim.cores[st.core] = core_new();
+        if (!sim.cores[st.core]) {
+            fprintf(stderr, ERR "sim: failed to allocate core %u\n", st.core);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return sim.cores[st.core];
+}
+
+/*
+  shared lines are tracked by the LLC (directory-like), so losing the LLC
+  copy also drops every private copy. this is what makes an LLC evset
+  primed from two cores evict the target from both L2s.
+*/
+static void back_invalidate(SimLine old)
+{
+    if (!old.tag || !old.shared)
+        return;
+    u64 pa = tag_to_pa(old.tag);
+    for (u32 i = 0; i < sim.conf.n_cores; i++) {
+        SimCore *c = sim.cores[i];
+        if (!c)
+            continue;
+        cache_inval(&c->l1, (pa >> SIM_CL_SHIFT) & (c->l1.n_sets - 1), old.tag);
+        cache_inval(&c->l2, (pa >> SIM_CL_SHIFT) & (c->l2.n_sets - 1), old.tag);
+    }
+}
+
+static inline void llc_insert(u32 idx, u64 tag, bool shared)
+{
+    back_invalidate(cache_fill(&sim.llc, idx, tag, shared));
+}
+
+static void llc_evict_random_way(u32 idx)
+{
+    SimLine *s = cache_set(&sim.llc, idx);
+    u32 w = sim_rand() % sim.llc.n_ways;
+    if (s[w].tag) {
+        SimLine old = s[w];
+        s[w].tag = 0;
+        s[w].stamp = 0;
+        s[w].shared = false;
+        back_invalidate(old);
+        sim.stats.noise_evicts++;
+    }
+}
+
+static void background_evictions(void)
+{
+    if (sim.conf.bg_evict <= 0.0) {
+        st.bg_tsc = st.vtsc;
+        return;
+    }
+    st.bg_acc += (f64)(st.vtsc - st.bg_tsc) * sim.conf.bg_evict / 1e6;
+    st.bg_tsc = st.vtsc;
+    u32 total = sim.llc.n_sets;
+    while (st.bg_acc >= 1.0) {
+        llc_evict_random_way(sim_rand() % total);
+        st.bg_acc -= 1.0;
+    }
+}
+
+static void sim_load_env(void)
+{
+    sim_def_conf(&sim.conf);
+    const char *spec = getenv(SIM_CONF_ENV);
+    if (spec && *spec && sim_parse_conf(spec, &sim.conf)) {
+        fprintf(stderr, ERR "sim: invalid " SIM_CONF_ENV "=\"%s\"\n", spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void sim_setup(void)
+{
+    if (!sim.conf.n_cores)
+        sim_load_env();
+
+    if (sim.conf.n_cores > SIM_MAX_CORES)
+        sim.conf.n_cores = SIM_MAX_CORES;
+    if (!sim.conf.n_slices)
+        sim.conf.n_slices = 1;
+    if (sim.conf.hash == SIM_HASH_SKX20 && sim.conf.n_slices != 20)
+        sim.conf.hash = SIM_HASH_MOD;
+    if (sim.conf.hash == SIM_HASH_XOR && !sim.conf.n_hash_masks) {
+        for (u32 i = 0; (1u << i) < sim.conf.n_slices && i < 3; i++)
+            sim.conf.hash_masks[sim.conf.n_hash_masks++] = def_xor_masks[i];
+    }
+
+    pthread_mutex_init(&sim.lock, NULL);
+    pthread_key_create(&sim.core_key, release_core);
+    sim.rng = sim.conf.seed ? sim.conf.seed : 0x9e3779b97f4a7c15ULL;
+
+    if (!cache_alloc(&sim.llc, sim.conf.llc_sets * sim.conf.n_slices,
+                     sim.conf.llc_ways, sim.conf.llc_repl)) {
+        fprintf(stderr, ERR "sim: failed to allocate LLC\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sim_ready = true;
+    if (verbose)
+        printf(V1 "sim: %u cores | L2 %ux%u | LLC %ux%u x %u slices | seed %lu\n",
+               sim.conf.n_cores, sim.conf.l2_sets, sim.conf.l2_ways,
+               sim.conf.llc_sets, sim.conf.llc_ways, sim.conf.n_slices,
+               sim.conf.seed);
+}
+
+void sim_init(const SimConf *conf)
+{
+    if (conf)
+        sim.conf = *conf;
+    pthread_once(&sim_once, sim_setup);
+}
+
+static inline void sim_ensure(void)
+{
+    if (__builtin_expect(!sim_ready, 0))
+        sim_init(NULL);
+}
+
+const SimConf *sim_conf(void)
+{
+    sim_ensure();
+    return &sim.conf;
+}
+
+u64 sim_access(const void *p)
+{
+    sim_ensure();
+
+    u64 va = (u64)p;
+    u64 tag = (va >> SIM_CL_SHIFT) + 1;
+    u64 pa = sim_va_to_pa(p);
+    u64 lat;
+
+    pthread_mutex_lock(&sim.lock);
+    SimCore *c = self_core();
+    u32 l1_set = (pa >> SIM_CL_SHIFT) & (c->l1.n_sets - 1);
+    u32 l2_set = (pa >> SIM_CL_SHIFT) & (c->l2.n_sets - 1);
+    u32 llc_idx = llc_index(pa);
+    i32 w;
+
+    sim.stats.accesses++;
+    background_evictions();
+
+    if ((w = cache_lookup(&c->l1, l1_set, tag)) >= 0) {
+        cache_touch(&c->l1, l1_set, w);
+        lat = sim.conf.lat_l1;
+        sim.stats.l1_hits++;
+    } else if ((w = cache_lookup(&c->l2, l2_set, tag)) >= 0) {
+        cache_touch(&c->l2, l2_set, w);
+        cache_fill(&c->l1, l1_set, tag, false);
+        lat = sim.conf.lat_l2;
+        sim.stats.l2_hits++;
+    } else {
+        if ((w = cache_lookup(&sim.llc, llc_idx, tag)) >= 0) {
+            cache_touch(&sim.llc, llc_idx, w);
+            cache_set(&sim.llc, llc_idx)[w].shared = true;
+            lat = sim.conf.lat_llc;
+            sim.stats.llc_hits++;
+        } else {
+            // a line shared with another core's L2 is kept in the LLC
+            bool shared = false;
+            for (u32 i = 0; i < sim.conf.n_cores && !shared; i++) {
+                SimCore *o = sim.cores[i];
+                if (o && o != c && cache_lookup(&o->l2, l2_set, tag) >= 0)
+                    shared = true;
+            }
+            if (shared) {
+                llc_insert(llc_idx, tag, true);
+                lat = sim.conf.lat_llc;
+                sim.stats.snoops++;
+            } else {
+                lat = sim.conf.lat_dram;
+                sim.stats.dram++;
+            }
+        }
+
+        // non-inclusive LLC: L2 victims are written back into the LLC
+        u64 victim = cache_fill(&c->l2, l2_set, tag, false).tag;
+        if (victim) {
+            u64 vpa = tag_to_pa(victim);
+            cache_inval(&c->l1, (vpa >> SIM_CL_SHIFT) & (c->l1.n_sets - 1), victim);
+            u32 vidx = llc_index(vpa);
+            if ((w = cache_lookup(&sim.llc, vidx, victim)) >= 0)
+                cache_touch(&sim.llc, vidx, w);
+            else
+                llc_insert(vidx, victim, false);
+        }
+        cache_fill(&c->l1, l1_set, tag, false);
+    }
+
+    if (sim.conf.evict_p > 0.0 && sim_rand_f64() < sim.conf.evict_p)
+        llc_evict_random_way(llc_idx);
+    if (sim.conf.jitter)
+        lat += sim_rand() % (sim.conf.jitter + 1);
+    if (sim.conf.spike_p > 0.0 && sim_rand_f64() < sim.conf.spike_p)
+        lat += sim.conf.spike_lat;
+
+    pthread_mutex_unlock(&sim.lock);
+
+    st.vtsc += lat;
+    return lat;
+}
+
+void sim_flush(const void *p)
+{
+    sim_ensure();
+
+    u64 tag = ((u64)p >> SIM_CL_SHIFT) + 1;
+    u64 pa = sim_va_to_pa(p);
+
+    pthread_mutex_lock(&sim.lock);
+    for (u32 i = 0; i < sim.conf.n_cores; i++) {
+        SimCore *c = sim.cores[i];
+        if (!c)
+            continue;
+        cache_inval(&c->l1, (pa >> SIM_CL_SHIFT) & (c->l1.n_sets - 1), tag);
+        cache_inval(&c->l2, (pa >> SIM_CL_SHIFT) & (c->l2.n_sets - 1), tag);
+    }
+    cache_inval(&sim.llc, llc_index(pa), tag);
+    sim.stats.flushes++;
+    pthread_mutex_unlock(&sim.lock);
+
+    st.vtsc += sim.conf.lat_l2;
+}
+
+u64 sim_rdtsc(void)
+{
+    sim_ensure();
+    st.vtsc += sim.conf.lat_tsc;
+    return st.vtsc;
+}
+
+u32 sim_core_id(void)
+{
+    sim_ensure();
+    if (!st.init) {
+        pthread_mutex_lock(&sim.lock);
+        self_core();
+        pthread_mutex_unlock(&sim.lock);
+    }
+    return st.core;
+}
+
+void sim_cpuid4(u32 idx, u32 *eax, u32 *ebx, u32 *ecx, u32 *edx)
+{
+    sim_ensure();
+
+    u32 ways = 0, sets = 0, level = 0;
+    switch (idx) {
+    case 0: level = 1; ways = sim.conf.l1_ways; sets = sim.conf.l1_sets; break;
+    case 2: level = 2; ways = sim.conf.l2_ways; sets = sim.conf.l2_sets; break;
+    case 3:
+        level = 3;
+        ways = sim.conf.llc_ways;
+        sets = sim.conf.llc_sets * sim.conf.n_slices;
+        break;
+    default: break;
+    }
+
+    *eax = level ? (level << 5) | 1 : 0; // data/unified cache type
+    *ebx = level ? ((ways - 1) << 22) | (CL_SIZE - 1) : 0;
+    *ecx = level ? sets - 1 : 0;
+    *edx = 0;
+}
+
+void sim_get_stats(SimStats *out)
+{
+    if (!sim_ready) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    pthread_mutex_lock(&sim.lock);
+    *out = sim.stats;
+    pthread_mutex_unlock(&sim.lock);
+}
+
+void sim_print_stats(void)
+{
+    SimStats s;
+    sim_get_stats(&s);
+    if (!s.accesses)
+        return;
+
+    f64 n = (f64)s.accesses;
+    printf(INFO "sim: %lu accesses | L1 %.1f%% | L2 %.1f%% | LLC %.1f%% "
+                "(snoop %.1f%%) | DRAM %.1f%%\n",
+           s.accesses, s.l1_hits * 100.0 / n, s.l2_hits * 100.0 / n,
+           s.llc_hits * 100.0 / n, s.snoops * 100.0 / n, s.dram * 100.0 / n);
+    printf(INFO "sim: %lu flushes | %lu noise evictions\n",
+           s.flushes, s.noise_evicts);
+}
+
+void sim_def_conf(SimConf *conf)
+{
+    *conf = (SimConf) {
+        .n_cores = 32,
+        .l1_sets = 64, .l1_ways = 8,
+        .l2_sets = 1024, .l2_ways = 16,
+        .llc_sets = ONE_SLICE_SETS, .llc_ways = 11,
+        .n_slices = 20,
+        .hash = SIM_HASH_SKX20,
+        .l2_repl = SIM_REPL_PLRU,
+        .llc_repl = SIM_REPL_PLRU,
+        .lat_l1 = 4, .lat_l2 = 14, .lat_llc = 60, .lat_dram = 220,
+        .lat_tsc = 30,
+        .jitter = 6,
+        .spike_p = 0.0005, .spike_lat = 5000,
+        .evict_p = 0.0,
+        .bg_evict = 0.0,
+        .page_shift = PAGE_SHIFT,
+        .seed = 1
+    };
+}
+
+static i32 parse_repl(const char *v, SimRepl *out)
+{
+    if (!strcasecmp(v, "lru"))
+        *out = SIM_REPL_LRU;
+    else if (!strcasecmp(v, "plru"))
+        *out = SIM_REPL_PLRU;
+    else if (!strcasecmp(v, "rand"))
+        *out = SIM_REPL_RAND;
+    else
+        return -1;
+    return 0;
+}
+
+static i32 apply_preset(const char *v, SimConf *conf)
+{
+    sim_def_conf(conf);
+    if (!strcasecmp(v, "skx"))
+        return 0;
+    if (!strcasecmp(v, "icx")) {
+        conf->l1_ways = 12;
+        conf->l2_ways = 20;
+        conf->llc_ways = 12;
+        conf->n_slices = 28;
+        conf->hash = SIM_HASH_MOD;
+        return 0;
+    }
+    if (!strcasecmp(v, "spr")) {
+        conf->l1_ways = 12;
+        conf->l2_sets = 2048;
+        conf->llc_ways = 15;
+        conf->n_slices = 56;
+        conf->hash = SIM_HASH_MOD;
+        return 0;
+    }
+    return -1;
+}
+
+static bool is_pow2(u64 v)
+{
+    return v && !(v & (v - 1));
+}
+
+i32 sim_parse_conf(const char *spec, SimConf *conf)
+{
+    char *dup = strdup(spec), *save = NULL;
+    if (!dup)
+        return -1;
+
+    i32 ret = 0;
+    for (char *tok = strtok_r(dup, ",", &save); tok && !ret;
+         tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (!val) {
+            ret = -1;
+            break;
+        }
+        *val++ = '\0';
+        u64 n = strtoull(val, NULL, 0);
+
+        if (!strcmp(tok, "preset"))
+            ret = apply_preset(val, conf);
+        else if (!strcmp(tok, "cores"))
+            conf->n_cores = (u32)n;
+        else if (!strcmp(tok, "slices"))
+            conf->n_slices = (u32)n;
+        else if (!strcmp(tok, "l2_sets"))
+            conf->l2_sets = (u32)n;
+        else if (!strcmp(tok, "l2_ways"))
+            conf->l2_ways = (u32)n;
+        else if (!strcmp(tok, "llc_sets"))
+            conf->llc_sets = (u32)n;
+        else if (!strcmp(tok, "llc_ways"))
+            conf->llc_ways = (u32)n;
+        else if (!strcmp(tok, "hash")) {
+            if (!strcasecmp(val, "skx20"))
+                conf->hash = SIM_HASH_SKX20;
+            else if (!strcasecmp(val, "xor"))
+                conf->hash = SIM_HASH_XOR;
+            else if (!strcasecmp(val, "mod"))
+                conf->hash = SIM_HASH_MOD;
+            else
+                ret = -1;
+        } else if (!strcmp(tok, "repl")) {
+            ret = parse_repl(val, &conf->l2_repl);
+            conf->llc_repl = conf->l2_repl;
+        } else if (!strcmp(tok, "l2_repl"))
+            ret = parse_repl(val, &conf->l2_repl);
+        else if (!strcmp(tok, "llc_repl"))
+            ret = parse_repl(val, &conf->llc_repl);
+        else if (!strcmp(tok, "l1"))
+            conf->lat_l1 = (u32)n;
+        else if (!strcmp(tok, "l2"))
+            conf->lat_l2 = (u32)n;
+        else if (!strcmp(tok, "llc"))
+            conf->lat_llc = (u32)n;
+        else if (!strcmp(tok, "dram"))
+            conf->lat_dram = (u32)n;
+        else if (!strcmp(tok, "tsc"))
+            conf->lat_tsc = (u32)n;
+        else if (!strcmp(tok, "jitter"))
+            conf->jitter = (u32)n;
+        else if (!strcmp(tok, "spike"))
+            conf->spike_p = strtod(val, NULL);
+        else if (!strcmp(tok, "spike_lat"))
+            conf->spike_lat = (u32)n;
+        else if (!strcmp(tok, "evict"))
+            conf->evict_p = strtod(val, NULL);
+        else if (!strcmp(tok, "bg"))
+            conf->bg_evict = strtod(val, NULL);
+        else if (!strcmp(tok, "seed"))
+            conf->seed = n;
+        else if (!strcmp(tok, "page")) {
+            if (!strcasecmp(val, "4k"))
+                conf->page_shift = PAGE_SHIFT;
+            else if (!strcasecmp(val, "2m"))
+                conf->page_shift = HUGE_PAGE_SHIFT;
+            else
+                ret = -1;
+        }
+        else
+            ret = -1;
+    }
+    free(dup);
+
+    if (!ret && (!is_pow2(conf->l1_sets) || !is_pow2(conf->l2_sets) ||
+                 !is_pow2(conf->llc_sets) || !conf->n_cores ||
+                 !conf->l2_ways || !conf->llc_ways || !conf->n_slices))
+        ret = -1;
+    if (!ret && conf->hash == SIM_HASH_XOR && !is_pow2(conf->n_slices))
+        ret = -1;
+
+    return ret;
+}
@@ -0,0 +1,137 @@
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <pthread.h>
+#include <string.h>
+
+bool g_stats_on = false;
+__thread EvStats *tl_stats = NULL;
+
+static EvStats *stats_head = NULL;
+static u32 n_stats_threads = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static u64 phase_us[N_PHASES];
+
+static const char *stat_names[N_STATS] = {
+    [ST_EV_TESTS] = "ev_tests",
+    [ST_TESTS_UNSURE] = "tests_unsure",
+    [ST_TRIALS_VALID] = "trials_valid",
+    [ST_TRIALS_MIGRATED] = "trials_migrated",
+    [ST_TRIALS_INTR] = "trials_intr",
+    [ST_SEARCH_ITERS] = "search_iters",
+    [ST_BACKTRACKS] = "backtracks",
+    [ST_PRUNE_TESTS] = "prune_tests",
+    [ST_HELPER_TRIPS] = "helper_trips",
+    [ST_FILTER_CANDS] = "filter_cands",
+    [ST_EVSETS_BUILT] = "evsets_built",
+    [ST_EVSETS_FAILED] = "evsets_failed",
+};
+
+static const char *phase_names[N_PHASES] = {
+    [PH_LATS] = "lats",
+    [PH_L2_BUILD] = "l2_build",
+    [PH_CANDS] = "cands",
+    [PH_L3_BUILD] = "l3_build",
+};
+
+void stats_enable(void)
+{
+    g_stats_on = true;
+}
+
+bool stats_thread_init(void)
+{
+    EvStats *st = _calloc(1, sizeof(*st));
+    if (!st) {
+        g_stats_on = false;
+        fprintf(stderr, ERR "failed to allocate thread stats, disabling --stats\n");
+        return true;
+    }
+
+    // outlives the thread, so short-lived workers are still merged
+    pthread_mutex_lock(&stats_lock);
+    st->next = stats_head;
+    stats_head = st;
+    n_stats_threads++;
+    pthread_mutex_unlock(&stats_lock);
+
+    tl_stats = st;
+    return false;
+}
+
+void stats_phase_add(StatPhase ph, u64 us)
+{
+    if (g_stats_on)
+        __atomic_fetch_add(&phase_us[ph], us, __ATOMIC_RELAXED);
+}
+
+u64 stats_get(StatId id)
+{
+    u64 tot = 0;
+    pthread_mutex_lock(&stats_lock);
+    for (EvStats *st = stats_head; st; st = st->next)
+        tot += __atomic_load_n(&st->cnt[id], __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&stats_lock);
+    return tot;
+}
+
+u64 stats_phase_get(StatPhase ph)
+{
+    return __atomic_load_n(&phase_us[ph], __ATOMIC_RELAXED);
+}
+
+// racy against running workers, so only call it between runs
+void stats_reset(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    for (EvStats *st = stats_head; st; st = st->next)
+        memset(st->cnt, 0, sizeof(st->cnt));
+    pthread_mutex_unlock(&stats_lock);
+
+    for (u32 i = 0; i < N_PHASES; i++)
+        __atomic_store_n(&phase_us[i], 0, __ATOMIC_RELAXED);
+}
+
+static f64 ratio(u64 num, u64 den)
+{
+    return den ? (f64)num / den : 0;
+}
+
+void stats_report(FILE *f)
+{
+    if (!g_stats_on)
+        return;
+
+    u64 tot[N_STATS] = {0};
+    pthread_mutex_lock(&stats_lock);
+    for (EvStats *st = stats_head; st; st = st->next) {
+        for (u32 i = 0; i < N_STATS; i++)
+            tot[i] += __atomic_load_n(&st->cnt[i], __ATOMIC_RELAXED);
+    }
+    u32 n_threads = n_stats_threads;
+    pthread_mutex_unlock(&stats_lock);
+
+    fprintf(f, "{\"threads\":%u,\"counters\":{", n_threads);
+    for (u32 i = 0; i < N_STATS; i++)
+        fprintf(f, "%s\"%s\":%lu", i ? "," : "", stat_names[i], tot[i]);
+
+    fprintf(f, "},\"phases_ms\":{");
+    for (u32 i = 0; i < N_PHASES; i++)
+        fprintf(f, "%s\"%s\":%.3f", i ? "," : "", phase_names[i], phase_us[i] / 1e3);
+
+    // what a slow build is bound by: noise, backtracking or filtering
+    u64 trials = tot[ST_TRIALS_VALID] + tot[ST_TRIALS_MIGRATED] + tot[ST_TRIALS_INTR],
+        n_evsets = tot[ST_EVSETS_BUILT] + tot[ST_EVSETS_FAILED],
+        wall = 0;
+    for (u32 i = 0; i < N_PHASES; i++)
+        wall += phase_us[i];
+
+    fprintf(f, "},\"derived\":{\"trial_discard_rate\":%.4f,\"unsure_rate\":%.4f,"
+               "\"backtracks_per_evset\":%.2f,\"tests_per_evset\":%.1f,"
+               "\"cands_share\":%.4f}}\n",
+            ratio(trials - tot[ST_TRIALS_VALID], trials),
+            ratio(tot[ST_TESTS_UNSURE], tot[ST_EV_TESTS]),
+            ratio(tot[ST_BACKTRACKS], n_evsets),
+            ratio(tot[ST_EV_TESTS], n_evsets),
+            ratio(phase_us[PH_CANDS], wall));
+    fflush(f);
+}
@@ -0,0 +1,145 @@
+#include "../include/telemetry.h"
+#include "../include/common.h"
+#include <sys/stat.h>
+
+static TelemShm *g_telem;
+static u64 g_telem_iter;
+static bool g_telem_clamped;
+static u32 g_telem_over_avg, g_telem_over_max;
+
+bool telem_open(const char *path)
+{
+    // a new file rather than truncating in place, readers keep the old mapping
+    unlink(path);
+    i32 fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, ERR "cannot create telemetry segment %s\n", path);
+        return true;
+    }
+
+    if (ftruncate(fd, sizeof(TelemShm))) {
+        fprintf(stderr, ERR "cannot size telemetry segment %s\n", path);
+        close(fd);
+        return true;
+    }
+
+    TelemShm *shm = mmap(NULL, sizeof(TelemShm), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, ERR "cannot map telemetry segment %s\n", path);
+        return true;
+    }
+
+    shm->version = TELEM_VERSION;
+    shm->n_slots = TELEM_N_SLOTS;
+    shm->max_entries = TELEM_MAX_ENTRIES;
+    shm->pid = getpid();
+    atomic_store_explicit(&shm->n_published, 0, memory_order_relaxed);
+    atomic_store_explicit(&shm->magic, TELEM_MAGIC, memory_order_release);
+
+    g_telem = shm;
+    g_telem_iter = 0;
+    printf(INFO "Publishing hotness samples to: %s\n", path);
+    return false;
+}
+
+void telem_note_waits(u64 n, u64 sum_ns, u64 max_ns)
+{
+    u64 avg = n ? sum_ns / n : 0;
+    g_telem_over_avg = avg > UINT32_MAX ? UINT32_MAX : avg;
+    g_telem_over_max = max_ns > UINT32_MAX ? UINT32_MAX : max_ns;
+}
+
+void telem_publish(TelemKind kind, u32 n, const i32 *ids, const f64 *raw,
+                   const f64 *ewma, const bool *valid, u32 wait_us)
+{
+    if (!g_telem)
+        return;
+
+    if (n > TELEM_MAX_ENTRIES) {
+        if (!g_telem_clamped)
+            printf(WRN "telemetry holds %u entries, dropping the other %u\n",
+                   TELEM_MAX_ENTRIES, n - TELEM_MAX_ENTRIES);
+        g_telem_clamped = true;
+        n = TELEM_MAX_ENTRIES;
+    }
+
+    u64 pos = atomic_load_explicit(&g_telem->n_published, memory_order_relaxed);
+    TelemSlot *slot = &g_telem->slots[pos % TELEM_N_SLOTS];
+    u64 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    slot->s.ts_ns = (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    slot->s.iter = g_telem_iter++;
+    slot->s.kind = kind;
+    slot->s.n = n;
+    slot->s.wait_us = wait_us;
+    slot->s.over_avg_ns = g_telem_over_avg;
+    slot->s.over_max_ns = g_telem_over_max;
+    for (u32 i = 0; i < n; i++) {
+        slot->s.e[i] = (TelemEntry) {
+            .id = ids ? ids[i] : (i32)i,
+            .valid = valid ? valid[i] : 1,
+            .raw = raw[i],
+            .ewma = ewma[i],
+        };
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&g_telem->n_published, pos + 1, memory_order_release);
+}
+
+void telem_close(void)
+{
+    if (!g_telem)
+        return;
+    munmap(g_telem, sizeof(TelemShm));
+    g_telem = NULL;
+}
+
+bool telem_reader_open(TelemReader *r, const char *path)
+{
+    *r = (TelemReader){0};
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, ERR "cannot open telemetry segment %s\n", path);
+        return true;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || (u64)st.st_size < sizeof(TelemShm)) {
+        fprintf(stderr, ERR "%s is not a telemetry segment\n", path);
+        close(fd);
+        return true;
+    }
+
+    const TelemShm *shm = mmap(NULL, sizeof(TelemShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, ERR "cannot map telemetry segment %s\n", path);
+        return true;
+    }
+
+    if (atomic_load_explicit(&shm->magic, memory_order_acquire) != TELEM_MAGIC ||
+        shm->version != TELEM_VERSION || shm->n_slots != TELEM_N_SLOTS) {
+        fprintf(stderr, ERR "%s: unknown telemetry layout\n", path);
+        munmap((void *)shm, sizeof(TelemShm));
+        return true;
+    }
+
+    r->shm = shm;
+    r->size = sizeof(TelemShm);
+    return false;
+}
+
+void telem_reader_close(TelemReader *r)
+{
+    if (r->shm)
+        munmap((void *)r->shm, r->size);
+    *r = (TelemReader){0};
+}
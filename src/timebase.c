@@ -0,0 +1,205 @@
+#include "../include/timebase.h"
+#include "../include/asm.h"
+#include "../include/config.h"
+#include <cpuid.h>
+#include <pthread.h>
+
+#define TB_CAL_RUNS 3               // median of
+#define TB_CAL_NS 10000000ull       // per run
+#define TB_SAMPLE_TRIES 16
+#define TB_AGREE_PPM 2000           // cpuid against the calibrated rate
+#define TB_CHECK_MIN_NS 200000000ull
+#define TB_DRIFT_PPM 5000
+
+Timebase g_tb = {
+    .hz = TB_DEF_HZ,
+    .ns_mult = (1000000000ull << TB_SHIFT) / TB_DEF_HZ,
+    .us_mult = (1000000ull << TB_SHIFT) / TB_DEF_HZ,
+    .cyc_mult = (TB_DEF_HZ << TB_SHIFT) / 1000000000ull,
+    .src = TB_DEFAULT,
+};
+
+static const char *tb_names[N_TB_SOURCES] = {
+    [TB_DEFAULT] = "default",
+    [TB_HYPERVISOR] = "hypervisor",
+    [TB_CPUID_15] = "cpuid 0x15",
+    [TB_CPUID_16] = "cpuid 0x16",
+    [TB_CALIBRATED] = "calibrated",
+};
+
+static pthread_once_t tb_once = PTHREAD_ONCE_INIT;
+static u64 tb_ref_tsc, tb_ref_ns; // last tb_measure or tb_check
+
+const char *tb_src_name(TbSource src)
+{
+    return src < N_TB_SOURCES ? tb_names[src] : "?";
+}
+
+static f64 tb_ppm(u64 a, u64 ref)
+{
+    return (f64)(a > ref ? a - ref : ref - a) * 1e6 / ref;
+}
+
+static void tb_set(u64 hz, TbSource src)
+{
+    g_tb.ns_mult = ((unsigned __int128)1000000000ull << TB_SHIFT) / hz;
+    g_tb.us_mult = ((unsigned __int128)1000000ull << TB_SHIFT) / hz;
+    g_tb.cyc_mult = ((unsigned __int128)hz << TB_SHIFT) / 1000000000ull;
+    g_tb.hz = hz;
+    g_tb.src = src;
+    g_tb.gen++;
+}
+
+/*
+  tsc and CLOCK_MONOTONIC_RAW at the same instant, from the tightest rdtsc
+  pair around clock_gettime. true on error
+*/
+static bool tb_sample(u64 *tsc, u64 *ns)
+{
+    u64 best = ~0ull;
+    for (u32 i = 0; i < TB_SAMPLE_TRIES; i++) {
+        struct timespec ts;
+        u64 t0 = _rdtsc();
+        if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts))
+            return true;
+        u64 t1 = _rdtsc();
+
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+            *tsc = t0 + best / 2;
+            *ns = (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+    }
+    return false;
+}
+
+// tsc rate over a few short sleeps, 0 on error
+static u64 tb_measure(void)
+{
+    u64 hz[TB_CAL_RUNS], tsc0, ns0, tsc1, ns1;
+
+    for (u32 r = 0; r < TB_CAL_RUNS; r++) {
+        struct timespec d = { .tv_nsec = TB_CAL_NS };
+        if (tb_sample(&tsc0, &ns0))
+            return 0;
+        nanosleep(&d, NULL);
+        if (tb_sample(&tsc1, &ns1) || ns1 <= ns0 || tsc1 <= tsc0)
+            return 0;
+        hz[r] = (unsigned __int128)(tsc1 - tsc0) * 1000000000ull / (ns1 - ns0);
+    }
+
+    for (u32 i = 1; i < TB_CAL_RUNS; i++) {
+        for (u32 j = i; j > 0 && hz[j - 1] > hz[j]; j--) {
+            u64 t = hz[j];
+            hz[j] = hz[j - 1];
+            hz[j - 1] = t;
+        }
+    }
+
+    tb_ref_tsc = tsc1;
+    tb_ref_ns = ns1;
+    return hz[TB_CAL_RUNS / 2];
+}
+
+// tsc rate as reported by cpuid, 0 if nothing reports it
+static u64 tb_cpuid_hz(TbSource *src)
+{
+    u32 a, b, c, d;
+
+    // KVM (with a fixed tsc rate) and VMware expose it in the timing leaf
+    __cpuid(1, a, b, c, d);
+    if (c & (1u << 31)) {
+        __cpuid(0x40000000, a, b, c, d);
+        if (a >= 0x40000010) {
+            __cpuid(0x40000010, a, b, c, d);
+            if (a) {
+                *src = TB_HYPERVISOR;
+                return (u64)a * 1000;
+            }
+        }
+    }
+
+    u32 max_leaf = __get_cpuid_max(0, NULL);
+    if (max_leaf >= 0x15) {
+        __cpuid(0x15, a, b, c, d);
+        if (a && b && c) { // the crystal clock (ecx) is 0 on many parts
+            *src = TB_CPUID_15;
+            return (u64)c * b / a;
+        }
+    }
+
+    if (max_leaf >= 0x16) {
+        __cpuid(0x16, a, b, c, d);
+        if (a & 0xffff) {
+            *src = TB_CPUID_16;
+            return (u64)(a & 0xffff) * 1000000;
+        }
+    }
+    return 0;
+}
+
+static void tb_init_once(void)
+{
+#if EVSIM
+    return; // the simulated tsc only moves with the accesses
+#endif
+    u32 a, b, c, d;
+    g_tb.invariant = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8));
+
+    TbSource src = TB_DEFAULT;
+    u64 hz = tb_cpuid_hz(&src),
+        cal = tb_measure();
+
+    // the base frequency of 0x16 is rounded, it only stands in for calibration
+    if (cal && (!hz || src == TB_CPUID_16 || tb_ppm(hz, cal) > TB_AGREE_PPM)) {
+        if (hz && src != TB_CPUID_16) {
+            printf(WRN "tsc rate from %s (%.4f GHz) does not match the calibrated "
+                   "%.4f GHz, using the latter\n", tb_names[src], hz / 1e9, cal / 1e9);
+        }
+        hz = cal;
+        src = TB_CALIBRATED;
+    }
+
+    if (!hz) {
+        printf(WRN "cannot determine the tsc rate, assuming %.1f GHz\n", TB_DEF_HZ / 1e9);
+        return;
+    }
+
+    tb_set(hz, src);
+    if (verbose) {
+        printf(V1 "tsc: %.4f GHz (%s) | invariant: %s\n", hz / 1e9, tb_names[src],
+               g_tb.invariant ? "yes" : "no");
+    }
+}
+
+void tb_init(void)
+{
+    pthread_once(&tb_once, tb_init_once);
+}
+
+bool tb_check(void)
+{
+#if EVSIM
+    return false;
+#endif
+    u64 tsc, ns;
+    if (!tb_ref_ns || tb_sample(&tsc, &ns) || ns - tb_ref_ns < TB_CHECK_MIN_NS)
+        return false;
+
+    u64 expect = tb_ns_to_cyc(ns - tb_ref_ns),
+        seen = tsc - tb_ref_tsc;
+    tb_ref_tsc = tsc;
+    tb_ref_ns = ns;
+    if (tb_ppm(seen, expect) <= TB_DRIFT_PPM)
+        return false;
+
+    // the rate changed, or the tsc jumped (new offset, same rate)
+    u64 hz = tb_measure();
+    if (!hz || tb_ppm(hz, g_tb.hz) <= TB_DRIFT_PPM)
+        return false;
+
+    printf(WRN "tsc rate changed from %.4f to %.4f GHz, recalibrated\n",
+           g_tb.hz / 1e9, hz / 1e9);
+    tb_set(hz, TB_CALIBRATED);
+    return true;
+}
@@ -0,0 +1,355 @@
+#include "../include/timer.h"
+#include "../include/utils.h"
+#include "../include/lats.h"
+#include "../include/timebase.h"
+#include <cpuid.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <strings.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TIMER_CAL_REPS 1000
+
+#define WAIT_CAL_SLEEPS 16
+#define WAIT_CAL_SLEEP_NS 200000ull
+#define WAIT_MIN_MARGIN_NS 20000ull
+#define WAIT_MAX_MARGIN_NS 2000000ull
+
+TimerSrc g_timer_src = TIMER_TSC;
+volatile u64 g_timer_ticks = 0;
+__thread PmcCtx tl_pmc = { .fd = -1 };
+
+static const char *timer_names[N_TIMER_SRCS] = {
+    [TIMER_TSC] = "tsc",
+    [TIMER_PMC] = "pmc",
+    [TIMER_THREAD] = "thread",
+};
+
+static pthread_once_t wait_once = PTHREAD_ONCE_INIT;
+static void wait_calibrate(void);
+
+static pthread_t tick_tid;
+static volatile bool tick_run = false;
+
+i32 timer_src_parse(const char *name)
+{
+    if (!strcasecmp(name, "auto"))
+        return TIMER_AUTO;
+
+    for (i32 i = 0; i < N_TIMER_SRCS; i++) {
+        if (!strcasecmp(name, timer_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+const char *timer_src_name(TimerSrc src)
+{
+    return src < N_TIMER_SRCS ? timer_names[src] : "auto";
+}
+
+#if !EVSIM
+static pthread_once_t pmc_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pmc_key; // closes a thread's counter when it exits
+
+static void pmc_key_release(void *arg)
+{
+    (void)arg;
+    pmc_thread_fini();
+}
+
+static void pmc_key_init(void)
+{
+    pthread_key_create(&pmc_key, pmc_key_release);
+}
+#endif
+
+bool pmc_thread_init(void)
+{
+    if (tl_pmc.failed)
+        return true;
+
+#if EVSIM
+    tl_pmc.mask = ~0ull; // _rdpmc counts virtual cycles
+    tl_pmc.ready = true;
+    return false;
+#else
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    i32 fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0)
+        goto err;
+
+    struct perf_event_mmap_page *page = mmap(NULL, getpagesize(), PROT_READ,
+                                             MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        close(fd);
+        goto err;
+    }
+
+    if (!page->cap_user_rdpmc || !page->index) {
+        munmap(page, getpagesize());
+        close(fd);
+        goto err;
+    }
+
+    tl_pmc.fd = fd;
+    tl_pmc.page = page;
+    tl_pmc.mask = page->pmc_width >= 64 ? ~0ull : (1ull << page->pmc_width) - 1;
+    tl_pmc.ready = true;
+
+    pthread_once(&pmc_once, pmc_key_init);
+    pthread_setspecific(pmc_key, &tl_pmc);
+    return false;
+
+err:
+    tl_pmc.failed = true;
+    return true;
+#endif
+}
+
+void pmc_thread_fini(void)
+{
+#if !EVSIM
+    if (tl_pmc.page)
+        munmap(tl_pmc.page, getpagesize());
+    if (tl_pmc.fd >= 0)
+        close(tl_pmc.fd);
+#endif
+    tl_pmc = (PmcCtx){ .fd = -1 };
+}
+
+static void *tick_worker(void *arg)
+{
+    (void)arg;
+    while (tick_run)
+        g_timer_ticks++;
+    return NULL;
+}
+
+static bool tick_start(void)
+{
+#if EVSIM
+    return true; // real time does not follow the simulated accesses
+#endif
+    if (tick_run)
+        return false;
+
+    tick_run = true;
+    if (pthread_create(&tick_tid, NULL, tick_worker, NULL)) {
+        tick_run = false;
+        return true;
+    }
+
+    // let it get scheduled before the first reading
+    u64 t0 = g_timer_ticks;
+    while (g_timer_ticks == t0);
+    return false;
+}
+
+static void tick_stop(void)
+{
+    if (!tick_run)
+        return;
+
+    tick_run = false;
+    pthread_join(tick_tid, NULL);
+}
+
+// true if @p src can't be used in this environment
+static bool timer_src_open(TimerSrc src)
+{
+    switch (src) {
+    case TIMER_PMC:
+        return pmc_thread_init();
+    case TIMER_THREAD:
+        return tick_start();
+    default:
+        return false;
+    }
+}
+
+/*
+  hit/miss separation of a source: gap between the median L1 hit and DRAM miss,
+  over the spread (p10 to p90) of both. <= 0 if it can't tell them apart
+*/
+static f64 timer_src_score(TimerSrc src, u8 *line, i32 *hits, i32 *misses)
+{
+    g_timer_src = src;
+
+    for (u32 i = 0; i < TIMER_CAL_REPS; i++) {
+        maccess(line);
+        u64 lat = _time_maccess(line);
+        hits[i] = _min(lat, (u64)INT32_MAX);
+
+        _clflush(line);
+        _mfence();
+        lat = _time_maccess(line);
+        misses[i] = _min(lat, (u64)INT32_MAX);
+    }
+
+    i32 hit = calc_median(hits, TIMER_CAL_REPS),    // sorts
+        miss = calc_median(misses, TIMER_CAL_REPS);
+    u32 lo = TIMER_CAL_REPS / 10, hi = TIMER_CAL_REPS * 9 / 10;
+    i32 spread = (hits[hi] - hits[lo]) + (misses[hi] - misses[lo]);
+    f64 score = (f64)(miss - hit) / (1 + spread);
+
+    if (verbose) {
+        printf(V1 "timer %-6s: hit %d | miss %d | spread %d | score %.2f\n",
+               timer_names[src], hit, miss, spread, score);
+    }
+    return score;
+}
+
+static TimerSrc timer_calibrate(void)
+{
+    i32 *hits = _calloc(TIMER_CAL_REPS, sizeof(i32)),
+        *misses = _calloc(TIMER_CAL_REPS, sizeof(i32));
+    u8 *line = _calloc(PAGE_SIZE, 1);
+    TimerSrc best = TIMER_TSC;
+    f64 best_score = 0;
+
+    if (!hits || !misses || !line) {
+        fprintf(stderr, ERR "failed allocation for timer calibration\n");
+        goto out;
+    }
+
+    for (i32 src = 0; src < N_TIMER_SRCS; src++) {
+        if (timer_src_open(src))
+            continue;
+
+        f64 score = timer_src_score(src, line, hits, misses);
+        if (score > best_score) {
+            best = src;
+            best_score = score;
+        }
+    }
+
+out:
+    if (best != TIMER_THREAD)
+        tick_stop();
+
+    free(hits);
+    free(misses);
+    free(line);
+    return best;
+}
+
+static void timer_fini(void)
+{
+    tick_stop();
+    pmc_thread_fini();
+}
+
+void timer_init(TimerSrc src)
+{
+    static bool fini_set = false;
+    if (!fini_set && !atexit(timer_fini))
+        fini_set = true;
+
+    pthread_once(&wait_once, wait_calibrate); // not in the first scan window
+
+    if (src == TIMER_AUTO) {
+        g_timer_src = timer_calibrate();
+        printf(INFO "Timing source: %s (calibrated)\n", timer_names[g_timer_src]);
+        return;
+    }
+
+    if (src != TIMER_TSC && timer_src_open(src)) {
+        printf(WRN "timing source %s is unavailable, using tsc\n", timer_names[src]);
+        src = TIMER_TSC;
+    }
+
+    g_timer_src = src;
+}
+
+static u64 wait_margin_ns = 0;
+static bool wait_tpause = false;
+static _Atomic u64 wait_n, wait_sum_ns, wait_max_ns;
+
+static u64 mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until_ns(u64 ns)
+{
+    struct timespec ts = {
+        .tv_sec = ns / 1000000000ull,
+        .tv_nsec = ns % 1000000000ull,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void wait_calibrate(void)
+{
+#if EVSIM
+    return; // the simulated tsc only moves with the accesses, always spin
+#endif
+    tb_init();
+
+    // the spin has to cover the latest wake-up seen, with some headroom
+    u64 late = 0;
+    for (u32 i = 0; i < WAIT_CAL_SLEEPS; i++) {
+        u64 due = mono_ns() + WAIT_CAL_SLEEP_NS;
+        sleep_until_ns(due);
+        late = _max(late, mono_ns() - due);
+    }
+    wait_margin_ns = _min(_max(late + late / 2, WAIT_MIN_MARGIN_NS), WAIT_MAX_MARGIN_NS);
+
+    u32 eax, ebx, ecx, edx;
+    wait_tpause = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 5));
+
+    if (verbose) {
+        printf(V1 "wait: wake-up margin %lu us | final stretch: %s\n",
+               wait_margin_ns / 1000, wait_tpause ? "tpause" : "pause");
+    }
+}
+
+u64 wait_until_tsc(u64 deadline)
+{
+    pthread_once(&wait_once, wait_calibrate);
+
+    u64 now = _rdtsc();
+    if (wait_margin_ns && deadline > now) {
+        u64 left_ns = tb_cyc_to_ns(deadline - now);
+        if (left_ns > wait_margin_ns)
+            sleep_until_ns(mono_ns() + left_ns - wait_margin_ns);
+    }
+
+    if (wait_tpause) {
+        while ((now = _rdtsc()) < deadline)
+            _tpause(deadline);
+    }
+    while ((now = _rdtsc()) < deadline)
+        _pause();
+
+    u64 over = now - deadline,
+        over_ns = tb_cyc_to_ns(over),
+        max = atomic_load_explicit(&wait_max_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wait_n, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wait_sum_ns, over_ns, memory_order_relaxed);
+    while (over_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&wait_max_ns, &max, over_ns,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed));
+    return over;
+}
+
+WaitStats wait_stats_take(void)
+{
+    return (WaitStats) {
+        .n = atomic_exchange_explicit(&wait_n, 0, memory_order_relaxed),
+        .sum_ns = atomic_exchange_explicit(&wait_sum_ns, 0, memory_order_relaxed),
+        .max_ns = atomic_exchange_explicit(&wait_max_ns, 0, memory_order_relaxed),
+    };
+}
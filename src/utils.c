@@ -1,5 +1,7 @@
 #include "../include/common.h"
 #include "../include/utils.h"
+#include "../include/prime.h"
+#include "../include/telemetry.h"
 #include "../vm_tools/vtop.h"
 #include "../include/evset_para.h"
 #include "../include/vset_ops.h"
@@ -65,6 +67,18 @@ i32 print_usage_vev(char *progname)
            "  -u, --uncertain-sets N  Granular mode: number of L2 uncertain sets per offset [default: all]\n"
            "  -f, --evsets-per-l2 N   Number of eviction sets to build per L2 uncertain set [default: 1]\n"
            "  --vtop                  Topology-aware evset construction, by integrating with vTopology\n"
+           "  --algo NAME             Evset construction: zhao (binary search w/ backtracking),\n"
+           "                          gt (group testing), bs (Prime+Scope binary search) [default: zhao]\n"
+           "  --sprt P                Sequential eviction tests: stop once a decision is P confident\n"
+           "                          (e.g. 0.99) instead of running fixed trial counts [default: off]\n"
+           "  --huge                  Back candidate buffers with 2MiB pages (hugetlbfs or THP)\n"
+           "  --host-huge             As --huge, and the host backs guest memory with 2MiB pages:\n"
+           "                          set index bits below 2MiB are known, so no L2 filtering is needed\n"
+           "  --timer SRC             Latency timing source: tsc, pmc (rdpmc cycles, needs a vPMU),\n"
+           "                          thread (counting thread) or auto (lowest-noise) [default: tsc]\n"
+           "  --filter MODE           L2 candidate filtering: seq (one test per candidate), a batch\n"
+           "                          size, or auto (timed on a sample per host) [default: auto]\n"
+           "  --stats=json            Print construction counters and phase times as one JSON line\n"
            "\n"
            "Parallelization options:\n"
            "  -c, --num-core N        N number of cores to leverage in core-parallelism for L3/LLC evset construction\n"
@@ -107,10 +121,25 @@ i32 print_usage_vset(char *progname)
            "  --lcas                  Multi-socket LLC occupancy monitoring\n"
            "                           -t sets update interval in milliseconds\n"
            "  --fix-wait              Disable automatic wait-time adjustments\n"
+           "  --pipeline N            Split each thread pair's evsets into N groups primed and probed\n"
+           "                          on their own clocks, overlapping the waits [default: 0, off]\n"
+           "  --probe MODE            line (time every evset line) or group (one timing per evset,\n"
+           "                          line by line only while it shows evictions) [default: line]\n"
+           "  --layout MODE           array (walk the evset lines by index) or chain (as a pointer\n"
+           "                          chase through the lines themselves) [default: array]\n"
            "  --perf                  Measure prime/probe performance\n"
            "  --fraction-check        Report L3 color coverage for generated eviction sets\n"
            "  --alpha-rise A          EWMA rise alpha [default: 0.85]\n"
            "  --alpha-fall A          EWMA fall alpha [default: 0.85]\n"
+           "  --timer SRC             Latency timing source: tsc, pmc (rdpmc cycles, needs a vPMU),\n"
+           "                          thread (counting thread) or auto (lowest-noise) [default: tsc]\n"
+           "  --filter MODE           L2 candidate filtering: seq (one test per candidate), a batch\n"
+           "                          size, or auto (timed on a sample per host) [default: auto]\n"
+           "  --tune-prime            Search the fastest reliable prime pattern on fresh evsets and\n"
+           "                          save it to " PRIME_PROFILE_PATH " (loaded by later runs)\n"
+           "    --tune-trials N       Trials per pattern and evset [default: 50]\n"
+           "  --telemetry[=PATH]      With --live or --lcas, publish every scan to a shared-memory\n"
+           "                          ring read by vtelem [default: " TELEM_DEF_PATH "]\n"
            "\n"
            "Graph Types (for -G):\n"
            "  0, eviction-freq        L3 eviction activity over time\n"
@@ -144,6 +173,8 @@ i32 print_usage_vcolor(char *progname)
            "    --scan-wait US        Wait time during prime+probe [default: 7000]\n"
            "    --alpha-rise A        EWMA rise alpha [default: 0.85]\n"
            "    --alpha-fall A        EWMA fall alpha [default: 0.85]\n"
+           "    --telemetry[=PATH]    Publish every scan to a shared-memory ring read by vtelem\n"
+           "                          [default: " TELEM_DEF_PATH "]\n"
            "\n"
            "Examples:\n"
            "  %s -s 10\n"
@@ -181,11 +212,52 @@ i32 print_usage_vpo(char *progname)
     return EXIT_SUCCESS;
 }
 
+i32 print_usage_vbench(char *progname)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Options:\n"
+           "  -s, --scenarios LIST    Comma separated scenarios [default: l2,cands,l3:1,gran:1:1:1,gran:4:1:2,verify:3]\n"
+           "                            l2            L2 evsets of all uncertain sets\n"
+           "                            cands         filtered LLC candidates for all L2 colors\n"
+           "                            l3:N          parallel L3 build over N offsets\n"
+           "                            gran:U:F:O    granular L3 build (-u U -f F -o O)\n"
+           "                            verify:R      R verification sweeps over the last L3 evsets\n"
+           "  -r, --reps N            Repetitions per scenario [default: 3]\n"
+           "  -c, --num-core N        Number of cores (even value)\n"
+           "  -v, --verbose LEVEL     Verbosity level\n"
+           "  --csv FILE              Write the summary as CSV (- for stdout)\n"
+           "  --json FILE             Write the summary as JSON (- for stdout)\n"
+           "  --baseline FILE         Compare against the CSV of an earlier run\n"
+           "  --tol PCT               Regression tolerance for --baseline [default: 10]\n"
+           "  --algo NAME             zhao, gt or bs\n"
+           "  --timer SRC             tsc, pmc, thread or auto\n"
+           "  --filter MODE           auto, seq or a batch size\n"
+           "  --cores M,H             vCPUs of the main and helper thread for verification sweeps\n"
+           "                          and --kernels [default: 0,1, the first scan pair]\n"
+           "  --kernels               Time the access/traversal kernels instead of scenarios\n"
+           "    --trials N            Trials per kernel point [default: 100]\n"
+           "\n"
+           "Examples:\n"
+           "  %s -c 4 --csv base.csv\n"
+           "  %s -c 4 -s gran:4:1:2,verify:5 --baseline base.csv --tol 5\n"
+           "  %s --kernels --trials 200 --csv kernels.csv\n"
+           "\n"
+           "  -h, --help              Display this help and exit\n",
+           progname, progname, progname, progname);
+    return EXIT_SUCCESS;
+}
+
 void print_cache_lats()
 {
     printf(SUC "latencies: L1d: %zu | L2: %zu | L3: %zu | DRAM: %zu\n", 
             g_lats.l1d, g_lats.l2, g_lats.l3, g_lats.dram);
 
+    if (g_config.verbose_level >= 2) {
+        printf(V2 "P(lat >= thresh): L2 hit %.3f miss %.3f | L3 hit %.3f miss %.3f\n",
+               g_lats.l2_hit_otp, g_lats.l2_miss_otp, g_lats.l3_hit_otp, g_lats.l3_miss_otp);
+    }
+
     printf(SUC "threshold: L1d: %zu | L2: %zu | L3: %zu | interrupt: %zu\n%s", 
            g_lats.l1d_thresh, g_lats.l2_thresh, g_lats.l3_thresh, g_lats.interrupt_thresh,
            (verbose) ? "" : "\n"); // extra space to separate from rest
@@ -214,56 +286,6 @@ void print_arg_conf(void)
     printf("  candidate scaling factor: %u\n", g_config.cand_scaling);
 }
 
-u64 get_cpu_freq_hz() {
-    // primary method: read from /proc/cpuinfo
-    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
-    if (cpuinfo) {
-        char line[512];
-        while (fgets(line, sizeof(line), cpuinfo)) {
-            if (strstr(line, "cpu MHz")) {
-                char *ptr = strchr(line, ':');
-                if (ptr) {
-                    f64 mhz = strtod(ptr + 1, NULL);
-                    fclose(cpuinfo);
-                    if (verbose > 1) printf(V2 "Retrieved CPU freq from /proc/cpuinfo\n");
-                    return (u64)(mhz * 1000000); // covert MHz to Hz
-                }
-            }
-        }
-        fclose(cpuinfo); // failed
-    }
-    
-    // backup 1 method: read from scaling_cur_freq
-    FILE *scaling = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "r");
-    if (scaling) {
-        char line[64];
-        if (fgets(line, sizeof(line), scaling)) {
-            // this file reports kHz
-            u64 khz = strtoull(line, NULL, 10);
-            fclose(scaling);
-            if (verbose > 1) printf(V2 "Retrieved CPU freq from scaling_cur_freq\n");
-            return khz * 1000; // kHz to Hz
-        }
-        fclose(scaling);
-    }
-    
-    // backup 2: read from cpuinfo_max_freq
-    FILE *max_freq = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
-    if (max_freq) {
-        char line[64];
-        if (fgets(line, sizeof(line), max_freq)) {
-            // this file reports kHz
-            u64 khz = strtoull(line, NULL, 10);
-            fclose(max_freq);
-            if (verbose > 1) printf(V2 "Retrieved CPU freq from cpu_max_freq\n");
-            return khz * 1000;
-        }
-        fclose(max_freq);
-    }
-
-    return 0; // failed
-}
-
 i32 set_cpu_affinity(u16 core_id)
 {
     cpu_set_t mask;
@@ -449,6 +471,9 @@ void cleanup_mem(void* base_addr, EvCands* cands, u64 region_size)
 
 u64 va_to_pa(void* va)
 {
+#if EVSIM
+    return sim_va_to_pa(va);
+#endif
     FILE *pagemap = fopen("/proc/self/pagemap", "rb");
     if (!pagemap) {
         perror("fopen");
@@ -476,6 +501,24 @@ u64 va_to_pa(void* va)
     return pa;
 }
 
+i64 count_huge_backed(u8 *buf, u64 size)
+{
+    i64 n_huge = 0;
+    u64 last = HUGE_PAGE_SIZE - PAGE_SIZE;
+
+    for (u64 off = 0; off + HUGE_PAGE_SIZE <= size; off += HUGE_PAGE_SIZE) {
+        u64 first_pa = va_to_pa(buf + off),
+            last_pa = va_to_pa(buf + off + last);
+        if (!(first_pa >> PAGE_SHIFT) && !(last_pa >> PAGE_SHIFT))
+            return -1;
+
+        if (_ALIGNED(first_pa, HUGE_PAGE_SHIFT) && last_pa == first_pa + last)
+            n_huge++;
+    }
+
+    return n_huge;
+}
+
 u32 va_to_l2color(void *va)
 {
     u64 gpa = va_to_pa(va);
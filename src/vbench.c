@@ -0,0 +1,1074 @@
+#include "../include/common.h"
+#include "../include/config.h"
+#include "../include/utils.h"
+#include "../include/cache_info.h"
+#include "../include/lats.h"
+#include "../include/evset.h"
+#include "../include/evset_para.h"
+#include "../include/helper_thread.h"
+#include "../include/cache_ops.h"
+#include "../include/stats.h"
+#include <bits/getopt_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SCENARIOS 32
+#define MAX_REPS 64
+#define DEF_REPS 3
+#define DEF_TOL_PCT 10.0
+#define DEF_SCENARIOS "l2,cands,l3:1,gran:1:1:1,gran:4:1:2,verify:3"
+#define DEF_KERNEL_TRIALS 100
+#define KERNEL_N_SIZES 4 // sets of 1/8, 1/4, 1/2 and all of the pool
+
+extern EvBuildConf def_l3_build_conf;
+
+typedef enum ScKind {
+    SC_L2 = 0,
+    SC_CANDS,   // filtered LLC candidates for all L2 colors
+    SC_L3,      // l3:N, regular parallel build over N offsets
+    SC_GRAN,    // gran:U:F:O, granular build
+    SC_VERIFY   // verify:R, R sweeps over the last L3 evsets
+} ScKind;
+
+typedef struct {
+    ScKind kind;
+    u32 n, u, f, o;
+    char name[32];
+} Scenario;
+
+typedef struct {
+    f64 *v;
+    u64 cnt, cap;
+} F64Vec;
+
+typedef struct {
+    u32 reps;
+    u64 items;      // evsets, or candidate lines for cands
+    u64 n_verified, n_passed;
+    f64 wall_ms[MAX_REPS], l2_ms[MAX_REPS], cands_ms[MAX_REPS], l3_ms[MAX_REPS];
+    F64Vec sizes;
+    F64Vec verify_us;
+} ScResult;
+
+// the last build is kept around for verify scenarios
+static EvSet ***bench_l2 = NULL;
+static EvSet ****last_l3 = NULL;
+static u32 last_kmax = 0;
+// --cores, vCPUs of the single-pair stages. the first scan pair by default
+static i32 bench_main_vcpu = 0, bench_helper_vcpu = 1;
+
+static bool vec_push(F64Vec *vec, f64 x)
+{
+    if (vec->cnt == vec->cap) {
+        u64 cap = vec->cap ? vec->cap * 2 : 256;
+        f64 *v = realloc(vec->v, cap * sizeof(*v));
+        if (!v) {
+            fprintf(stderr, ERR "failed to grow bench samples\n");
+            return true;
+        }
+        vec->v = v;
+        vec->cap = cap;
+    }
+    vec->v[vec->cnt++] = x;
+    return false;
+}
+
+static i32 compare_f64(const void *a, const void *b)
+{
+    f64 x = *(const f64 *)a, y = *(const f64 *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank, sorts @p v
+static f64 pctl(f64 *v, u64 cnt, f64 q)
+{
+    if (!cnt)
+        return 0;
+    qsort(v, cnt, sizeof(*v), compare_f64);
+    return v[(u64)(q * (cnt - 1) + 0.5)];
+}
+
+static bool scenario_parse(const char *tok, Scenario *sc)
+{
+    memset(sc, 0, sizeof(*sc));
+    snprintf(sc->name, sizeof(sc->name), "%s", tok);
+
+    if (!strcasecmp(tok, "l2")) {
+        sc->kind = SC_L2;
+        return false;
+    }
+    if (!strcasecmp(tok, "cands")) {
+        sc->kind = SC_CANDS;
+        return false;
+    }
+    if (sscanf(tok, "l3:%u", &sc->n) == 1 && sc->n > 0) {
+        sc->kind = SC_L3;
+        return false;
+    }
+    if (sscanf(tok, "gran:%u:%u:%u", &sc->u, &sc->f, &sc->o) == 3 &&
+        sc->u > 0 && sc->f > 0 && sc->o > 0) {
+        sc->kind = SC_GRAN;
+        return false;
+    }
+    if (sscanf(tok, "verify:%u", &sc->n) == 1 && sc->n > 0) {
+        sc->kind = SC_VERIFY;
+        return false;
+    }
+    return true;
+}
+
+static u32 scenarios_parse(char *list, Scenario *scs)
+{
+    u32 n = 0;
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == MAX_SCENARIOS) {
+            fprintf(stderr, ERR "at most %u scenarios\n", MAX_SCENARIOS);
+            return 0;
+        }
+        if (scenario_parse(tok, &scs[n])) {
+            fprintf(stderr, ERR "unknown scenario %s\n", tok);
+            return 0;
+        }
+        n++;
+    }
+    return n;
+}
+
+// same as the retry path of build_l2_evset: shifted sets share build_conf
+static void free_l2_complex(EvSet ***l2evsets)
+{
+    if (!l2evsets)
+        return;
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        if (!l2evsets[n])
+            continue;
+        for (u32 i = 0; i < g_n_uncertain_l2_sets; i++) {
+            EvSet *ev = l2evsets[n][i];
+            if (ev) {
+                free(ev->addrs);
+                evidx_free(&ev->idx);
+                free(ev);
+            }
+        }
+        free(l2evsets[n]);
+    }
+    free(l2evsets);
+}
+
+// frees the candidate complexes, none may still be registered afterwards
+static void release_cands(void)
+{
+    release_evcands_complexes();
+    u32 n = evcands_complexes_held();
+    if (n)
+        fprintf(stderr, WRN "%u candidate complexes still held after release\n", n);
+}
+
+static void drop_last_l3(void)
+{
+    free_evset_complex(last_l3, NUM_OFFSETS, g_n_uncertain_l2_sets, last_kmax);
+    last_l3 = NULL;
+    last_kmax = 0;
+    release_cands(); // nothing points into them anymore
+}
+
+static EvSet ***get_bench_l2(void)
+{
+    if (!bench_l2) {
+        bench_l2 = build_l2_evset(l2_info.n_sets);
+        if (!bench_l2)
+            fprintf(stderr, ERR "failed to build the L2 evsets scenarios share\n");
+    }
+    return bench_l2;
+}
+
+static void verify_one(EvSet *ev, ScResult *r)
+{
+    u64 start = time_us();
+    EvRes res = verify_evset(ev, ev->target_addr);
+    vec_push(&r->verify_us, time_us() - start);
+    r->n_verified++;
+    r->n_passed += res == OK;
+}
+
+// counts and sizes the usable evsets of an L3 complex, then verifies them
+static u64 sweep_l3(EvSet ****complex, u32 kmax, ScResult *r, bool collect)
+{
+    helper_thread_ctrl hctrl = {0};
+    set_cpu_affinity(bench_main_vcpu);
+    if (start_helper_thread_pinned(&hctrl, bench_helper_vcpu))
+        return 0;
+
+    u64 n_usable = 0;
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        for (u32 c = 0; c < g_n_uncertain_l2_sets; c++) {
+            if (!complex[n] || !complex[n][c])
+                continue;
+            for (u32 k = 0; k < kmax; k++) {
+                EvSet *ev = complex[n][c][k];
+                if (!ev || !ev->addrs || !ev->build_conf ||
+                    ev->size == 0 || ev->size > l3_info.n_ways)
+                    continue;
+
+                // the pair helpers are gone by now
+                ev->build_conf->hctrl = &hctrl;
+                if (ev->build_conf->lower_ev && ev->build_conf->lower_ev->build_conf)
+                    ev->build_conf->lower_ev->build_conf->hctrl = &hctrl;
+
+                n_usable++;
+                if (collect)
+                    vec_push(&r->sizes, ev->size);
+                verify_one(ev, r);
+            }
+        }
+    }
+
+    stop_helper_thread(&hctrl);
+    return n_usable;
+}
+
+static u64 sweep_l2(EvSet ***l2evsets, ScResult *r)
+{
+    u64 n_usable = 0;
+    for (u32 n = 0; n < NUM_OFFSETS; n++) {
+        if (!l2evsets[n])
+            continue;
+        for (u32 i = 0; i < g_n_uncertain_l2_sets; i++) {
+            EvSet *ev = l2evsets[n][i];
+            if (!ev || ev->size == 0 || ev->size > l2_info.n_ways)
+                continue;
+            n_usable++;
+            vec_push(&r->sizes, ev->size);
+            verify_one(ev, r);
+        }
+    }
+    return n_usable;
+}
+
+static u64 count_cands(EvCands ***cands_complex)
+{
+    u64 cnt = 0;
+    for (u32 c = 0; c < n_unc_l2_sets; c++) {
+        if (cands_complex[c][c])
+            cnt += cands_complex[c][c]->count;
+    }
+    return cnt;
+}
+
+// one repetition. true on error
+static bool run_rep(Scenario *sc, ScResult *r)
+{
+    u32 rep = r->reps;
+    u64 start, wall, items = 0;
+
+    if (sc->kind == SC_VERIFY) {
+        if (!last_l3) {
+            fprintf(stderr, ERR "%s needs an l3 or gran scenario before it\n", sc->name);
+            return true;
+        }
+        stats_reset();
+        start = time_us();
+        for (u32 i = 0; i < sc->n; i++)
+            items += sweep_l3(last_l3, last_kmax, r, false);
+        wall = time_us() - start;
+        goto done;
+    }
+
+    drop_last_l3();
+    if (sc->kind == SC_L2) {
+        // the shared set is rebuilt too, as later scenarios reuse it
+        free_l2_complex(bench_l2);
+        bench_l2 = NULL;
+    } else if ((sc->kind == SC_CANDS || sc->kind == SC_GRAN) && !get_bench_l2()) {
+        return true;
+    }
+
+    stats_reset();
+    start = time_us();
+    switch (sc->kind) {
+    case SC_L2:
+        bench_l2 = build_l2_evset(l2_info.n_sets);
+        wall = time_us() - start;
+        if (!bench_l2)
+            return true;
+        items = sweep_l2(bench_l2, r);
+        break;
+    case SC_CANDS: {
+        init_def_l3_conf(&def_l3_build_conf, NULL, NULL);
+        EvCands ***cands_complex = build_evcands_all_para(&def_l3_build_conf,
+                                                          bench_l2, 0);
+        wall = time_us() - start;
+        if (!cands_complex)
+            return true;
+        items = count_cands(cands_complex);
+        release_cands();
+        break;
+    }
+    case SC_L3:
+        granular = false;
+        g_config.num_sets = sc->n;
+        last_kmax = cache_uncertainty(&l3_info) / cache_uncertainty(&l2_info);
+        last_l3 = build_l3_evsets_para(sc->n);
+        wall = time_us() - start;
+        if (!last_l3)
+            return true;
+        items = sweep_l3(last_l3, last_kmax, r, true);
+        break;
+    case SC_GRAN:
+        granular = true;
+        g_config.num_l2_sets = sc->u;
+        g_config.evsets_per_l2 = sc->f;
+        g_config.num_offsets = sc->o;
+        last_kmax = sc->f;
+        last_l3 = build_l3_evsets_para_gran(sc->u, sc->o, bench_l2);
+        wall = time_us() - start;
+        if (!last_l3)
+            return true;
+        items = sweep_l3(last_l3, last_kmax, r, true);
+        break;
+    default:
+        return true;
+    }
+
+done:
+    r->wall_ms[rep] = wall / 1e3;
+    r->l2_ms[rep] = stats_phase_get(PH_L2_BUILD) / 1e3;
+    r->cands_ms[rep] = stats_phase_get(PH_CANDS) / 1e3;
+    r->l3_ms[rep] = stats_phase_get(PH_L3_BUILD) / 1e3;
+    r->items += items;
+    r->reps++;
+
+    printf(INFO "%s rep %u: %lu %s | %.3fms\n", sc->name, rep + 1, items,
+           sc->kind == SC_CANDS ? "candidate lines" :
+           sc->kind == SC_VERIFY ? "verifications" : "evsets",
+           r->wall_ms[rep]);
+    return false;
+}
+
+typedef struct {
+    f64 items_per_s, verify_pass;
+    f64 size_min, size_p10, size_p50, size_p90, size_max;
+    f64 wall[2], l2[2], cands[2], l3[2], verify[2]; // p50, p99
+} ScSummary;
+
+static void summarize(ScResult *r, ScSummary *s)
+{
+    f64 wall_s = 0;
+    for (u32 i = 0; i < r->reps; i++)
+        wall_s += r->wall_ms[i] / 1e3;
+
+    s->items_per_s = wall_s > 0 ? r->items / wall_s : 0;
+    s->verify_pass = r->n_verified ? (f64)r->n_passed / r->n_verified : 0;
+
+    s->size_min = pctl(r->sizes.v, r->sizes.cnt, 0);
+    s->size_p10 = pctl(r->sizes.v, r->sizes.cnt, 0.1);
+    s->size_p50 = pctl(r->sizes.v, r->sizes.cnt, 0.5);
+    s->size_p90 = pctl(r->sizes.v, r->sizes.cnt, 0.9);
+    s->size_max = pctl(r->sizes.v, r->sizes.cnt, 1);
+
+    struct { f64 *src, *dst; } phases[] = {
+        { r->wall_ms, s->wall }, { r->l2_ms, s->l2 },
+        { r->cands_ms, s->cands }, { r->l3_ms, s->l3 },
+    };
+    for (u32 i = 0; i < sizeof(phases) / sizeof(*phases); i++) {
+        phases[i].dst[0] = pctl(phases[i].src, r->reps, 0.5);
+        phases[i].dst[1] = pctl(phases[i].src, r->reps, 0.99);
+    }
+    s->verify[0] = pctl(r->verify_us.v, r->verify_us.cnt, 0.5);
+    s->verify[1] = pctl(r->verify_us.v, r->verify_us.cnt, 0.99);
+}
+
+static const char *csv_header =
+    "scenario,reps,items,items_per_s,verify_pass,"
+    "size_min,size_p10,size_p50,size_p90,size_max,"
+    "wall_p50_ms,wall_p99_ms,l2_p50_ms,l2_p99_ms,cands_p50_ms,cands_p99_ms,"
+    "l3_p50_ms,l3_p99_ms,verify_p50_us,verify_p99_us\n";
+
+static void write_csv(FILE *f, Scenario *scs, ScResult *res, ScSummary *sums, u32 n)
+{
+    fputs(csv_header, f);
+    for (u32 i = 0; i < n; i++) {
+        ScSummary *s = &sums[i];
+        fprintf(f, "%s,%u,%lu,%.3f,%.4f,%.0f,%.0f,%.0f,%.0f,%.0f,"
+                   "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f\n",
+                scs[i].name, res[i].reps, res[i].items, s->items_per_s, s->verify_pass,
+                s->size_min, s->size_p10, s->size_p50, s->size_p90, s->size_max,
+                s->wall[0], s->wall[1], s->l2[0], s->l2[1], s->cands[0], s->cands[1],
+                s->l3[0], s->l3[1], s->verify[0], s->verify[1]);
+    }
+}
+
+static void write_json(FILE *f, Scenario *scs, ScResult *res, ScSummary *sums, u32 n)
+{
+    fprintf(f, "{\"scenarios\":[");
+    for (u32 i = 0; i < n; i++) {
+        ScSummary *s = &sums[i];
+        fprintf(f, "%s{\"scenario\":\"%s\",\"reps\":%u,\"items\":%lu,"
+                   "\"items_per_s\":%.3f,\"verify_pass\":%.4f,",
+                i ? "," : "", scs[i].name, res[i].reps, res[i].items,
+                s->items_per_s, s->verify_pass);
+
+        // sizes are sorted by summarize
+        fprintf(f, "\"size_hist\":{");
+        F64Vec *sz = &res[i].sizes;
+        for (u64 j = 0, first = 1; j < sz->cnt;) {
+            u64 k = j;
+            while (k < sz->cnt && sz->v[k] == sz->v[j])
+                k++;
+            fprintf(f, "%s\"%.0f\":%lu", first ? "" : ",", sz->v[j], k - j);
+            first = 0;
+            j = k;
+        }
+
+        fprintf(f, "},\"p50_ms\":{\"wall\":%.3f,\"l2_build\":%.3f,\"cands\":%.3f,"
+                   "\"l3_build\":%.3f},\"p99_ms\":{\"wall\":%.3f,\"l2_build\":%.3f,"
+                   "\"cands\":%.3f,\"l3_build\":%.3f},"
+                   "\"verify_us\":{\"p50\":%.1f,\"p99\":%.1f}}",
+                s->wall[0], s->l2[0], s->cands[0], s->l3[0],
+                s->wall[1], s->l2[1], s->cands[1], s->l3[1],
+                s->verify[0], s->verify[1]);
+    }
+    fprintf(f, "]}\n");
+}
+
+// column @p col of a CSV line, -1 if missing
+static f64 csv_field(char *line, i32 col)
+{
+    char *p = line;
+    for (i32 i = 0; i < col && p; i++) {
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+    return p ? strtod(p, NULL) : -1;
+}
+
+static i32 csv_col(char *header, const char *name)
+{
+    i32 col = 0;
+    for (char *p = header; p; col++) {
+        u64 len = strcspn(p, ",\n");
+        if (len == strlen(name) && !strncmp(p, name, len))
+            return col;
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+    return -1;
+}
+
+/*
+  compares against a CSV from an earlier run. a scenario regresses if its
+  throughput or verification pass rate drops, or its p50 wall time grows, by
+  more than @p tol_pct. true if any did
+*/
+static bool compare_baseline(const char *path, Scenario *scs, ScSummary *sums,
+                             u32 n, f64 tol_pct)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, ERR "cannot open baseline %s\n", path);
+        return true;
+    }
+
+    char header[512], line[512];
+    if (!fgets(header, sizeof(header), f)) {
+        fprintf(stderr, ERR "empty baseline %s\n", path);
+        fclose(f);
+        return true;
+    }
+
+    i32 c_tput = csv_col(header, "items_per_s"),
+        c_pass = csv_col(header, "verify_pass"),
+        c_wall = csv_col(header, "wall_p50_ms");
+    if (c_tput < 0 || c_pass < 0 || c_wall < 0) {
+        fprintf(stderr, ERR "%s is not a vbench CSV\n", path);
+        fclose(f);
+        return true;
+    }
+
+    f64 tol = tol_pct / 100;
+    bool regressed = false;
+    printf(INFO "Baseline %s (tolerance %.1f%%):\n", path, tol_pct);
+    printf("  %-16s %14s %14s %8s %12s %12s %8s\n", "scenario", "items/s", "base",
+           "delta", "wall p50", "base", "delta");
+
+    while (fgets(line, sizeof(line), f)) {
+        u64 len = strcspn(line, ",");
+        for (u32 i = 0; i < n; i++) {
+            if (len != strlen(scs[i].name) || strncmp(line, scs[i].name, len))
+                continue;
+
+            f64 tput = csv_field(line, c_tput), pass = csv_field(line, c_pass),
+                wall = csv_field(line, c_wall);
+            f64 d_tput = tput > 0 ? sums[i].items_per_s / tput - 1 : 0,
+                d_wall = wall > 0 ? sums[i].wall[0] / wall - 1 : 0;
+            bool bad = d_tput < -tol || d_wall > tol || sums[i].verify_pass < pass - tol;
+
+            printf("  %-16s %14.2f %14.2f %+7.1f%% %10.3fms %10.3fms %+7.1f%%%s\n",
+                   scs[i].name, sums[i].items_per_s, tput, d_tput * 100,
+                   sums[i].wall[0], wall, d_wall * 100, bad ? "  <- regressed" : "");
+            if (bad && sums[i].verify_pass < pass - tol)
+                printf(WRN "%s: verification pass rate %.2f%% (baseline %.2f%%)\n",
+                       scs[i].name, sums[i].verify_pass * 100, pass * 100);
+            regressed |= bad;
+        }
+    }
+    fclose(f);
+
+    if (regressed)
+        printf(WRN "regression against the baseline\n");
+    else
+        printf(SUC "no regression against the baseline\n");
+    return regressed;
+}
+
+/*
+  kernel microbenchmarks (--kernels): each access/traversal kernel runs over
+  the first N lines of one filtered candidate pool, with a line of the same
+  pool as target. per trial, the target is loaded into the LLC, the kernel
+  runs timed, and the target reload tells whether it got evicted
+*/
+typedef enum KernId {
+    K_FWD = 0,      // access_array
+    K_BWD,          // access_array_bwd
+    K_PRIME,        // prime_cands_daniel
+    K_TRAVERSE,     // addrs_traverse
+    K_MT,           // traverse_cands_mt, with the helper thread
+    N_KERNELS
+} KernId;
+
+typedef enum KernLayout {
+    L_POOL = 0,     // candidate pool order
+    L_SHUFFLED,
+    L_IDX,          // page indices (EvIdx), for the kernels that have a variant
+    L_CHAIN,        // pool order linked through the lines (evset_chain), fwd/bwd only
+    N_LAYOUTS
+} KernLayout;
+
+static const char *kern_names[N_KERNELS] = {
+    [K_FWD] = "access_array",
+    [K_BWD] = "access_array_bwd",
+    [K_PRIME] = "prime_cands_daniel",
+    [K_TRAVERSE] = "addrs_traverse",
+    [K_MT] = "traverse_cands_mt",
+};
+
+static const char *layout_names[N_LAYOUTS] = {
+    [L_POOL] = "pool",
+    [L_SHUFFLED] = "shuffled",
+    [L_IDX] = "idx",
+    [L_CHAIN] = "chain",
+};
+
+// block/stride points of the prime patterns, the first is the default
+static const struct { u32 block, stride; } prime_grid[] = {
+    {24, 12}, {12, 12}, {16, 8}, {32, 16}, {48, 24}, {48, 12},
+};
+
+typedef struct {
+    KernId kern;
+    KernLayout layout;
+    u32 size, repeat, block, stride;
+    f64 cpl_p50, cpl_p90;   // cycles per line
+    f64 evict_rate;
+} KernRow;
+
+typedef struct {
+    KernRow *rows;
+    u32 cnt, cap;
+} KernRows;
+
+static ALWAYS_INLINE void kern_run(KernId kern, KernLayout layout, u8 **lines,
+                                   EvIdx *idx, evchain *chain, u64 cnt,
+                                   EvBuildConf *conf)
+{
+    u64 repeat = conf->ev_repeat, block = conf->block, stride = conf->stride;
+
+    if (layout == L_CHAIN) {
+        if (kern == K_BWD)
+            chase_bwd(chain, cnt);
+        else
+            chase_fwd(chain, cnt);
+        return;
+    }
+
+    if (layout == L_IDX) {
+        switch (kern) {
+        case K_FWD:
+            access_idx(idx->base, idx->idxs, cnt);
+            break;
+        case K_BWD:
+            access_idx_bwd(idx->base, idx->idxs, cnt);
+            break;
+        default:
+            prime_idx_daniel(idx->base, idx->idxs, cnt, repeat, stride, block);
+            break;
+        }
+        return;
+    }
+
+    switch (kern) {
+    case K_FWD:
+        access_array(lines, cnt);
+        break;
+    case K_BWD:
+        access_array_bwd(lines, cnt);
+        break;
+    case K_PRIME:
+        prime_cands_daniel(lines, cnt, repeat, stride, block);
+        break;
+    case K_TRAVERSE:
+        addrs_traverse(lines, cnt, conf);
+        break;
+    default:
+        traverse_cands_mt(lines, cnt, conf);
+        break;
+    }
+}
+
+static bool kern_point(KernRows *out, KernId kern, KernLayout layout, u8 *target,
+                       u8 **lines, EvIdx *idx, evchain *chain, u64 cnt,
+                       EvBuildConf *conf, u32 trials, f64 *cpl)
+{
+    u32 n_evicted = 0;
+    for (u32 t = 0; t < trials; t++) {
+        _clflushopt(target);
+        _mfence();
+        maccess(target);
+        helper_thread_read_single(target, conf->hctrl); // shared, so in the LLC
+        _lfence();
+
+        u64 start = _rdtsc();
+        kern_run(kern, layout, lines, idx, chain, cnt, conf);
+        _lfence();
+        u64 end = _rdtsc();
+
+        n_evicted += _time_maccess(target) >= g_lats.l3_thresh;
+        cpl[t] = (f64)(end - start) / cnt;
+    }
+
+    if (out->cnt == out->cap) {
+        u32 cap = out->cap ? out->cap * 2 : 64;
+        KernRow *rows = realloc(out->rows, cap * sizeof(*rows));
+        if (!rows) {
+            fprintf(stderr, ERR "failed to grow kernel results\n");
+            return true;
+        }
+        out->rows = rows;
+        out->cap = cap;
+    }
+
+    KernRow *row = &out->rows[out->cnt++];
+    *row = (KernRow) {
+        .kern = kern, .layout = layout, .size = cnt, .repeat = conf->ev_repeat,
+        .block = conf->block, .stride = conf->stride,
+        .evict_rate = (f64)n_evicted / trials,
+    };
+    row->cpl_p50 = pctl(cpl, trials, 0.5);
+    row->cpl_p90 = pctl(cpl, trials, 0.9);
+
+    bool params = kern == K_PRIME || kern == K_MT || (kern == K_TRAVERSE && row->repeat > 1);
+    printf("  %-20s %-9s %6u", kern_names[kern], layout_names[layout], row->size);
+    if (params)
+        printf("  r%u b%-2u s%-2u", row->repeat, row->block, row->stride);
+    else
+        printf("  %-11s", "");
+    printf(" %9.2f %9.2f %7.2f%%\n", row->cpl_p50, row->cpl_p90, row->evict_rate * 100);
+    return false;
+}
+
+static void shuffle_lines(u8 **lines, u64 cnt)
+{
+    for (u64 i = cnt - 1; i > 0; i--) {
+        u64 j = rand() % (i + 1);
+        u8 *tmp = lines[i];
+        lines[i] = lines[j];
+        lines[j] = tmp;
+    }
+}
+
+static bool run_kernels(u32 trials, KernRows *out)
+{
+    EvSet ***l2evsets = get_bench_l2();
+    if (!l2evsets)
+        return true;
+
+    init_def_l3_conf(&def_l3_build_conf, NULL, NULL);
+    EvCands ***cands_complex = build_evcands_all_para(&def_l3_build_conf, l2evsets, 1);
+    if (!cands_complex || !cands_complex[0][0] || cands_complex[0][0]->count < 2) {
+        fprintf(stderr, ERR "no candidate pool to run the kernels over\n");
+        return true;
+    }
+
+    EvCands *pool = cands_complex[0][0];
+    u64 max_cnt = pool->count - 1;
+    u8 **lines[N_LAYOUTS] = {0};
+    EvIdx idx = {0};
+    f64 *cpl = _calloc(trials, sizeof(*cpl));
+    helper_thread_ctrl hctrl = {0};
+    bool ret = true;
+
+    for (u32 l = 0; l < N_LAYOUTS; l++) {
+        lines[l] = _calloc(max_cnt, sizeof(u8 *));
+        if (!lines[l])
+            goto out;
+        for (u64 i = 0; i < max_cnt; i++)
+            lines[l][i] = evcands_at(pool, i + 1);
+    }
+    if (!cpl)
+        goto out;
+    shuffle_lines(lines[L_SHUFFLED], max_cnt);
+    bool have_idx = !evidx_encode(&idx, lines[L_IDX], max_cnt, pool->evb);
+
+    set_cpu_affinity(bench_main_vcpu);
+    if (start_helper_thread_pinned(&hctrl, bench_helper_vcpu))
+        goto out;
+
+    u8 *target = evcands_at(pool, 0);
+    EvBuildConf conf;
+    init_def_l3_conf(&conf, l2evsets[0][0], &hctrl);
+    u32 def_block = conf.block, def_stride = conf.stride;
+
+    printf(INFO "Kernels over a pool of %lu lines, %u trials per point\n", pool->count, trials);
+    printf("  %-20s %-9s %6s  %-11s %9s %9s %8s\n", "kernel", "layout", "lines",
+           "params", "cyc/l p50", "cyc/l p90", "evicted");
+
+    // a pool holds about cand_scale x n_ways lines congruent with the target,
+    // so the sizes go from below to above what evicts it
+    for (i32 sz = KERNEL_N_SIZES - 1; sz >= 0; sz--) {
+        u64 cnt = max_cnt >> sz;
+        if (cnt == 0)
+            continue;
+        // relinked per size, the chain closes over the first cnt lines
+        EvSet chained = {.addrs = lines[L_CHAIN], .size = cnt};
+        evset_chain(&chained);
+        for (u32 k = 0; k < N_KERNELS; k++) {
+            for (u32 l = 0; l < N_LAYOUTS; l++) {
+                if (l == L_IDX && (!have_idx || k == K_TRAVERSE || k == K_MT))
+                    continue;
+                if (l == L_CHAIN && k != K_FWD && k != K_BWD)
+                    continue;
+
+                bool grid = k == K_PRIME || k == K_MT;
+                u32 n_points = grid ? sizeof(prime_grid) / sizeof(*prime_grid) : 1;
+                for (u32 repeat = 1; repeat <= (k == K_FWD || k == K_BWD ? 1 : 2); repeat++) {
+                    for (u32 p = 0; p < n_points; p++) {
+                        conf.ev_repeat = repeat;
+                        conf.block = grid ? prime_grid[p].block : def_block;
+                        conf.stride = grid ? prime_grid[p].stride : def_stride;
+                        if (kern_point(out, k, l, target, lines[l], &idx, chained.chain,
+                                       cnt, &conf, trials, cpl))
+                            goto out_helper;
+                    }
+                }
+            }
+        }
+    }
+    ret = false;
+
+out_helper:
+    stop_helper_thread(&hctrl);
+out:
+    for (u32 l = 0; l < N_LAYOUTS; l++)
+        free(lines[l]);
+    evidx_free(&idx);
+    free(cpl);
+    release_cands();
+    return ret;
+}
+
+static void write_kernels(FILE *f, KernRows *kr, bool json)
+{
+    if (!json)
+        fputs("kernel,layout,lines,repeat,block,stride,cycles_per_line_p50,"
+              "cycles_per_line_p90,evict_rate\n", f);
+    else
+        fprintf(f, "{\"kernels\":[");
+
+    for (u32 i = 0; i < kr->cnt; i++) {
+        KernRow *r = &kr->rows[i];
+        if (json) {
+            fprintf(f, "%s{\"kernel\":\"%s\",\"layout\":\"%s\",\"lines\":%u,\"repeat\":%u,"
+                       "\"block\":%u,\"stride\":%u,\"cycles_per_line_p50\":%.2f,"
+                       "\"cycles_per_line_p90\":%.2f,\"evict_rate\":%.4f}",
+                    i ? "," : "", kern_names[r->kern], layout_names[r->layout], r->size,
+                    r->repeat, r->block, r->stride, r->cpl_p50, r->cpl_p90, r->evict_rate);
+        } else {
+            fprintf(f, "%s,%s,%u,%u,%u,%u,%.2f,%.2f,%.4f\n",
+                    kern_names[r->kern], layout_names[r->layout], r->size, r->repeat,
+                    r->block, r->stride, r->cpl_p50, r->cpl_p90, r->evict_rate);
+        }
+    }
+
+    if (json)
+        fprintf(f, "]}\n");
+}
+
+static bool write_file(const char *path, Scenario *scs, ScResult *res, ScSummary *sums,
+                       u32 n, bool json)
+{
+    FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!f) {
+        fprintf(stderr, ERR "cannot write %s\n", path);
+        return true;
+    }
+    if (json)
+        write_json(f, scs, res, sums, n);
+    else
+        write_csv(f, scs, res, sums, n);
+    if (f != stdout) {
+        fclose(f);
+        printf(INFO "Results written to: %s\n", path);
+    }
+    return false;
+}
+
+static i32 run_kernels_main(u32 trials, const char *csv_path, const char *json_path,
+                            const char *baseline_path)
+{
+    KernRows kr = {0};
+    i32 result = EXIT_SUCCESS;
+
+    if (baseline_path)
+        printf(WRN "--baseline only compares scenarios, ignored with --kernels\n");
+
+    if (run_kernels(trials, &kr))
+        result = EXIT_FAILURE;
+
+    const char *paths[2] = { csv_path, json_path };
+    for (u32 i = 0; i < 2; i++) {
+        if (!paths[i])
+            continue;
+        FILE *f = strcmp(paths[i], "-") ? fopen(paths[i], "w") : stdout;
+        if (!f) {
+            fprintf(stderr, ERR "cannot write %s\n", paths[i]);
+            result = EXIT_FAILURE;
+            continue;
+        }
+        write_kernels(f, &kr, i == 1);
+        if (f != stdout) {
+            fclose(f);
+            printf(INFO "Results written to: %s\n", paths[i]);
+        }
+    }
+
+    free(kr.rows);
+    free_l2_complex(bench_l2);
+    cleanup_mem(NULL, NULL, 0);
+#if EVSIM
+    sim_print_stats();
+#endif
+    return result;
+}
+
+i32 main(i32 argc, char* argv[])
+{
+    setup_segv_handler();
+
+    struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"verbose", required_argument, 0, 'v'},
+        {"reps", required_argument, 0, 'r'},
+        {"scenarios", required_argument, 0, 's'},
+        {"num-core", required_argument, 0, 'c'},
+        {"csv", required_argument, 0, 0},
+        {"json", required_argument, 0, 0},
+        {"baseline", required_argument, 0, 0},
+        {"tol", required_argument, 0, 0},
+        {"algo", required_argument, 0, 0},
+        {"timer", required_argument, 0, 0},
+        {"filter", required_argument, 0, 0},
+        {"kernels", no_argument, 0, 0},
+        {"trials", required_argument, 0, 0},
+        {"cores", required_argument, 0, 0},
+        {0, 0, 0, 0}
+    };
+
+    init_def_args_conf();
+    g_config.cache_level = L3;
+    srand(time(NULL));
+
+    char scenario_list[512] = DEF_SCENARIOS;
+    const char *csv_path = NULL, *json_path = NULL, *baseline_path = NULL;
+    u32 reps = DEF_REPS, trials = DEF_KERNEL_TRIALS;
+    f64 tol_pct = DEF_TOL_PCT;
+    bool kernels = false;
+
+    i32 opt, option_index = 0;
+    while ((opt = getopt_long(argc, argv, "hv:r:s:c:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'h':
+                return print_usage_vbench(argv[0]);
+            case 'v':
+                g_config.verbose_level = atoi(optarg);
+                if (g_config.verbose_level < 1 || g_config.verbose_level > 3)
+                    g_config.verbose_level = 0;
+                verbose = g_config.verbose_level;
+                break;
+            case 'r':
+                reps = atoi(optarg);
+                if (reps < 1 || reps > MAX_REPS) {
+                    fprintf(stderr, ERR "-r must be between 1 and %u\n", MAX_REPS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                snprintf(scenario_list, sizeof(scenario_list), "%s", optarg);
+                break;
+            case 'c': {
+                i32 parsed = atoi(optarg);
+                if (parsed <= 0 || parsed % 2 != 0) {
+                    fprintf(stderr, ERR "-c must be a positive even core count\n");
+                    return EXIT_FAILURE;
+                }
+                if (!validate_core_count_arg((u32)parsed))
+                    return EXIT_FAILURE;
+                g_config.num_threads = (u32)parsed;
+                break;
+            }
+            case 0: {
+                const char *name = long_options[option_index].name;
+                if (strcmp(name, "csv") == 0) {
+                    csv_path = optarg;
+                } else if (strcmp(name, "json") == 0) {
+                    json_path = optarg;
+                } else if (strcmp(name, "baseline") == 0) {
+                    baseline_path = optarg;
+                } else if (strcmp(name, "tol") == 0) {
+                    tol_pct = strtod(optarg, NULL);
+                    if (tol_pct <= 0) {
+                        fprintf(stderr, ERR "--tol must be a positive percentage\n");
+                        return EXIT_FAILURE;
+                    }
+                } else if (strcmp(name, "algo") == 0) {
+                    i32 algo = ev_algo_parse(optarg);
+                    if (algo < 0) {
+                        fprintf(stderr, ERR "unknown --algo %s (zhao, gt or bs)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.ev_algo = (u32)algo;
+                } else if (strcmp(name, "timer") == 0) {
+                    i32 src = timer_src_parse(optarg);
+                    if (src < 0) {
+                        fprintf(stderr, ERR "unknown --timer %s (tsc, pmc, thread or auto)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.timer_src = (u32)src;
+                } else if (strcmp(name, "filter") == 0) {
+                    i32 batch = filter_batch_parse(optarg);
+                    if (batch < 0) {
+                        fprintf(stderr, ERR "unknown --filter %s (auto, seq or a batch size)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.filter_batch = (u32)batch;
+                } else if (strcmp(name, "kernels") == 0) {
+                    kernels = true;
+                } else if (strcmp(name, "trials") == 0) {
+                    trials = atoi(optarg);
+                    if ((i32)trials <= 0) {
+                        fprintf(stderr, ERR "--trials must be greater than 0\n");
+                        return EXIT_FAILURE;
+                    }
+                } else if (strcmp(name, "cores") == 0) {
+                    i32 n_cores = n_system_cores(), m, h;
+                    if (sscanf(optarg, "%d,%d", &m, &h) != 2 || m < 0 || h < 0 ||
+                        m >= n_cores || h >= n_cores || m == h) {
+                        fprintf(stderr, ERR "--cores takes two distinct vCPUs below %d, as M,H\n",
+                                n_cores);
+                        return EXIT_FAILURE;
+                    }
+                    bench_main_vcpu = m;
+                    bench_helper_vcpu = h;
+                }
+                break;
+            }
+            default:
+                return print_usage_vbench(argv[0]);
+        }
+    }
+
+    Scenario scs[MAX_SCENARIOS];
+    u32 n_scs = scenarios_parse(scenario_list, scs);
+    if (!n_scs)
+        return EXIT_FAILURE;
+
+    init_cache_info();
+
+    u64 max_f = cache_uncertainty(&l3_info) / cache_uncertainty(&l2_info);
+    for (u32 i = 0; i < n_scs; i++) {
+        Scenario *sc = &scs[i];
+        if (sc->kind == SC_GRAN && sc->u > g_n_uncertain_l2_sets) {
+            printf(WRN "%s: -u capped to %u L2 uncertain sets\n", sc->name,
+                   g_n_uncertain_l2_sets);
+            sc->u = g_n_uncertain_l2_sets;
+        }
+        if (sc->kind == SC_GRAN && (sc->f > max_f || sc->o > NUM_OFFSETS)) {
+            fprintf(stderr, ERR "%s: -f must be <= %lu and -o <= %lu\n", sc->name,
+                    max_f, NUM_OFFSETS);
+            return EXIT_FAILURE;
+        }
+        if (sc->kind == SC_L3 && sc->n > NUM_OFFSETS)
+            sc->n = NUM_OFFSETS;
+    }
+
+    stats_enable();
+    init_cache_lats_thresh(DEF_LAT_REPS);
+    print_cache_lats();
+
+    if (kernels)
+        return run_kernels_main(trials, csv_path, json_path, baseline_path);
+
+    ScResult *res = _calloc(n_scs, sizeof(*res));
+    ScSummary *sums = _calloc(n_scs, sizeof(*sums));
+    if (!res || !sums) {
+        fprintf(stderr, ERR "failed to allocate bench results\n");
+        return EXIT_FAILURE;
+    }
+
+    i32 result = EXIT_SUCCESS;
+    u64 start_full = time_us();
+
+    for (u32 i = 0; i < n_scs; i++) {
+        printf(INFO "Scenario %s (%u reps)\n", scs[i].name, reps);
+        for (u32 r = 0; r < reps; r++) {
+            if (run_rep(&scs[i], &res[i])) {
+                fprintf(stderr, ERR "scenario %s failed in rep %u\n", scs[i].name, r + 1);
+                result = EXIT_FAILURE;
+                break;
+            }
+        }
+        summarize(&res[i], &sums[i]);
+    }
+
+    printf(INFO "Benchmark completed | %.3fs\n", (time_us() - start_full) / 1e6);
+    printf("  %-16s %10s %14s %8s %10s %12s %12s\n", "scenario", "items",
+           "items/s", "pass", "size p50", "wall p50", "wall p99");
+    for (u32 i = 0; i < n_scs; i++) {
+        printf("  %-16s %10lu %14.2f %7.2f%% %10.0f %10.3fms %10.3fms\n",
+               scs[i].name, res[i].items, sums[i].items_per_s, sums[i].verify_pass * 100,
+               sums[i].size_p50, sums[i].wall[0], sums[i].wall[1]);
+    }
+
+    if (csv_path && write_file(csv_path, scs, res, sums, n_scs, false))
+        result = EXIT_FAILURE;
+    if (json_path && write_file(json_path, scs, res, sums, n_scs, true))
+        result = EXIT_FAILURE;
+    if (baseline_path && compare_baseline(baseline_path, scs, sums, n_scs, tol_pct))
+        result = EXIT_FAILURE;
+
+    drop_last_l3();
+    free_l2_complex(bench_l2);
+    for (u32 i = 0; i < n_scs; i++) {
+        free(res[i].sizes.v);
+        free(res[i].verify_us.v);
+    }
+    free(res);
+    free(sums);
+    cleanup_mem(NULL, NULL, 0);
+#if EVSIM
+    sim_print_stats();
+#endif
+    return result;
+}
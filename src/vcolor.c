@@ -7,6 +7,7 @@
 #include "../include/lats.h"
 #include "../vm_tools/gpa_hpa.h"
 #include "../include/vset_ops.h"
+#include "../include/telemetry.h"
 #include <bits/getopt_ext.h>
 #include <pthread.h>
 #include <fcntl.h>
@@ -173,110 +174,21 @@ static void drop_caches(void)
     }
 }
 
-typedef struct {
-    u32 start_idx;
-    u32 end_idx;
-    u32 thread_idx;
-    EvCands *base_cands;
-    EvCands **results;
-    EvSet ***l2evsets;
-    EvBuildConf *conf;
-} color_arg_t;
-
-static bool build_single_color(u32 idx, u32 thread_idx, EvCands *base,
-                               EvCands **results, EvSet ***l2evsets,
-                               EvBuildConf *conf)
-{
-    u32 offset = idx * CL_SIZE;
-    EvBuildConf c = *conf;
-    c.filter_ev = l2evsets[idx][idx];
-    c.filter_ev->build_conf = &def_l2_build_conf;
-
-    EvCands *cand = evcands_new(&l3_info, &c, base->evb);
-    if (!cand)
-        return false;
-
-    if (evcands_populate(offset, cand, &c, thread_idx, offset)) {
-        free(cand->addrs);
-        free(cand);
-        return false;
-    }
-
-    results[idx] = cand;
-    return true;
-}
-
-static void *color_worker(void *arg)
-{
-    color_arg_t *ctx = (color_arg_t *)arg;
-    pin_thread_by_pid(pthread_self(), ctx->thread_idx);
-    for (u32 i = ctx->start_idx; i < ctx->end_idx; i++)
-        build_single_color(i, ctx->thread_idx, ctx->base_cands,
-                           ctx->results, ctx->l2evsets, ctx->conf);
-    return NULL;
-}
-
 static EvCands **build_color_cands_para(EvBuildConf *conf, EvSet ***l2evsets)
 {
-    u64 start_alloc = time_us();
-    EvCands *base_cands = evcands_new(&l3_info, conf, NULL);
-    if (!base_cands) {
-        fprintf(stderr, ERR "Failed to allocate EvBuffer\n");
-        return NULL;
-    }
-    u64 end_alloc = time_us();
-    if (verbose)
-        printf(V1 "Completed EvCands allocation | %.3fms\n",
-               (end_alloc - start_alloc) / 1e3);
-
-    u32 n_colors = g_n_uncertain_l2_sets;
-    EvCands **results = _calloc(n_colors, sizeof(EvCands*));
-    if (!results)
-        return NULL;
-
-    u32 n_threads = g_config.num_threads ? g_config.num_threads : n_system_cores();
-    if (n_threads > n_colors)
-        n_threads = n_colors;
-
-    pthread_t tids[n_threads];
-    color_arg_t args[n_threads];
-    u32 base_load = n_colors / n_threads;
-    u32 rem = n_colors % n_threads;
-    u32 curr = 0;
-
     u64 start_filter = time_us();
-
-    for (u32 t = 0; t < n_threads; t++) {
-        u32 cnt = base_load + (t < rem ? 1 : 0);
-        args[t].start_idx = curr;
-        args[t].end_idx = curr + cnt;
-        args[t].thread_idx = t;
-        args[t].base_cands = base_cands;
-        args[t].results = results;
-        args[t].l2evsets = l2evsets;
-        args[t].conf = conf;
-        curr += cnt;
-        if (pthread_create(&tids[t], NULL, color_worker, &args[t])) {
-            fprintf(stderr, ERR "thread create failed\n");
-            n_threads = t;
-            break;
-        }
+    EvCands **results = evcands_stream_colors(conf, l2evsets, g_n_uncertain_l2_sets,
+                                              g_n_uncertain_l2_sets);
+    u64 end_filter = time_us();
+    if (!results) {
+        fprintf(stderr, ERR "Failed to populate candidates\n");
+        return NULL;
     }
 
-    for (u32 t = 0; t < n_threads; t++)
-        pthread_join(tids[t], NULL);
-
-    u64 end_filter = time_us();
     if (verbose)
         printf(V1 "Completed filtering | %.3fms\n",
                (end_filter - start_filter) / 1e3);
 
-    for (u32 i = 0; i < n_colors; i++)
-        if (!results[i]) {
-            fprintf(stderr, ERR "Failed to populate candidates for color %u\n", i);
-            return NULL;
-        }
-
     return results;
 }
 
@@ -290,13 +202,12 @@ typedef struct {
     u32 n_ways;
     u32 wait_us;
     u32 n_pairs;
-    u64 cycles_per_us;
     f64 *ewma;
     f64 alpha_rise;
     f64 alpha_fall;
     f64 **tot_avg;
-    pthread_t *threads;
     l2c_occ_worker_arg *wargs;
+    l2c_occ_pool pool;
 } scan_ctx_t;
 
 static bool init_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
@@ -349,9 +260,6 @@ static bool init_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
         }
     }
 
-    u64 freq = get_cpu_freq_hz();
-    ctx->cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     i32 n_cores = n_system_cores();
     u32 req = g_config.num_threads ? g_config.num_threads : n_cores;
     if (req > (u32)n_cores) req = n_cores;
@@ -361,9 +269,8 @@ static bool init_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
 
     ctx->ewma = _calloc(ctx->n_colors, sizeof(f64));
     ctx->tot_avg = _calloc(ctx->n_colors, sizeof(f64*));
-    ctx->threads = _calloc(ctx->n_pairs, sizeof(pthread_t));
     ctx->wargs = _calloc(ctx->n_pairs, sizeof(l2c_occ_worker_arg));
-    if (!ctx->ewma || !ctx->tot_avg || !ctx->threads || !ctx->wargs)
+    if (!ctx->ewma || !ctx->tot_avg || !ctx->wargs)
         return false;
 
     for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -378,7 +285,6 @@ static bool init_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
     for (u32 i = 0; i < ctx->n_pairs; i++) {
         u32 count = base + (i < extra ? 1 : 0);
         ctx->wargs[i].wait_us = ctx->wait_us;
-        ctx->wargs[i].cycles_per_us = ctx->cycles_per_us;
         ctx->wargs[i].iterations = 1;
         ctx->wargs[i].color_sets = ctx->color_sets;
         ctx->wargs[i].color_counts = ctx->color_counts;
@@ -397,6 +303,7 @@ static void free_scan_ctx(scan_ctx_t *ctx)
 {
     if (!ctx) return;
 
+    l2c_occ_pool_stop(&ctx->pool);
     free_evset_complex(ctx->complex, g_config.num_offsets, ctx->n_colors,
                        g_config.evsets_per_l2);
 
@@ -410,7 +317,6 @@ static void free_scan_ctx(scan_ctx_t *ctx)
     if (ctx->color_counts) free(ctx->color_counts);
     if (ctx->filters) free(ctx->filters);
     if (ctx->ewma) free(ctx->ewma);
-    if (ctx->threads) free(ctx->threads);
     if (ctx->wargs) free(ctx->wargs);
     if (ctx->tot_avg) {
         for (u32 c = 0; c < ctx->n_colors; c++)
@@ -427,15 +333,15 @@ static bool scan_iteration(scan_ctx_t *ctx, f64 *rates)
     for (u32 c = 0; c < ctx->n_colors; c++)
         ctx->tot_avg[c][0] = 0.0;
 
-    for (u32 i = 0; i < ctx->n_pairs; i++) {
-        ctx->wargs[i].wait_us = ctx->wait_us;
-        if (pthread_create(&ctx->threads[i], NULL, l2c_occ_worker, &ctx->wargs[i])) {
-            ctx->n_pairs = i;
-            break;
-        }
+    if (!ctx->pool.threads) {
+        if (l2c_occ_pool_start(&ctx->pool, ctx->wargs, ctx->n_pairs))
+            return false;
+        ctx->n_pairs = ctx->pool.n_pairs;
     }
+
     for (u32 i = 0; i < ctx->n_pairs; i++)
-        pthread_join(ctx->threads[i], NULL);
+        ctx->wargs[i].wait_us = ctx->wait_us;
+    l2c_occ_pool_run(&ctx->pool);
 
     for (u32 c = 0; c < ctx->n_colors; c++) {
         f64 total = (f64)ctx->n_ways * ctx->color_counts[c];
@@ -454,6 +360,17 @@ static void update_ewma(scan_ctx_t *ctx, f64 *rates)
     }
 }
 
+// colors without evsets are published as not valid
+static void publish_hotness(scan_ctx_t *ctx, f64 *rates)
+{
+    bool valid[TELEM_MAX_ENTRIES];
+    for (u32 c = 0; c < ctx->n_colors && c < TELEM_MAX_ENTRIES; c++)
+        valid[c] = ctx->color_counts[c] > 0;
+    WaitStats ws = wait_stats_take();
+    telem_note_waits(ws.n, ws.sum_ns, ws.max_ns);
+    telem_publish(TELEM_COLOR, ctx->n_colors, NULL, rates, ctx->ewma, valid, ctx->wait_us);
+}
+
 static void print_hotness(scan_ctx_t *ctx, u32 *host_colors)
 {
     for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -528,6 +445,7 @@ i32 main(i32 argc, char *argv[])
     bool use_vset = false;
     u32 scan_period_ms = 1000;
     u32 scan_wait_us = 7000;
+    const char *telem_path = NULL;
     u32 scan_cand_scale = 3;
     f64 alpha_r = 0.85, alpha_f = 0.85;
     struct option long_options[] = {
@@ -543,6 +461,7 @@ i32 main(i32 argc, char *argv[])
         {"alpha-rise", required_argument, 0, 2},
         {"alpha-fall", required_argument, 0, 3},
         {"scan-wait", required_argument, 0, 4},
+        {"telemetry", optional_argument, 0, 5},
         {0,0,0,0}
     };
 
@@ -605,6 +524,8 @@ i32 main(i32 argc, char *argv[])
                 alpha_f = atof(optarg);
             } else if (opt == 4) {
                 scan_wait_us = atoi(optarg);
+            } else if (opt == 5) {
+                telem_path = optarg ? optarg : TELEM_DEF_PATH;
             } else {
                 return 0;
             }
@@ -700,6 +621,11 @@ i32 main(i32 argc, char *argv[])
         printf("Starting vSet Monitoring\n");
         printf("-------------------------\n");
 
+        if (telem_path && telem_open(telem_path)) {
+            if (host_colors) free(host_colors);
+            return EXIT_FAILURE;
+        }
+
         scan_ctx_t ctx;
         g_config.cand_scaling = scan_cand_scale; // -C
         def_l3_build_conf.cand_scale = scan_cand_scale;
@@ -721,6 +647,7 @@ i32 main(i32 argc, char *argv[])
         scan_iteration(&ctx, rates);
         for (u32 c = 0; c < ctx.n_colors; c++)
             ctx.ewma[c] = rates[c];
+        publish_hotness(&ctx, rates);
 
         u32 order[VCOLOR_MAX_COLORS];
         color_hot_t tmp[VCOLOR_MAX_COLORS];
@@ -747,6 +674,7 @@ i32 main(i32 argc, char *argv[])
         while (1) {
             scan_iteration(&ctx, rates);
             update_ewma(&ctx, rates);
+            publish_hotness(&ctx, rates);
 
             for (u32 i = 0; i < ctx.n_colors; i++) {
                 tmp[i].color = i;
@@ -791,6 +719,7 @@ i32 main(i32 argc, char *argv[])
             print_hotness(&ctx, host_colors);
             printf("Hottest color: %2u\n", hottest);
             fflush(stdout);
+            tb_check();
             usleep(scan_period_ms * 1000);
         }
 
@@ -5,6 +5,7 @@
 #include "../include/lats.h"
 #include "../include/evset.h"
 #include "../include/evset_para.h"
+#include "../include/stats.h"
 #include "../vm_tools/gpa_hpa.h"
 #include <bits/getopt_ext.h>
 #include <stdlib.h>
@@ -35,6 +36,13 @@ i32 main(i32 argc, char* argv[])
         {"evsets-per-l2", required_argument, 0, 'f'},
         {"num-offsets", required_argument, 0, 'o'},
         {"vtop", no_argument, 0, 0},
+        {"algo", required_argument, 0, 0},
+        {"sprt", required_argument, 0, 0},
+        {"huge", no_argument, 0, 0},
+        {"host-huge", no_argument, 0, 0},
+        {"timer", required_argument, 0, 0},
+        {"filter", required_argument, 0, 0},
+        {"stats", required_argument, 0, 0},
         {0, 0, 0, 0}
     };
 
@@ -156,6 +164,45 @@ i32 main(i32 argc, char* argv[])
             case 0:
                 if (strcmp(long_options[option_index].name, "vtop") == 0) {
                     vtop = true;
+                } else if (strcmp(long_options[option_index].name, "algo") == 0) {
+                    i32 algo = ev_algo_parse(optarg);
+                    if (algo < 0) {
+                        fprintf(stderr, ERR "unknown --algo %s (zhao, gt or bs)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.ev_algo = (u32)algo;
+                } else if (strcmp(long_options[option_index].name, "sprt") == 0) {
+                    f64 conf = strtod(optarg, NULL);
+                    if (conf <= 0.5 || conf >= 1) {
+                        fprintf(stderr, ERR "--sprt must be in (0.5, 1)\n");
+                        return EXIT_FAILURE;
+                    }
+                    g_config.sprt_conf = conf;
+                } else if (strcmp(long_options[option_index].name, "huge") == 0) {
+                    if (g_config.huge_pages == HUGE_OFF)
+                        g_config.huge_pages = HUGE_GUEST;
+                } else if (strcmp(long_options[option_index].name, "host-huge") == 0) {
+                    g_config.huge_pages = HUGE_HOST;
+                } else if (strcmp(long_options[option_index].name, "timer") == 0) {
+                    i32 src = timer_src_parse(optarg);
+                    if (src < 0) {
+                        fprintf(stderr, ERR "unknown --timer %s (tsc, pmc, thread or auto)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.timer_src = (u32)src;
+                } else if (strcmp(long_options[option_index].name, "filter") == 0) {
+                    i32 batch = filter_batch_parse(optarg);
+                    if (batch < 0) {
+                        fprintf(stderr, ERR "unknown --filter %s (auto, seq or a batch size)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.filter_batch = (u32)batch;
+                } else if (strcmp(long_options[option_index].name, "stats") == 0) {
+                    if (strcasecmp(optarg, "json") != 0) {
+                        fprintf(stderr, ERR "unknown --stats format %s (json)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.stats_json = true;
                 }
                 break;
             default: return print_usage_vev(argv[0]);
@@ -198,9 +245,13 @@ i32 main(i32 argc, char* argv[])
         }
     }
 
+    if (g_config.stats_json)
+        stats_enable();
+
     start_lat_detect = time_us();
     init_cache_lats_thresh(DEF_LAT_REPS);
     end_lat_detect = time_us();
+    stats_phase_add(PH_LATS, end_lat_detect - start_lat_detect);
 
     print_cache_lats();
 
@@ -253,6 +304,10 @@ check_result:
     
     printf(INFO "Program completed | %.3fs\n", 
           (end_full - start_full) / 1e6);
+#if EVSIM
+    sim_print_stats();
+#endif
+    stats_report(stdout); // last line, for scripts
     
     return result;
 }
@@ -22,7 +22,6 @@ extern i32 debug;
 typedef struct {
     u32 tid;
     u32 wait_us;
-    u64 cycles_per_us;
     EvSet ***color_sets;
     u32 *color_counts;
     u32 start_color;
@@ -99,6 +98,8 @@ static void *poisoner_worker(void *arg)
     // Attach helper thread to all eviction sets this worker will operate on.
     attach_helper_to_evsets(w->color_sets, w->color_counts, w->start_color,
                             w->num_colors, &hctrl);
+    compact_color_evsets(w->color_sets, w->color_counts, w->start_color,
+                         w->num_colors);
 
     if (verbose) {
         printf(V1 "thread pair %u working on colors [%u:%u]\n",
@@ -106,6 +107,8 @@ static void *poisoner_worker(void *arg)
     }
 
     while (1) {
+        if (w->tid == 0)
+            tb_check(); // one pair watches for a new tsc rate
         u64 p_start = _rdtsc();
         for (u32 idx = 0; idx < w->num_colors; idx++) {
             u32 color = w->start_color + idx;
@@ -113,7 +116,10 @@ static void *poisoner_worker(void *arg)
             for (u32 s = 0; s < set_cnt; s++) {
                 EvSet *ev = w->color_sets[color][s];
                 // thrash
-                access_array(ev->addrs, ev->size);
+                if (ev->idx.count == ev->size)
+                    access_idx(ev->idx.base, ev->idx.idxs, ev->size);
+                else
+                    access_array(ev->addrs, ev->size);
                 /*
                 for (u32 i = 0; i < ev->size; i++)
                     memset(ev->addrs[i], 0xF, PAGE_SIZE);
@@ -121,17 +127,17 @@ static void *poisoner_worker(void *arg)
             }
         }
         u64 p_end = _rdtsc();
-        u32 prime_us = (u32)((p_end - p_start) / w->cycles_per_us);
+        u32 prime_us = (u32)tb_cyc_to_us(p_end - p_start);
 
         // pass -t 1 if you want continuous thrashing back to back
         // otherwise some waiting period would be triggered here
         // which reduces intensity of the poisoner
         if (w->wait_us > prime_us) {
             u32 remaining_us = w->wait_us - prime_us;
-            u64 wait_cycles = (u64)remaining_us * w->cycles_per_us;
+            u64 wait_cycles = tb_us_to_cyc(remaining_us);
             u64 end_time = _rdtsc() + wait_cycles;
-            while (_rdtsc() < end_time)
-                ;
+            helper_thread_park(&hctrl, end_time);
+            wait_until_tsc(end_time);
         }
 
         // keep thrash
@@ -140,7 +146,10 @@ static void *poisoner_worker(void *arg)
             u32 set_cnt = w->color_counts[color];
             for (u32 s = 0; s < set_cnt; s++) {
                 EvSet *ev = w->color_sets[color][s];
-                access_array(ev->addrs, ev->size);
+                if (ev->idx.count == ev->size)
+                    access_idx(ev->idx.base, ev->idx.idxs, ev->size);
+                else
+                    access_array(ev->addrs, ev->size);
             }
         }
     }
@@ -171,9 +180,6 @@ static void start_poisoning(EvSet ****complex)
         }
     }
 
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    u64 cycles_per_us = cpu_freq_hz ? cpu_freq_hz / 1000000ULL : 2000ULL;
-
     i32 n_cores = n_system_cores();
     u32 req_threads = g_config.num_threads ? g_config.num_threads : n_cores;
     if (req_threads > (u32)n_cores)
@@ -195,7 +201,6 @@ static void start_poisoning(EvSet ****complex)
         u32 count = base + (i < extra ? 1 : 0);
         wargs[i].tid = i;
         wargs[i].wait_us = wait_time_us;
-        wargs[i].cycles_per_us = cycles_per_us;
         wargs[i].color_sets = color_sets;
         wargs[i].color_counts = color_counts;
         wargs[i].start_color = next_start;
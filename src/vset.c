@@ -6,6 +6,8 @@
 #include "../include/config.h"
 #include "../include/evset.h"
 #include "../include/evset_para.h"
+#include "../include/prime.h"
+#include "../include/telemetry.h"
 #include "../vm_tools/gpa_hpa.h"
 #include <unistd.h>
 #include <stdlib.h>
@@ -36,13 +38,12 @@ typedef struct {
     u32 n_ways;
     u32 wait_us;
     u32 n_pairs;
-    u64 cycles_per_us;
     f64 *ewma;
     f64 alpha_rise;
     f64 alpha_fall;
     f64 **tot_avg;
-    pthread_t *threads;
     l2c_occ_worker_arg *wargs;
+    l2c_occ_pool pool;
 } scan_ctx_t;
 
 static bool init_live_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
@@ -98,9 +99,6 @@ static bool init_live_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
         }
     }
 
-    u64 freq = get_cpu_freq_hz();
-    ctx->cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     i32 n_cores = n_system_cores();
     u32 req = g_config.num_threads ? g_config.num_threads : n_cores;
     if (req > (u32)n_cores) req = n_cores;
@@ -110,9 +108,8 @@ static bool init_live_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
 
     ctx->ewma = _calloc(ctx->n_colors, sizeof(f64));
     ctx->tot_avg = _calloc(ctx->n_colors, sizeof(f64*));
-    ctx->threads = _calloc(ctx->n_pairs, sizeof(pthread_t));
     ctx->wargs = _calloc(ctx->n_pairs, sizeof(l2c_occ_worker_arg));
-    if (!ctx->ewma || !ctx->tot_avg || !ctx->threads || !ctx->wargs)
+    if (!ctx->ewma || !ctx->tot_avg || !ctx->wargs)
         return false;
 
     for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -127,7 +124,6 @@ static bool init_live_scan_ctx(scan_ctx_t *ctx, EvSet ***filters, u32 n_colors)
     for (u32 i = 0; i < ctx->n_pairs; i++) {
         u32 count = base + (i < extra ? 1 : 0);
         ctx->wargs[i].wait_us = ctx->wait_us;
-        ctx->wargs[i].cycles_per_us = ctx->cycles_per_us;
         ctx->wargs[i].iterations = 1;
         ctx->wargs[i].color_sets = ctx->color_sets;
         ctx->wargs[i].color_counts = ctx->color_counts;
@@ -146,6 +142,7 @@ static void free_live_scan_ctx(scan_ctx_t *ctx)
 {
     if (!ctx) return;
 
+    l2c_occ_pool_stop(&ctx->pool);
     free_evset_complex(ctx->complex, g_config.num_offsets, ctx->n_colors,
                        g_config.evsets_per_l2);
 
@@ -159,7 +156,6 @@ static void free_live_scan_ctx(scan_ctx_t *ctx)
     if (ctx->color_counts) free(ctx->color_counts);
     if (ctx->filters) free(ctx->filters);
     if (ctx->ewma) free(ctx->ewma);
-    if (ctx->threads) free(ctx->threads);
     if (ctx->wargs) free(ctx->wargs);
     if (ctx->tot_avg) {
         for (u32 c = 0; c < ctx->n_colors; c++)
@@ -176,16 +172,15 @@ static bool scan_iteration(scan_ctx_t *ctx, f64 *rates)
     for (u32 c = 0; c < ctx->n_colors; c++)
         ctx->tot_avg[c][0] = 0.0;
 
-    for (u32 i = 0; i < ctx->n_pairs; i++) {
-        ctx->wargs[i].wait_us = ctx->wait_us;
-        if (pthread_create(&ctx->threads[i], NULL, l2c_occ_worker, &ctx->wargs[i])) {
-            ctx->n_pairs = i;
-            break;
-        }
+    if (!ctx->pool.threads) {
+        if (l2c_occ_pool_start(&ctx->pool, ctx->wargs, ctx->n_pairs))
+            return false;
+        ctx->n_pairs = ctx->pool.n_pairs;
     }
 
     for (u32 i = 0; i < ctx->n_pairs; i++)
-        pthread_join(ctx->threads[i], NULL);
+        ctx->wargs[i].wait_us = ctx->wait_us;
+    l2c_occ_pool_run(&ctx->pool);
 
     for (u32 c = 0; c < ctx->n_colors; c++) {
         f64 total = (f64)ctx->n_ways * ctx->color_counts[c];
@@ -204,6 +199,17 @@ static void update_ewma(scan_ctx_t *ctx, f64 *rates)
     }
 }
 
+// colors without evsets are published as not valid
+static void publish_hotness(scan_ctx_t *ctx, f64 *rates)
+{
+    bool valid[TELEM_MAX_ENTRIES];
+    for (u32 c = 0; c < ctx->n_colors && c < TELEM_MAX_ENTRIES; c++)
+        valid[c] = ctx->color_counts[c] > 0;
+    WaitStats ws = wait_stats_take();
+    telem_note_waits(ws.n, ws.sum_ns, ws.max_ns);
+    telem_publish(TELEM_COLOR, ctx->n_colors, NULL, rates, ctx->ewma, valid, ctx->wait_us);
+}
+
 static void print_hotness(scan_ctx_t *ctx, u32 *host_colors)
 {
     for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -234,6 +240,9 @@ i32 main(i32 argc, char* argv[])
     bool fraction_mode = false;
     bool freq_mode = false;
     bool freq_plot = false;
+    bool tune_mode = false;
+    u32 tune_trials = 50;
+    const char *telem_path = NULL;
     bool u_provided = false, f_provided = false, o_provided = false;
     u32 scan_wait_us = 7000;
     i32 t_arg = -1;
@@ -265,6 +274,14 @@ i32 main(i32 argc, char* argv[])
         {"fix-wait", no_argument, 0, 0},
         {"alpha-rise", required_argument, 0, 1},
         {"alpha-fall", required_argument, 0, 2},
+        {"timer", required_argument, 0, 0},
+        {"filter", required_argument, 0, 0},
+        {"tune-prime", no_argument, 0, 0},
+        {"tune-trials", required_argument, 0, 0},
+        {"telemetry", optional_argument, 0, 0},
+        {"pipeline", required_argument, 0, 0},
+        {"probe", required_argument, 0, 0},
+        {"layout", required_argument, 0, 0},
         {0, 0, 0, 0}
     };
 
@@ -426,6 +443,50 @@ i32 main(i32 argc, char* argv[])
                     fraction_mode = true;
                 } else if (strcmp(long_options[option_index].name, "fix-wait") == 0) {
                     fix_wait = true;
+                } else if (strcmp(long_options[option_index].name, "timer") == 0) {
+                    i32 src = timer_src_parse(optarg);
+                    if (src < 0) {
+                        fprintf(stderr, ERR "unknown --timer %s (tsc, pmc, thread or auto)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.timer_src = (u32)src;
+                } else if (strcmp(long_options[option_index].name, "filter") == 0) {
+                    i32 batch = filter_batch_parse(optarg);
+                    if (batch < 0) {
+                        fprintf(stderr, ERR "unknown --filter %s (auto, seq or a batch size)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    g_config.filter_batch = (u32)batch;
+                } else if (strcmp(long_options[option_index].name, "tune-prime") == 0) {
+                    tune_mode = true;
+                } else if (strcmp(long_options[option_index].name, "tune-trials") == 0) {
+                    i32 parsed = atoi(optarg);
+                    if (parsed <= 0) {
+                        fprintf(stderr, ERR "--tune-trials must be greater than 0\n");
+                        return EXIT_FAILURE;
+                    }
+                    tune_trials = (u32)parsed;
+                } else if (strcmp(long_options[option_index].name, "telemetry") == 0) {
+                    telem_path = optarg ? optarg : TELEM_DEF_PATH;
+                } else if (strcmp(long_options[option_index].name, "pipeline") == 0) {
+                    i32 parsed = atoi(optarg);
+                    if (parsed < 0) {
+                        fprintf(stderr, ERR "--pipeline cannot be negative\n");
+                        return EXIT_FAILURE;
+                    }
+                    pipeline_groups = (u32)parsed;
+                } else if (strcmp(long_options[option_index].name, "probe") == 0) {
+                    if (strcmp(optarg, "group") && strcmp(optarg, "line")) {
+                        fprintf(stderr, ERR "unknown --probe %s (line or group)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    probe_group = !strcmp(optarg, "group");
+                } else if (strcmp(long_options[option_index].name, "layout") == 0) {
+                    if (strcmp(optarg, "chain") && strcmp(optarg, "array")) {
+                        fprintf(stderr, ERR "unknown --layout %s (array or chain)\n", optarg);
+                        return EXIT_FAILURE;
+                    }
+                    layout_chain = !strcmp(optarg, "chain");
                 }
                 break;
             default:
@@ -482,7 +543,7 @@ i32 main(i32 argc, char* argv[])
     }
 
     if (!live_mode && !perf_mode && !fraction_mode && !graph_mode &&
-        !remap && !lcas_mode && !freq_mode) {
+        !remap && !lcas_mode && !freq_mode && !tune_mode) {
         return print_usage_vset(argv[0]);
     }
 
@@ -533,6 +594,19 @@ i32 main(i32 argc, char* argv[])
 
     print_cache_lats();
 
+    if (tune_mode) {
+        result = tune_prime_pattern(tune_trials);
+        end_full = time_us();
+        printf(INFO "Program completed | %.3fs\n", (end_full - start_full) / 1e6);
+        return result;
+    }
+
+    if (!prime_profile_load(PRIME_PROFILE_PATH, &g_prime)) {
+        char desc[96];
+        prime_pattern_str(&g_prime, desc, sizeof(desc));
+        printf(INFO "Prime pattern from %s: %s\n", PRIME_PROFILE_PATH, desc);
+    }
+
     if (remap) {
         u32 n_remap = check_mem_remap_cheat();
         if (n_remap < 0) { // err
@@ -556,6 +630,9 @@ i32 main(i32 argc, char* argv[])
         return EXIT_SUCCESS;
     }
 
+    if (telem_path && (live_mode || lcas_mode) && telem_open(telem_path))
+        return EXIT_FAILURE;
+
     if (live_mode) {
         u32 n_colors = g_config.num_l2_sets ? g_config.num_l2_sets : g_n_uncertain_l2_sets;
         scan_ctx_t ctx;
@@ -596,6 +673,7 @@ i32 main(i32 argc, char* argv[])
         scan_iteration(&ctx, rates);
         for (u32 c = 0; c < ctx.n_colors; c++)
             ctx.ewma[c] = rates[c];
+        publish_hotness(&ctx, rates);
         printf("LLC color hotness\n");
         printf("Wait: %u ms\n", ctx.wait_us / 1000);
         print_hotness(&ctx, host_colors);
@@ -605,6 +683,7 @@ i32 main(i32 argc, char* argv[])
         while (1) {
             scan_iteration(&ctx, rates);
             update_ewma(&ctx, rates);
+            publish_hotness(&ctx, rates);
             u32 n_colors_hot = 0;
             u32 n_colors_cold = 0;
             for (u32 c = 0; c < ctx.n_colors; c++)
@@ -636,6 +715,7 @@ i32 main(i32 argc, char* argv[])
             printf("\33[2K\rWait: %u ms\n", ctx.wait_us / 1000);
             print_hotness(&ctx, host_colors);
             fflush(stdout);
+            tb_check();
             usleep(scan_period_ms * 1000);
         }
 
@@ -680,21 +760,13 @@ i32 main(i32 argc, char* argv[])
         rate_cycles = monitor_l3_activity_freq(freq_plot);
     }
 
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-
     if (debug > 0) {
         stop_debug_mod();
     }
 
     if (rate_cycles > 0) {
-        if (cpu_freq_hz == 0) {
-            printf(WRN "Couldn't retrieve CPU freq. Using retrieved cycles directly.\n");
-            printf("LLC access rate: %u cycles\n", rate_cycles);
-        } else {
-            f64 rate_us = (f64)rate_cycles / ((f64)cpu_freq_hz / 1000000.0);
-            printf(SUC "Access rate to LLC: %.3f microseconds (CPU @ %.2f GHz)\n",
-                   rate_us, (f64)cpu_freq_hz / 1000000000.0);
-        }
+        printf(SUC "Access rate to LLC: %.3f microseconds (TSC @ %.2f GHz)\n",
+               tb_cyc_to_ns(rate_cycles) / 1000.0, g_tb.hz / 1e9);
     }
 
     end_full = time_us();
@@ -8,6 +8,8 @@
 #include "../include/config.h"
 #include "../include/evset.h"
 #include "../include/evset_para.h"
+#include "../include/prime.h"
+#include "../include/telemetry.h"
 #include "../vm_tools/gpa_hpa.h"
 #include "../vm_tools/vtop.h"
 #include <fcntl.h>
@@ -26,6 +28,8 @@
 #define LCAS_MAP_PATH "/sys/fs/bpf/lcas_dom_order"
 #define LCAS_MAX_SOCKETS 16
 #define PERF_PP_ITERS 10
+#define GRP_CALIB_REPS 31
+#define PIPE_STALE_PCT 25 // a window carried over may overrun wait_us by this much
 #define HI_CGROUP_PROCS "/sys/fs/cgroup/hi_prgroup/cgroup.procs"
 
 bool lcas_mode = false;
@@ -39,6 +43,9 @@ u64 retry = 3;
 u64 wait_time_us = 7000; // default wait time in microseconds
 u64 og_wait_time_us = 7000; // for the case of expanding, we need to save this val to jump back to it
 bool fix_wait = false;
+bool probe_group = false; // --probe group
+bool layout_chain = false; // --layout chain
+u32 pipeline_groups = 0; // evset groups staggered per pair in l2c_occ scans, 0: off
 u32 heatmap_time_step_us = DEFAULT_HEATMAP_TIME_STEP_US;
 u32 heatmap_max_time_us = DEFAULT_HEATMAP_MAX_TIME_US;
 
@@ -171,104 +178,496 @@ i32 check_cgroup_hi_ready(void)
 static u32 monitor_l3_occupancy_heatmap_impl(i32 main_vcpu, i32 helper_vcpu,
                                              i32 socket_id, EvSet ****prebuilt);
 
-void *l2c_occ_worker(void *arg)
+/*
+  pipelined scans (--pipeline): the pair's evsets are split into groups that
+  are primed and probed on their own clocks, so one group is primed or probed
+  while the others wait. groups stay primed between scans
+*/
+typedef struct l2c_pipe {
+    EvSet **sets;   // the pair's evsets, color by color
+    u32 *colors;    // color of each
+    u32 n_sets,
+        n_groups;
+    u64 *primed;    // tsc at the end of a group's prime, 0: not primed
+    bool *done;     // probed in this scan
+} l2c_pipe;
+
+static void l2c_pipe_free(l2c_occ_worker_arg *w)
 {
-    l2c_occ_worker_arg *w = arg;
+    l2c_pipe *p = w->pipe;
+    if (!p)
+        return;
+    free(p->sets);
+    free(p->colors);
+    free(p->primed);
+    free(p->done);
+    free(p);
+    w->pipe = NULL;
+}
 
+static void l2c_pipe_setup(l2c_occ_worker_arg *w)
+{
+    u32 n_sets = 0;
+    for (u32 idx = 0; idx < w->num_colors; idx++)
+        n_sets += w->color_counts[w->start_color + idx];
+    if (!n_sets)
+        return;
+
+    l2c_pipe *p = _calloc(1, sizeof(*p));
+    w->pipe = p;
+    if (p) {
+        p->n_groups = _min(pipeline_groups, n_sets);
+        p->sets = _calloc(n_sets, sizeof(*p->sets));
+        p->colors = _calloc(n_sets, sizeof(*p->colors));
+        p->primed = _calloc(p->n_groups, sizeof(*p->primed));
+        p->done = _calloc(p->n_groups, sizeof(*p->done));
+    }
+    if (!p || !p->sets || !p->colors || !p->primed || !p->done) {
+        fprintf(stderr, WRN "thread pair %u: no memory to pipeline, scanning in one pass\n",
+                w->tid);
+        l2c_pipe_free(w);
+        return;
+    }
+
+    for (u32 idx = 0; idx < w->num_colors; idx++) {
+        u32 color = w->start_color + idx;
+        for (u32 s = 0; s < w->color_counts[color]; s++) {
+            p->sets[p->n_sets] = w->color_sets[color][s];
+            p->colors[p->n_sets++] = color;
+        }
+    }
+}
+
+static void l2c_occ_setup(l2c_occ_worker_arg *w, helper_thread_ctrl *hctrl)
+{
     set_cpu_affinity(w->core_main);
-    helper_thread_ctrl hctrl = {0};
-    start_helper_thread_pinned(&hctrl, w->core_helper);
+    start_helper_thread_pinned(hctrl, w->core_helper);
+    w->hctrl = hctrl;
 
     /* attach this helper thread to all eviction sets this worker will
        operate on */
     attach_helper_to_evsets(w->color_sets, w->color_counts, w->start_color,
-                            w->num_colors, &hctrl);
+                            w->num_colors, hctrl);
+    u32 n_loose = compact_color_evsets(w->color_sets, w->color_counts,
+                                       w->start_color, w->num_colors);
+    if (n_loose && verbose > 1)
+        printf(V2 "thread pair %u: %u evsets kept as pointer arrays\n", w->tid, n_loose);
+    if (layout_chain)
+        chain_color_evsets(w->color_sets, w->color_counts, w->start_color, w->num_colors);
+
+    if (pipeline_groups > 1)
+        l2c_pipe_setup(w);
+}
 
-    for (u32 it = 0; it < w->iterations; it++) {
-        u64 prime_begin_tsc = _rdtsc();
-
-        /* prime all colors up front */
-        for (u32 idx = 0; idx < w->num_colors; idx++) {
-            u32 color = w->start_color + idx;
-            u32 set_cnt = w->color_counts[color];
-            for (u32 s = 0; s < set_cnt; s++) {
-                EvSet *ev = w->color_sets[color][s];
-                flush_array(ev->addrs, ev->size);
-                _lfence();
-                l3_evset_prime(ev, g_lats.l3_thresh);
-                _lfence();
-            }
+// undoes l2c_occ_setup, the evsets get their pointer arrays back
+static void l2c_occ_teardown(l2c_occ_worker_arg *w, helper_thread_ctrl *hctrl)
+{
+    stop_helper_thread(hctrl);
+    if (expand_color_evsets(w->color_sets, w->color_counts, w->start_color, w->num_colors))
+        fprintf(stderr, ERR "thread pair %u: failed to restore evset addresses\n", w->tid);
+    l2c_pipe_free(w);
+}
+
+static void l2c_prime_evset(EvSet *ev)
+{
+    if (ev->idx.count == ev->size)
+        flush_idx(ev->idx.base, ev->idx.idxs, ev->size);
+    else
+        flush_array(ev->addrs, ev->size);
+    _lfence();
+    l3_evset_prime(ev, l3_prime_thresh(ev));
+    _lfence();
+}
+
+// lines of @p ev evicted since its prime, timed one by one
+static u32 l2c_probe_lines(EvSet *ev)
+{
+    u32 n_evicted = 0;
+    bool compact = ev->idx.count == ev->size;
+
+    /*
+      indexed, not walked along ev->chain: reading a link before the line is
+      timed would pull it in and every probe would read as a hit
+    */
+    for (i32 j = ev->size - 1; j >= 0; j--) {
+        bool valid = false;
+        u64 lat = 0;
+        u8 *line = compact ? evidx_at(&ev->idx, j) : ev->addrs[j];
+
+        for (u32 r = 0; r < 3 && !valid; r++) {
+            u32 a1, a2;
+            _rdtscp_aux(&a1);
+            _lfence();
+            lat = _time_maccess(line);
+            _rdtscp_aux(&a2);
+            if (a1 == a2 && lat < g_lats.interrupt_thresh)
+                valid = true;
         }
 
-        u64 prime_end_tsc = _rdtsc();
-        u64 prime_cycles = prime_end_tsc - prime_begin_tsc;
-        if (w->prime_times)
-            w->prime_times[it] = prime_cycles / w->cycles_per_us;
-
-        /* wait for remaining portion of the configured delay */
-        if (w->wait_us > 0) {
-            u32 prime_time_us = prime_cycles / w->cycles_per_us;
-            if (w->wait_us > prime_time_us) {
-                u64 remaining_cycles =
-                    (u64)(w->wait_us - prime_time_us) * w->cycles_per_us;
-                u64 end_tsc = _rdtsc() + remaining_cycles;
-                while (_rdtsc() < end_tsc)
-                    ;
-            }
+        if (lat >= g_lats.l3_thresh)
+            n_evicted++;
+    }
+    return n_evicted;
+}
+
+// one timed walk over the whole of @p ev, backwards as l2c_probe_lines
+static u64 grp_time(EvSet *ev)
+{
+    if (ev->chain)
+        return time_chase(ev->chain, ev->size, true);
+    u64 start = lat_start();
+    if (ev->idx.count == ev->size)
+        access_idx_bwd(ev->idx.base, ev->idx.idxs, ev->size);
+    else
+        access_array_bwd(ev->addrs, ev->size);
+    return lat_since(start);
+}
+
+/*
+  group latency of the untouched set against one with a line flushed after
+  the prime, as calibrate_grp_access_lat does with a target access. leaves
+  ev->grp.thresh at 0, i.e. per-line probes, if the two do not separate
+*/
+static bool grp_calibrate(EvSet *ev)
+{
+    i32 quiet[GRP_CALIB_REPS], one[GRP_CALIB_REPS];
+    for (u32 r = 0; r < GRP_CALIB_REPS; r++) {
+        l2c_prime_evset(ev);
+        quiet[r] = grp_time(ev);
+
+        l2c_prime_evset(ev);
+        _clflush(evset_at(ev, r % ev->size));
+        _mfence();
+        one[r] = grp_time(ev);
+    }
+
+    i32 base = calc_median(quiet, GRP_CALIB_REPS),
+        evicted = calc_median(one, GRP_CALIB_REPS),
+        thresh = (base + evicted) / 2;
+    u32 otc = 0, utc = 0;
+    for (u32 r = 0; r < GRP_CALIB_REPS; r++) {
+        otc += quiet[r] >= thresh;
+        utc += one[r] < thresh;
+    }
+
+    ev->grp = (EvGrpProbe){0};
+    if (evicted <= base || otc > GRP_CALIB_REPS * 0.05 || utc > GRP_CALIB_REPS * 0.05)
+        return true;
+
+    ev->grp.thresh = thresh;
+    ev->grp.base = base;
+    ev->grp.miss = evicted - base;
+    return false;
+}
+
+/*
+  lines of @p ev evicted since its prime. with --probe group, a set that was
+  quiet is timed as a whole: below its threshold nothing was evicted, above
+  it the count is estimated from the latency and the set goes back to
+  per-line probes, which give exact counts, until it reads quiet again
+*/
+static u32 l2c_probe_evset(EvSet *ev)
+{
+    EvGrpProbe *g = &ev->grp;
+    if (!probe_group || !g->thresh || g->exact) {
+        u32 n_evicted = l2c_probe_lines(ev);
+        g->exact = g->thresh && n_evicted;
+        return n_evicted;
+    }
+
+    u64 lat = grp_time(ev);
+    if (lat < g->thresh)
+        return 0;
+
+    g->exact = true;
+    u64 n_evicted = (lat - g->base + g->miss / 2) / g->miss;
+    return _max(1, _min(n_evicted, ev->size));
+}
+
+// group probe thresholds of the pair's evsets, once per evset
+static void l2c_grp_setup(l2c_occ_worker_arg *w)
+{
+    u32 n_sets = 0, n_line = 0;
+    for (u32 idx = 0; idx < w->num_colors; idx++) {
+        u32 color = w->start_color + idx;
+        for (u32 s = 0; s < w->color_counts[color]; s++) {
+            EvSet *ev = w->color_sets[color][s];
+            if (!ev || !ev->size || ev->grp.thresh)
+                continue;
+            n_sets++;
+            n_line += grp_calibrate(ev);
+        }
+    }
+
+    if (verbose > 1)
+        printf(V2 "thread pair %u: %u/%u evsets probed as a group\n", w->tid,
+               n_sets - n_line, n_sets);
+}
+
+// prime+probe of all the worker's colors, results in tot_avg[color][it]
+static void l2c_occ_scan(l2c_occ_worker_arg *w, u32 it)
+{
+    u64 prime_begin_tsc = _rdtsc();
+
+    /* prime all colors up front */
+    for (u32 idx = 0; idx < w->num_colors; idx++) {
+        u32 color = w->start_color + idx;
+        u32 set_cnt = w->color_counts[color];
+        for (u32 s = 0; s < set_cnt; s++)
+            l2c_prime_evset(w->color_sets[color][s]);
+    }
+
+    u64 prime_end_tsc = _rdtsc();
+    u64 prime_cycles = prime_end_tsc - prime_begin_tsc;
+    if (w->prime_times)
+        w->prime_times[it] = tb_cyc_to_us(prime_cycles);
+
+    /* wait for remaining portion of the configured delay */
+    if (w->wait_us > 0) {
+        u32 prime_time_us = tb_cyc_to_us(prime_cycles);
+        if (w->wait_us > prime_time_us) {
+            u64 remaining_cycles = tb_us_to_cyc(w->wait_us - prime_time_us);
+            u64 end_tsc = _rdtsc() + remaining_cycles;
+            helper_thread_park(w->hctrl, end_tsc);
+            wait_until_tsc(end_tsc);
         }
+    }
+
+    u64 total_probe_cycles = 0;
+    for (u32 idx = 0; idx < w->num_colors; idx++) {
+        u32 color = w->start_color + idx;
+        u32 set_cnt = w->color_counts[color];
+        if (set_cnt == 0)
+            continue;
+
+        u64 probe_start = _rdtsc();
+        u32 total_evictions = 0;
+        for (u32 s = 0; s < set_cnt; s++)
+            total_evictions += l2c_probe_evset(w->color_sets[color][s]);
+        u64 probe_end = _rdtsc();
+        total_probe_cycles += probe_end - probe_start;
+
+        w->tot_avg[color][it] = (f64)total_evictions;
+    }
+
+    if (w->probe_times)
+        w->probe_times[it] = tb_cyc_to_us(total_probe_cycles);
+}
 
-        u64 total_probe_cycles = 0;
-        for (u32 idx = 0; idx < w->num_colors; idx++) {
-            u32 color = w->start_color + idx;
-            u32 set_cnt = w->color_counts[color];
-            if (set_cnt == 0)
+static u64 l2c_pipe_prime(l2c_pipe *p, u32 g)
+{
+    u32 first = (u64)g * p->n_sets / p->n_groups,
+        last = (u64)(g + 1) * p->n_sets / p->n_groups;
+    u64 start = _rdtsc();
+    for (u32 i = first; i < last; i++)
+        l2c_prime_evset(p->sets[i]);
+    p->primed[g] = _rdtsc();
+    return p->primed[g] - start;
+}
+
+/*
+  l2c_occ_scan with the groups staggered: the oldest group is probed as soon
+  as its window reaches wait_us and primed again right away, groups without
+  a window are primed in between. a window left over from the last scan is
+  reused unless it ran PIPE_STALE_PCT past wait_us
+*/
+static void l2c_occ_scan_pipelined(l2c_occ_worker_arg *w, u32 it)
+{
+    l2c_pipe *p = w->pipe;
+    u64 wait = tb_us_to_cyc(w->wait_us),
+        stale = wait + wait * PIPE_STALE_PCT / 100;
+    u64 prime_cycles = 0, probe_cycles = 0;
+    u32 n_left = p->n_groups;
+
+    for (u32 idx = 0; idx < w->num_colors; idx++)
+        w->tot_avg[w->start_color + idx][it] = 0;
+
+    u64 now = _rdtsc();
+    for (u32 g = 0; g < p->n_groups; g++) {
+        p->done[g] = false;
+        if (p->primed[g] && now - p->primed[g] > stale)
+            p->primed[g] = 0;
+    }
+
+    while (n_left) {
+        u32 oldest = p->n_groups, unprimed = p->n_groups;
+        for (u32 g = 0; g < p->n_groups; g++) {
+            if (p->done[g])
                 continue;
+            if (!p->primed[g])
+                unprimed = g;
+            else if (oldest == p->n_groups || p->primed[g] < p->primed[oldest])
+                oldest = g;
+        }
 
-            u64 probe_start = _rdtsc();
-            u32 total_evictions = 0;
-            for (u32 s = 0; s < set_cnt; s++) {
-                EvSet *ev = w->color_sets[color][s];
-
-                for (i32 j = ev->size - 1; j >= 0; j--) {
-                    bool valid = false;
-                    u64 lat = 0;
-
-                    for (u32 r = 0; r < 3 && !valid; r++) {
-                        u32 a1, a2;
-                        _rdtscp_aux(&a1);
-                        _lfence();
-                        lat = _time_maccess(ev->addrs[j]);
-                        _rdtscp_aux(&a2);
-                        if (a1 == a2 && lat < g_lats.interrupt_thresh)
-                            valid = true;
-                    }
+        if (oldest < p->n_groups && _rdtsc() - p->primed[oldest] >= wait) {
+            u32 first = (u64)oldest * p->n_sets / p->n_groups,
+                last = (u64)(oldest + 1) * p->n_sets / p->n_groups;
+            u64 start = _rdtsc();
+            for (u32 i = first; i < last; i++)
+                w->tot_avg[p->colors[i]][it] += l2c_probe_evset(p->sets[i]);
+            probe_cycles += _rdtsc() - start;
+
+            p->done[oldest] = true;
+            n_left--;
+            prime_cycles += l2c_pipe_prime(p, oldest); // the next scan's window
+        } else if (unprimed < p->n_groups) {
+            prime_cycles += l2c_pipe_prime(p, unprimed);
+        } else {
+            // every group waits, sleep until the oldest is due
+            helper_thread_park(w->hctrl, p->primed[oldest] + wait);
+            wait_until_tsc(p->primed[oldest] + wait);
+        }
+    }
 
-                    if (lat >= g_lats.l3_thresh)
-                        total_evictions++;
-                }
-            }
-            u64 probe_end = _rdtsc();
-            total_probe_cycles += probe_end - probe_start;
+    if (w->prime_times)
+        w->prime_times[it] = tb_cyc_to_us(prime_cycles);
+    if (w->probe_times)
+        w->probe_times[it] = tb_cyc_to_us(probe_cycles);
+}
 
-            w->tot_avg[color][it] = (f64)total_evictions;
+static void l2c_occ_iterations(l2c_occ_worker_arg *w)
+{
+    for (u32 it = 0; it < w->iterations; it++) {
+        if (w->pipe)
+            l2c_occ_scan_pipelined(w, it);
+        else
+            l2c_occ_scan(w, it);
+
+        if (scan_period_ms && it + 1 < w->iterations) {
+            // the helper sleeps through the period too, not just the window
+            u64 end_tsc = _rdtsc() + tb_ms_to_cyc(scan_period_ms);
+            helper_thread_park(w->hctrl, end_tsc);
+            wait_until_tsc(end_tsc);
         }
+    }
+}
+
+void *l2c_occ_worker(void *arg)
+{
+    l2c_occ_worker_arg *w = arg;
+    helper_thread_ctrl hctrl = {0};
+
+    l2c_occ_setup(w, &hctrl);
+    if (probe_group)
+        l2c_grp_setup(w);
+    l2c_occ_iterations(w);
+    l2c_occ_teardown(w, &hctrl);
+    return NULL;
+}
+
+typedef struct {
+    l2c_occ_pool *pool;
+    u32 idx;
+} l2c_pool_arg;
+
+static void *l2c_pool_worker(void *arg)
+{
+    l2c_pool_arg *a = arg;
+    l2c_occ_pool *pool = a->pool;
+    l2c_occ_worker_arg *w = &pool->wargs[a->idx];
+    helper_thread_ctrl hctrl = {0};
+    u64 gen = 0;
 
-        if (w->probe_times)
-            w->probe_times[it] = total_probe_cycles / w->cycles_per_us;
+    l2c_occ_setup(w, &hctrl);
+    if (probe_group)
+        l2c_grp_setup(w);
 
-        if (scan_period_ms && it + 1 < w->iterations)
-            usleep(scan_period_ms * 1000);
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->gen == gen && !pool->stop)
+            pthread_cond_wait(&pool->go, &pool->lock);
+        if (pool->stop)
+            break;
+        gen = pool->gen;
+        pthread_mutex_unlock(&pool->lock);
+
+        l2c_occ_iterations(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->n_done == pool->n_pairs)
+            pthread_cond_signal(&pool->done);
     }
+    pthread_mutex_unlock(&pool->lock);
 
-    stop_helper_thread(&hctrl);
+    l2c_occ_teardown(w, &hctrl);
     return NULL;
 }
 
+bool l2c_occ_pool_start(l2c_occ_pool *pool, l2c_occ_worker_arg *wargs, u32 n_pairs)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->wargs = wargs;
+    pool->threads = _calloc(n_pairs, sizeof(pthread_t));
+    pool->args = _calloc(n_pairs, sizeof(l2c_pool_arg));
+    if (!pool->threads || !pool->args) {
+        fprintf(stderr, ERR "failed to allocate worker pool\n");
+        free(pool->threads);
+        free(pool->args);
+        pool->threads = NULL;
+        return true;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->go, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    l2c_pool_arg *args = pool->args;
+    for (u32 i = 0; i < n_pairs; i++) {
+        args[i].pool = pool;
+        args[i].idx = i;
+        if (pthread_create(&pool->threads[i], NULL, l2c_pool_worker, &args[i])) {
+            fprintf(stderr, WRN "failed to create worker %u, using %u pairs\n", i, i);
+            break;
+        }
+        pool->n_pairs++;
+    }
+
+    if (!pool->n_pairs) {
+        l2c_occ_pool_stop(pool);
+        return true;
+    }
+    return false;
+}
+
+void l2c_occ_pool_run(l2c_occ_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->n_done = 0;
+    pool->gen++;
+    pthread_cond_broadcast(&pool->go);
+    while (pool->n_done < pool->n_pairs)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void l2c_occ_pool_stop(l2c_occ_pool *pool)
+{
+    if (!pool->threads)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (u32 i = 0; i < pool->n_pairs; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->go);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->args);
+    pool->threads = NULL;
+    pool->args = NULL;
+    pool->n_pairs = 0;
+}
+
 typedef struct {
     EvSet **sets;
     u32 set_cnt;
     u32 wait_us;
-    u64 cycles_per_us;
     u32 retries;
     u32 n_ways;
     u32 *counts;
@@ -292,6 +691,8 @@ static void *heatmap_worker(void *arg)
             if (ev->build_conf->lower_ev &&
                 ev->build_conf->lower_ev->build_conf)
                 ev->build_conf->lower_ev->build_conf->hctrl = &hctrl;
+            if (probe_group && !ev->grp.thresh)
+                grp_calibrate(ev);
         }
     }
 
@@ -300,34 +701,41 @@ static void *heatmap_worker(void *arg)
         EvSet *ev = w->sets[s];
         flush_array(ev->addrs, ev->size);
         _lfence();
-        l3_evset_prime(ev, g_lats.l3_thresh);
+        l3_evset_prime(ev, l3_prime_thresh(ev));
         _lfence();
     }
     u64 prime_cycles = _rdtsc() - prime_begin;
 
     if (w->wait_us > 0) {
-        u32 prime_us = prime_cycles / w->cycles_per_us;
-        if (w->wait_us > prime_us)
-            usleep(w->wait_us - prime_us);
+        u32 prime_us = tb_cyc_to_us(prime_cycles);
+        if (w->wait_us > prime_us) {
+            u64 end_tsc = prime_begin + tb_us_to_cyc(w->wait_us);
+            helper_thread_park(&hctrl, end_tsc);
+            wait_until_tsc(end_tsc);
+        }
     }
 
     for (u32 s = 0; s < w->set_cnt; s++) {
         EvSet *ev = w->sets[s];
         u32 n_evicted = 0;
-        for (i32 j = ev->size - 1; j >= 0; j--) {
-            bool valid = false;
-            u64 lat = 0;
-            for (u32 r = 0; r < w->retries && !valid; r++) {
-                u32 a1, a2;
-                _rdtscp_aux(&a1);
-                _lfence();
-                lat = _time_maccess(ev->addrs[j]);
-                _rdtscp_aux(&a2);
-                if (a1 == a2)
-                    valid = true;
+        if (probe_group) {
+            n_evicted = l2c_probe_evset(ev);
+        } else {
+            for (i32 j = ev->size - 1; j >= 0; j--) {
+                bool valid = false;
+                u64 lat = 0;
+                for (u32 r = 0; r < w->retries && !valid; r++) {
+                    u32 a1, a2;
+                    _rdtscp_aux(&a1);
+                    _lfence();
+                    lat = _time_maccess(ev->addrs[j]);
+                    _rdtscp_aux(&a2);
+                    if (a1 == a2)
+                        valid = true;
+                }
+                if (lat >= g_lats.l3_thresh)
+                    n_evicted++;
             }
-            if (lat >= g_lats.l3_thresh)
-                n_evicted++;
         }
 
         if (n_evicted <= w->n_ways) {
@@ -342,14 +750,8 @@ static void *heatmap_worker(void *arg)
 
 void write_eviction_freq_data(u32 *cycle_diffs, u64 n_samples, bool plot)
 {
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    if (cpu_freq_hz == 0) {
-        fprintf(stderr, ERR "failed to get cpu freq for graph generation\n");
-        return;
-    }
-    
     // configurable time limit in cycles
-    u64 time_limit_cycles = (cpu_freq_hz * GRAPH_TIME_LIMIT_MS) / 1000;
+    u64 time_limit_cycles = tb_ms_to_cyc(GRAPH_TIME_LIMIT_MS);
     
     // calculate optimal batch size to achieve target data points
     u32 batch_size = time_limit_cycles / GRAPH_MAX_DATA_POINTS;
@@ -368,7 +770,7 @@ void write_eviction_freq_data(u32 *cycle_diffs, u64 n_samples, bool plot)
     }
     
     // convert actual timeline to milliseconds
-    f64 actual_timeline_ms = (f64)actual_timeline_cycles / ((f64)cpu_freq_hz / 1000.0);
+    f64 actual_timeline_ms = tb_cyc_to_ns(actual_timeline_cycles) / 1e6;
     
     // filename w/ current date/time
     time_t now = time(NULL);
@@ -393,7 +795,7 @@ void write_eviction_freq_data(u32 *cycle_diffs, u64 n_samples, bool plot)
     fprintf(fp, "%04d-%02d-%02d %02d:%02d:%02d\n",
             tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec);
-    fprintf(fp, "# cpu freq: %.2f ghz\n", (f64)cpu_freq_hz / 1000000000.0);
+    fprintf(fp, "# tsc freq: %.2f ghz (%s)\n", g_tb.hz / 1e9, tb_src_name(g_tb.src));
     fprintf(fp, "# configured time limit: %d ms\n", GRAPH_TIME_LIMIT_MS);
     fprintf(fp, "# actual timeline: %.3f ms\n", actual_timeline_ms);
     fprintf(fp, "# target data points: %d\n", GRAPH_MAX_DATA_POINTS);
@@ -424,7 +826,7 @@ void write_eviction_freq_data(u32 *cycle_diffs, u64 n_samples, bool plot)
     // write data points; each batch gets one data point
     u32 actual_batches = 0;
     for (u32 batch = 0; batch < max_batches; batch++) {
-        f64 time_ms = (f64)(batch * batch_size) / ((f64)cpu_freq_hz / 1000.0);
+        f64 time_ms = tb_cyc_to_ns((u64)batch * batch_size) / 1e6;
         
         // stop if we exceed actual timeline
         if (time_ms > actual_timeline_ms) break;
@@ -476,7 +878,7 @@ u32 monitor_l3_occupancy(void)
     flush_array(l3ev->addrs, l3ev->size);
     u32 s = _rdtsc();
     _mfence();
-    l3_evset_prime(l3ev, g_lats.l3_thresh);
+    l3_evset_prime(l3ev, l3_prime_thresh(l3ev));
     _mfence();
     u32 e = _rdtsc();
     if (verbose) 
@@ -494,7 +896,7 @@ u32 monitor_l3_occupancy(void)
     if (verbose)
         printf(V1 "wait completed; probing individual array method\n");
     
-    u64 arr_start = timer_start();
+    u64 arr_start = lat_start();
     
     // bwd for thrashing prevention
     for (i32 i = l3ev->size - 1; i >= 0; i--) {
@@ -522,8 +924,7 @@ u32 monitor_l3_occupancy(void)
         }
     }
     
-    u64 arr_end = timer_stop();
-    u64 arr_probe_time = arr_end - arr_start;
+    u64 arr_probe_time = lat_since(arr_start);
     
     f64 ratio = (f64)n_evicted / (f64)l3ev->size;
     printf(SUC "array individual: %u/%u lines evicted (%.1f%%) | %lu cycles\n", 
@@ -544,23 +945,60 @@ cleanup:
     return n_evicted;
 }
 
+u64 l3_prime_thresh(EvSet *evset)
+{
+    if (!evset->chain)
+        return g_lats.l3_thresh;
+    // the chase serializes the loads: all but one line at the L3 latency,
+    // so a single line from DRAM crosses it
+    return (evset->size - 1) * g_lats.l3 + g_lats.l3_thresh;
+}
+
 void l3_evset_prime(EvSet *evset, u64 threshold)
 {
     addrs_traverse(evset->build_conf->lower_ev->addrs, 
                    evset->build_conf->lower_ev->size,
                    evset->build_conf->lower_ev->build_conf);
     _lfence();
-    for (u32 i = 0; i < 10; i++) {
-        traverse_cands_mt(evset->addrs, evset->size, evset->build_conf);
-        u64 begin = timer_start();
-        access_array(evset->addrs, evset->size);
-        u64 end = timer_stop();
-        if (end - begin < threshold) {
+    for (u32 i = 0; i < g_prime.max_passes; i++) {
+        prime_pattern_run(evset, &g_prime);
+        if (g_prime.max_passes == 1)
+            break; // tuned to prime in one pass, no need to read it back
+        u64 lat;
+        if (evset->chain) {
+            lat = time_chase(evset->chain, evset->size, false);
+        } else if (evset->idx.count == evset->size) {
+            u64 begin = lat_start();
+            access_idx(evset->idx.base, evset->idx.idxs, evset->size);
+            lat = lat_since(begin);
+        } else {
+            u64 begin = lat_start();
+            access_array(evset->addrs, evset->size);
+            lat = lat_since(begin);
+        }
+        if (lat < threshold) {
             break;
         }
     }
 }
 
+// one access to every line of @p evset, along its chain when it has one
+static ALWAYS_INLINE void grp_probe(EvSet *evset, bool bwd)
+{
+    EvIdx *idx = &evset->idx;
+    if (evset->chain)
+        (void)(bwd ? chase_bwd(evset->chain, evset->size)
+                   : chase_fwd(evset->chain, evset->size));
+    else if (idx->count == evset->size && bwd)
+        access_idx_bwd(idx->base, idx->idxs, evset->size);
+    else if (idx->count == evset->size)
+        access_idx(idx->base, idx->idxs, evset->size);
+    else if (bwd)
+        access_array_bwd(evset->addrs, evset->size);
+    else
+        access_array(evset->addrs, evset->size);
+}
+
 i64 calibrate_grp_access_lat(u8 *target, EvSet *evset, EvBuildConf *tconf)
 {
     u64 n_repeat = 500;
@@ -582,12 +1020,13 @@ i64 calibrate_grp_access_lat(u8 *target, EvSet *evset, EvBuildConf *tconf)
         _lfence();
 
         // probe
-        u64 begin = timer_start();
-        access_array_bwd(evset->addrs, evset->size);
-        u64 end = _rdtscp_aux(&aux_after);
+        u64 begin = lat_start();
+        grp_probe(evset, true);
+        u64 lat = lat_since(begin);
+        _rdtscp_aux(&aux_after);
 
         if (aux_before == aux_after) {
-            no_acc_lats[r] = end - begin;
+            no_acc_lats[r] = lat;
             r++;
         }
     }
@@ -604,12 +1043,13 @@ i64 calibrate_grp_access_lat(u8 *target, EvSet *evset, EvBuildConf *tconf)
         maccess(target);
         helper_thread_read_single(target, tconf->hctrl);
 
-        u64 begin = timer_start();
-        access_array(evset->addrs, evset->size);
-        u64 end = _rdtscp_aux(&aux_after);
+        u64 begin = lat_start();
+        grp_probe(evset, false);
+        u64 lat = lat_since(begin);
+        _rdtscp_aux(&aux_after);
 
         if (aux_before == aux_after) {
-            acc_lats[r] = end - begin;
+            acc_lats[r] = lat;
             r++;
         }
     }
@@ -666,11 +1106,12 @@ u32 monitor_socket_activity_freq(socket_monitor_ctx *ctx, bool plot)
     l3_evset_prime(ctx->l3ev, ctx->threshold);
     
     while (sz < max_num_recs) {
-        u64 begin = timer_start();
-        access_array(ctx->l3ev->addrs, ctx->l3ev->size);
-        u64 end = _rdtscp_aux(&aux);
+        u64 begin = lat_start();
+        grp_probe(ctx->l3ev, false);
+        u64 lat = lat_since(begin),
+            end = _rdtscp_aux(&aux);
         bool ctx_switch = aux != last_aux;
-        if ((end - begin) > ctx->threshold || ctx_switch) {
+        if (lat > ctx->threshold || ctx_switch) {
             if (!ctx_switch) {
                 iters[sz] = iter;
                 timestamps[sz++] = end;
@@ -715,8 +1156,6 @@ u32 monitor_socket_activity_freq(socket_monitor_ctx *ctx, bool plot)
 u32 monitor_l3_activity_freq(bool plot)
 {
     i32 ret = EXIT_SUCCESS;
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    
     u32 rate_cycles = 0;
     cpu_topology_t *topo = NULL;
     multi_socket_info_t socket_info = {0};
@@ -752,6 +1191,8 @@ u32 monitor_l3_activity_freq(bool plot)
     
     for (u32 i = 0; i <= retry; i++) {
         if (l3ev && l3ev->size <= l3_info.n_ways) {
+            if (layout_chain)
+                evset_chain(l3ev);
             threshold = calibrate_grp_access_lat(l3ev->target_addr, l3ev,
                                                  l3ev->build_conf);
             if (threshold < g_lats.l3) {
@@ -788,14 +1229,14 @@ u32 monitor_l3_activity_freq(bool plot)
 
     // temporal resolution
     u32 tr_ret = 100;
-    u64 begin = timer_start();
+    u64 begin = lat_start();
     for (size_t i = 0; i < tr_ret; i++) {
-        timer_start();
-        access_array(l3ev->addrs, l3ev->size);
-        timer_stop();
+        u64 t = lat_start();
+        grp_probe(l3ev, false);
+        (void)lat_since(t);
     }
-    u64 end = timer_stop();
-    printf(INFO "temporal resolution: %lu cycles\n", (end - begin) / tr_ret);
+    printf(INFO "temporal resolution: %lu %s ticks\n", lat_since(begin) / tr_ret,
+           timer_src_name(g_timer_src));
     
     // setup helper thread control
     helper_thread_ctrl hctrl = {0};
@@ -851,13 +1292,8 @@ u32 monitor_l3_activity_freq(bool plot)
             socket_rates[s] = monitor_socket_activity_freq(&ctx[s], plot);
             
             if (socket_rates[s] > 0) {
-                if (cpu_freq_hz != 0) {
-                    f64 rate_us = (f64)socket_rates[s] / ((f64)cpu_freq_hz / 1000000.0);
-                    printf(SUC "Access rate to Socket %d LLC: %.3f microseconds (CPU @ %.2f GHz)\n", 
-                           s, rate_us, (f64)cpu_freq_hz / 1000000000.0);
-                } else {
-                    printf(SUC "Access rate to Socket %d LLC: %u cycles\n", s, socket_rates[s]);
-                }
+                printf(SUC "Access rate to Socket %d LLC: %.3f microseconds (TSC @ %.2f GHz)\n",
+                       s, tb_cyc_to_ns(socket_rates[s]) / 1000.0, g_tb.hz / 1e9);
             } else {
                 fprintf(stderr, WRN "failed to measure activity on socket %d\n", s);
             }
@@ -1093,10 +1529,6 @@ static u32 monitor_l3_occupancy_heatmap_impl(i32 main_vcpu, i32 helper_vcpu,
     u32 n_ways = all_evsets[0]->size;
     printf(INFO "Detected L3 ways: %u\n", n_ways);
 
-    // cycles per microsecond for busy wait loop
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    u64 cycles_per_us = cpu_freq_hz ? cpu_freq_hz / 1000000ULL : 2000ULL;
-    
     u32 **eviction_counts = _calloc(n_time_slots, sizeof(u32*));
     if (!eviction_counts) {
         fprintf(stderr, ERR "failed to allocate eviction counts array\n");
@@ -1108,19 +1540,19 @@ static u32 monitor_l3_occupancy_heatmap_impl(i32 main_vcpu, i32 helper_vcpu,
     u64 tmp_start = _rdtsc();
     flush_array(all_evsets[0]->addrs, all_evsets[0]->size);
     _lfence();
-    l3_evset_prime(all_evsets[0], g_lats.l3_thresh);
+    l3_evset_prime(all_evsets[0], l3_prime_thresh(all_evsets[0]));
     _lfence();
-    u32 single_prime_us = (u32)((_rdtsc() - tmp_start) / cycles_per_us);
+    u32 single_prime_us = (u32)tb_cyc_to_us(_rdtsc() - tmp_start);
 
     // batch priming time 
     tmp_start = _rdtsc();
     for (u32 i = 0; i < total_sets; i++) {
         flush_array(all_evsets[i]->addrs, all_evsets[i]->size);
         _lfence();
-        l3_evset_prime(all_evsets[i], g_lats.l3_thresh);
+        l3_evset_prime(all_evsets[i], l3_prime_thresh(all_evsets[i]));
         _lfence();
     }
-    u32 batch_prime_us = (u32)((_rdtsc() - tmp_start) / cycles_per_us);
+    u32 batch_prime_us = (u32)tb_cyc_to_us(_rdtsc() - tmp_start);
 
     f64 estimated_wait_seconds =
         estimate_heatmap_runtime(n_time_slots, batch_prime_us, single_prime_us);
@@ -1229,7 +1661,6 @@ static u32 monitor_l3_occupancy_heatmap_impl(i32 main_vcpu, i32 helper_vcpu,
 
         for (u32 i = 0; i < n_pairs; i++) {
             wargs[i].wait_us = current_wait_us;
-            wargs[i].cycles_per_us = cycles_per_us;
             wargs[i].retries = retries;
             wargs[i].n_ways = n_ways;
             wargs[i].counts = _calloc(n_ways + 1, sizeof(u32));
@@ -1498,11 +1929,6 @@ u32 monitor_l3_occupancy_l2color(void)
         }
     }
 
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    u64 cycles_per_us = cpu_freq_hz 
-                      ? cpu_freq_hz / 1000000ULL 
-                      : 2000ULL;
-
     tot_line_ev_avg = _calloc(n_colors, sizeof(f64*));
     for (u32 c = 0; c < n_colors; c++)
         tot_line_ev_avg[c] = _calloc(iterations, sizeof(f64));
@@ -1548,7 +1974,6 @@ u32 monitor_l3_occupancy_l2color(void)
         u32 count = base + (i < extra ? 1 : 0);
 
         wargs[i].wait_us = wait_us;
-        wargs[i].cycles_per_us = cycles_per_us;
         wargs[i].iterations = iterations;
         wargs[i].color_sets = color_sets;
         wargs[i].color_counts = color_counts;
@@ -1660,8 +2085,8 @@ u32 monitor_l3_occupancy_lcas(void)
         EvSet ***color_sets;
         u32 *color_counts;
         f64 **tot_avg;
-        pthread_t *threads;
         l2c_occ_worker_arg *wargs;
+        l2c_occ_pool pool;
         u32 n_ways;
     } lcas_socket_ctx;
 
@@ -1766,9 +2191,6 @@ u32 monitor_l3_occupancy_lcas(void)
     for (u32 s = 0; s < n_sockets; s++)
         sockets[s].n_ways = n_ways;
 
-    u64 freq = get_cpu_freq_hz();
-    u64 cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     for (u32 s = 0; s < n_sockets; s++) {
         socket_info_t *si = &sinfo.sockets[s];
         u32 max_pairs = si->vcpu_count / 2;
@@ -1801,10 +2223,9 @@ u32 monitor_l3_occupancy_lcas(void)
         if (sockets[s].n_pairs > sockets[s].n_colors)
             sockets[s].n_pairs = sockets[s].n_colors;
 
-        sockets[s].threads = _calloc(sockets[s].n_pairs, sizeof(pthread_t));
         sockets[s].wargs = _calloc(sockets[s].n_pairs,
                                    sizeof(l2c_occ_worker_arg));
-        if (!sockets[s].threads || !sockets[s].wargs)
+        if (!sockets[s].wargs)
             goto cleanup;
 
         u32 base = sockets[s].n_colors / sockets[s].n_pairs;
@@ -1813,7 +2234,6 @@ u32 monitor_l3_occupancy_lcas(void)
         for (u32 p = 0; p < sockets[s].n_pairs; p++) {
             u32 cntc = base + (p < extra ? 1 : 0);
             sockets[s].wargs[p].wait_us = wait_time_us;
-            sockets[s].wargs[p].cycles_per_us = cycles_per_us;
             sockets[s].wargs[p].iterations = 1;
             sockets[s].wargs[p].color_sets = sockets[s].color_sets;
             sockets[s].wargs[p].color_counts = sockets[s].color_counts;
@@ -1824,6 +2244,10 @@ u32 monitor_l3_occupancy_lcas(void)
             sockets[s].wargs[p].core_helper = pairs[p].helper_vcpu;
             next += cntc;
         }
+
+        // a socket without pairs is reported as N/A
+        l2c_occ_pool_start(&sockets[s].pool, sockets[s].wargs, sockets[s].n_pairs);
+        sockets[s].n_pairs = sockets[s].pool.n_pairs;
     }
     bool first = true;
     u32 consec_shrink_high = 0;
@@ -1838,7 +2262,12 @@ u32 monitor_l3_occupancy_lcas(void)
         printf("\033[%uA", n_sockets + 2);
         printf("\33[2K\rWait: %u ms\n", (u32)(wait_time_us / 1000));
         u32 high = 0;
+        u32 scan_wait_us = wait_time_us;
+        i32 ids[LCAS_MAX_SOCKETS];
+        f64 raw[LCAS_MAX_SOCKETS] = {0};
+        bool valid[LCAS_MAX_SOCKETS] = {0};
         for (u32 s = 0; s < n_sockets; s++) {
+            ids[s] = sinfo.sockets[s].socket_id;
             if (sockets[s].n_pairs == 0) {
                 printf("\33[2K\rSocket %d: N/A\n", sinfo.sockets[s].socket_id);
                 continue;
@@ -1847,13 +2276,9 @@ u32 monitor_l3_occupancy_lcas(void)
             for (u32 c = 0; c < sockets[s].n_colors; c++)
                 sockets[s].tot_avg[c][0] = 0.0;
 
-            for (u32 p = 0; p < sockets[s].n_pairs; p++) {
-                sockets[s].wargs[p].wait_us = wait_time_us;
-                pthread_create(&sockets[s].threads[p], NULL, l2c_occ_worker,
-                               &sockets[s].wargs[p]);
-            }
             for (u32 p = 0; p < sockets[s].n_pairs; p++)
-                pthread_join(sockets[s].threads[p], NULL);
+                sockets[s].wargs[p].wait_us = wait_time_us;
+            l2c_occ_pool_run(&sockets[s].pool);
 
             f64 total_e = 0.0, total_l = 0.0;
             for (u32 c = 0; c < sockets[s].n_colors; c++) {
@@ -1871,6 +2296,8 @@ u32 monitor_l3_occupancy_lcas(void)
                 f64 alpha = hot > old ? lcas_alpha_rise : lcas_alpha_fall;
                 ewma[s] = alpha * old + (1.0 - alpha) * hot;
             }
+            raw[s] = hot;
+            valid[s] = true;
 
             if (ewma[s] >= 0.95)
                 high++;
@@ -1878,6 +2305,9 @@ u32 monitor_l3_occupancy_lcas(void)
             printf("\33[2K\rSocket %d: %6.2f%%\n", sinfo.sockets[s].socket_id,
                    ewma[s] * 100.0);
         }
+        WaitStats ws = wait_stats_take();
+        telem_note_waits(ws.n, ws.sum_ns, ws.max_ns);
+        telem_publish(TELEM_SOCKET, n_sockets, ids, raw, ewma, valid, scan_wait_us);
 
         if (!fix_wait && wait_time_us > 1000) {
             if (high == n_sockets)
@@ -1962,13 +2392,14 @@ u32 monitor_l3_occupancy_lcas(void)
             }
         }
         fflush(stdout);
+        tb_check();
         usleep(lcas_period_ms * 1000);
         first = false;
     }
 
 cleanup:
     for (u32 s = 0; s < n_sockets; s++) {
-        if (sockets[s].threads) free(sockets[s].threads);
+        l2c_occ_pool_stop(&sockets[s].pool);
         if (sockets[s].wargs) free(sockets[s].wargs);
         if (sockets[s].pairs) free(sockets[s].pairs);
         if (sockets[s].color_sets) {
@@ -1992,8 +2423,7 @@ cleanup:
 }
 
 #if !XP_EV_PCT
-static f64 measure_eviction_rate_single(EvSet *ev, helper_thread_ctrl *hctrl,
-                                        u64 cycles_per_us)
+static f64 measure_eviction_rate_single(EvSet *ev, helper_thread_ctrl *hctrl)
 {
     if (!ev || !hctrl)
         return 0.0;
@@ -2002,14 +2432,13 @@ static f64 measure_eviction_rate_single(EvSet *ev, helper_thread_ctrl *hctrl,
 
     flush_array(ev->addrs, ev->size);
     _lfence();
-    l3_evset_prime(ev, g_lats.l3_thresh);
+    l3_evset_prime(ev, l3_prime_thresh(ev));
     _lfence();
 
     if (wait_time_us) {
-        u64 now = _rdtsc();
-        u64 wait_cycles = (u64)wait_time_us * cycles_per_us;
-        while ((_rdtsc() - now) < wait_cycles)
-            ;
+        u64 end_tsc = _rdtsc() + tb_us_to_cyc(wait_time_us);
+        helper_thread_park(hctrl, end_tsc);
+        wait_until_tsc(end_tsc);
     }
 
     u32 n_evicted = 0;
@@ -2035,7 +2464,7 @@ static f64 measure_eviction_rate_single(EvSet *ev, helper_thread_ctrl *hctrl,
 
 #if XP_EV_PCT
 static f64 measure_eviction_rate_single_xp(EvSet *ev, helper_thread_ctrl *hctrl,
-                                           u64 cycles_per_us, u32 wait_us,
+                                           u32 wait_us,
                                            u32 manual_evict)
 {
     if (!ev || !hctrl)
@@ -2045,14 +2474,13 @@ static f64 measure_eviction_rate_single_xp(EvSet *ev, helper_thread_ctrl *hctrl,
 
     flush_array(ev->addrs, ev->size);
     _lfence();
-    l3_evset_prime(ev, g_lats.l3_thresh);
+    l3_evset_prime(ev, l3_prime_thresh(ev));
     _lfence();
 
     if (wait_us) {
-        u64 now = _rdtsc();
-        u64 wait_cycles = (u64)wait_us * cycles_per_us;
-        while ((_rdtsc() - now) < wait_cycles)
-            ;
+        u64 end_tsc = _rdtsc() + tb_us_to_cyc(wait_us);
+        helper_thread_park(hctrl, end_tsc);
+        wait_until_tsc(end_tsc);
     }
 
     if (manual_evict) {
@@ -2190,8 +2618,6 @@ u32 monitor_eviction_pct_single(u32 iterations)
         }
     }
 
-    u64 freq = get_cpu_freq_hz();
-    u64 cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
     const u32 total_secs = 90;
 
     f64 *ewma = _calloc(n_sockets, sizeof(f64));
@@ -2232,7 +2658,7 @@ u32 monitor_eviction_pct_single(u32 iterations)
                 continue;
             }
             set_cpu_affinity(main_vcpu[s]);
-            f64 rate = measure_eviction_rate_single_xp(ev, &hctrls[s], cycles_per_us, wait_us, manual);
+            f64 rate = measure_eviction_rate_single_xp(ev, &hctrls[s], wait_us, manual);
             if (sec == 0)
                 ewma[s] = rate;
             else {
@@ -2324,9 +2750,6 @@ u32 monitor_eviction_pct_single(u32 iterations)
         }
     }
 
-    u64 freq = get_cpu_freq_hz();
-    u64 cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     f64 *ewma = _calloc(n_sockets, sizeof(f64));
     f64 **hist = NULL, **raw = NULL;
     if (graph_mode && graph_type == GRAPH_EVRATE_TIME && iterations > 0) {
@@ -2353,7 +2776,7 @@ u32 monitor_eviction_pct_single(u32 iterations)
             }
 
             set_cpu_affinity(main_vcpu[s]);
-            f64 rate = measure_eviction_rate_single(ev, &hctrls[s], cycles_per_us);
+            f64 rate = measure_eviction_rate_single(ev, &hctrls[s]);
 
             if (first)
                 ewma[s] = rate;
@@ -2376,6 +2799,7 @@ u32 monitor_eviction_pct_single(u32 iterations)
         if (iterations && it + 1 >= iterations)
             break;
 
+        tb_check();
         usleep(lcas_period_ms * 1000);
         first = false;
         it++;
@@ -2439,8 +2863,8 @@ u32 monitor_eviction_rate_multi(u32 iterations)
         EvSet ***color_sets;
         u32 *color_counts;
         f64 **tot_avg;
-        pthread_t *threads;
         l2c_occ_worker_arg *wargs;
+        l2c_occ_pool pool;
         u32 n_ways;
     } cas_socket_ctx;
 
@@ -2524,9 +2948,6 @@ u32 monitor_eviction_rate_multi(u32 iterations)
     for (u32 s = 0; s < n_sockets; s++)
         sockets[s].n_ways = n_ways;
 
-    u64 freq = get_cpu_freq_hz();
-    u64 cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     for (u32 s = 0; s < n_sockets; s++) {
         socket_info_t *si = &sinfo.sockets[s];
         u32 max_pairs = si->vcpu_count / 2;
@@ -2556,10 +2977,9 @@ u32 monitor_eviction_rate_multi(u32 iterations)
         if (sockets[s].n_pairs == 0)
             continue;
 
-        sockets[s].threads = _calloc(sockets[s].n_pairs, sizeof(pthread_t));
         sockets[s].wargs = _calloc(sockets[s].n_pairs,
                                    sizeof(l2c_occ_worker_arg));
-        if (!sockets[s].threads || !sockets[s].wargs)
+        if (!sockets[s].wargs)
             goto cleanup;
 
         u32 base = sockets[s].n_colors / sockets[s].n_pairs;
@@ -2568,7 +2988,6 @@ u32 monitor_eviction_rate_multi(u32 iterations)
         for (u32 p = 0; p < sockets[s].n_pairs; p++) {
             u32 cntc = base + (p < extra ? 1 : 0);
             sockets[s].wargs[p].wait_us = wait_time_us;
-            sockets[s].wargs[p].cycles_per_us = cycles_per_us;
             sockets[s].wargs[p].iterations = 1;
             sockets[s].wargs[p].color_sets = sockets[s].color_sets;
             sockets[s].wargs[p].color_counts = sockets[s].color_counts;
@@ -2579,6 +2998,10 @@ u32 monitor_eviction_rate_multi(u32 iterations)
             sockets[s].wargs[p].core_helper = pairs[p].helper_vcpu;
             next += cntc;
         }
+
+        // a socket without pairs is reported as N/A
+        l2c_occ_pool_start(&sockets[s].pool, sockets[s].wargs, sockets[s].n_pairs);
+        sockets[s].n_pairs = sockets[s].pool.n_pairs;
     }
     bool first = true;
     u32 consec_shrink_high = 0;
@@ -2604,13 +3027,9 @@ u32 monitor_eviction_rate_multi(u32 iterations)
             for (u32 c = 0; c < sockets[s].n_colors; c++)
                 sockets[s].tot_avg[c][0] = 0.0;
 
-            for (u32 p = 0; p < sockets[s].n_pairs; p++) {
-                sockets[s].wargs[p].wait_us = wait_time_us;
-                pthread_create(&sockets[s].threads[p], NULL, l2c_occ_worker,
-                               &sockets[s].wargs[p]);
-            }
             for (u32 p = 0; p < sockets[s].n_pairs; p++)
-                pthread_join(sockets[s].threads[p], NULL);
+                sockets[s].wargs[p].wait_us = wait_time_us;
+            l2c_occ_pool_run(&sockets[s].pool);
 
             f64 total_e = 0.0, total_l = 0.0;
             for (u32 c = 0; c < sockets[s].n_colors; c++) {
@@ -2665,6 +3084,7 @@ u32 monitor_eviction_rate_multi(u32 iterations)
         if (iterations && it + 1 >= iterations)
             break;
 
+        tb_check();
         usleep(lcas_period_ms * 1000);
         first = false;
     }
@@ -2686,7 +3106,7 @@ cleanup:
     if (ewma) free(ewma);
     if (sockets) {
         for (u32 s = 0; s < n_sockets; s++) {
-            if (sockets[s].threads) free(sockets[s].threads);
+            l2c_occ_pool_stop(&sockets[s].pool);
             if (sockets[s].wargs) free(sockets[s].wargs);
             if (sockets[s].pairs) free(sockets[s].pairs);
             if (sockets[s].color_sets) {
@@ -2955,7 +3375,7 @@ i32 check_mem_remap_cheat(void)
                 if (hpa_l2_sib != t_hpa_l2_sib) {
                     n_remaped += 1;
                     remap_detected = true;
-                    printf(WRN "Remap occured. Reconstructing evset.\n");
+                    printf(WRN "Remap occured. Repairing evset.\n");
                     printf("  [%*u]: %p -> HPA 0x%lx [%s]\n", 
                             w, i, l2ev->addrs[i], hpa,
                             RED "Bad L2 SIB " RST);
@@ -2974,7 +3394,21 @@ i32 check_mem_remap_cheat(void)
                 puts(SUC "Correct detection by test_eviction");
         } 
 
+        if (remap_detected && !repair_evset(l2ev)) {
+            // shifted evsets follow the repaired one
+            for (u32 o = 1; o < PAGE_SIZE / l2_info.cl_size; o++) {
+                if (!l2evsets[o] || !l2evsets[o][0])
+                    continue;
+                free(l2evsets[o][0]->addrs);
+                free(l2evsets[o][0]);
+                l2evsets[o][0] = evset_shift(l2ev, o * l2_info.cl_size);
+            }
+            printf(SUC "Repaired evset in place | size: %u\n", l2ev->size);
+            remap_detected = false;
+        }
+
         if (remap_detected) {
+            printf(WRN "Repair failed. Reconstructing evset.\n");
             // cleanup prev evsets
             if (l2evsets) {
                 for (u32 o = 0; o < PAGE_SIZE / l2_info.cl_size; o++) {
@@ -3085,9 +3519,6 @@ void perf_prime_probe(void)
         }
     }
 
-    u64 cpu_freq_hz = get_cpu_freq_hz();
-    u64 cycles_per_us = cpu_freq_hz ? cpu_freq_hz / 1000000ULL : 2000ULL;
-
     f64 **dummy_avg = _calloc(n_colors, sizeof(f64*));
     for (u32 c = 0; c < n_colors; c++)
         dummy_avg[c] = _calloc(iterations, sizeof(f64));
@@ -3121,7 +3552,6 @@ void perf_prime_probe(void)
         u32 count = base + (i < extra ? 1 : 0);
 
         wargs[i].wait_us = wait_time_us;
-        wargs[i].cycles_per_us = cycles_per_us;
         wargs[i].iterations = iterations;
         wargs[i].color_sets = color_sets;
         wargs[i].color_counts = color_counts;
@@ -3342,9 +3772,8 @@ typedef struct {
     u32 total_sets;
     u32 n_pairs;
     f64 **tot_avg;
-    pthread_t *threads;
     l2c_occ_worker_arg *wargs;
-    u64 cycles_per_us;
+    l2c_occ_pool pool;
 } evrate_ctx_t;
 
 static bool init_evrate_ctx(evrate_ctx_t *ctx)
@@ -3392,9 +3821,6 @@ static bool init_evrate_ctx(evrate_ctx_t *ctx)
         }
     }
 
-    u64 freq = get_cpu_freq_hz();
-    ctx->cycles_per_us = freq ? freq / 1000000ULL : 2000ULL;
-
     i32 n_cores = n_system_cores();
     u32 req = g_config.num_threads ? g_config.num_threads : n_cores;
     if (req > (u32)n_cores) req = n_cores;
@@ -3403,9 +3829,8 @@ static bool init_evrate_ctx(evrate_ctx_t *ctx)
     if (ctx->n_pairs > ctx->n_colors) ctx->n_pairs = ctx->n_colors;
 
     ctx->tot_avg = _calloc(ctx->n_colors, sizeof(f64 *));
-    ctx->threads = _calloc(ctx->n_pairs, sizeof(pthread_t));
     ctx->wargs = _calloc(ctx->n_pairs, sizeof(l2c_occ_worker_arg));
-    if (!ctx->tot_avg || !ctx->threads || !ctx->wargs)
+    if (!ctx->tot_avg || !ctx->wargs)
         return false;
 
     for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -3420,7 +3845,6 @@ static bool init_evrate_ctx(evrate_ctx_t *ctx)
     for (u32 i = 0; i < ctx->n_pairs; i++) {
         u32 cnt = base + (i < extra ? 1 : 0);
         ctx->wargs[i].wait_us = 0;
-        ctx->wargs[i].cycles_per_us = ctx->cycles_per_us;
         ctx->wargs[i].iterations = 1;
         ctx->wargs[i].color_sets = ctx->color_sets;
         ctx->wargs[i].color_counts = ctx->color_counts;
@@ -3439,6 +3863,7 @@ static bool init_evrate_ctx(evrate_ctx_t *ctx)
 static void free_evrate_ctx(evrate_ctx_t *ctx)
 {
     if (!ctx) return;
+    l2c_occ_pool_stop(&ctx->pool);
     if (ctx->complex) {
         for (u32 off = 0; off < g_config.num_offsets; off++) {
             for (u32 c = 0; c < ctx->n_colors; c++) {
@@ -3473,8 +3898,6 @@ static void free_evrate_ctx(evrate_ctx_t *ctx)
                 free(ctx->tot_avg[c]);
         free(ctx->tot_avg);
     }
-    if (ctx->threads)
-        free(ctx->threads);
     if (ctx->wargs) {
         for (u32 i = 0; i < ctx->n_pairs; i++)
             if (ctx->wargs[i].prime_times)
@@ -3538,6 +3961,10 @@ u32 monitor_eviction_rate_wait(void)
         exit(EXIT_FAILURE);
     }
 
+    if (l2c_occ_pool_start(&ctx.pool, ctx.wargs, ctx.n_pairs)) {
+        free_evrate_ctx(&ctx);
+        return 0;
+    }
 
     u32 prime_time_us = 0;
     for (u32 i = 0; i < ctx.n_pairs; i++)
@@ -3567,10 +3994,7 @@ u32 monitor_eviction_rate_wait(void)
         u32 wait_us = slot * heatmap_time_step_us;
         for (u32 i = 0; i < ctx.n_pairs; i++)
             ctx.wargs[i].wait_us = wait_us;
-        for (u32 i = 0; i < ctx.n_pairs; i++)
-            pthread_create(&ctx.threads[i], NULL, l2c_occ_worker, &ctx.wargs[i]);
-        for (u32 i = 0; i < ctx.n_pairs; i++)
-            pthread_join(ctx.threads[i], NULL);
+        l2c_occ_pool_run(&ctx.pool);
 
         f64 total_evicted = 0.0;
         for (u32 c = 0; c < ctx.n_colors; c++)
@@ -3588,3 +4012,92 @@ u32 monitor_eviction_rate_wait(void)
     free_evrate_ctx(&ctx);
     return 1;
 }
+
+i32 tune_prime_pattern(u32 trials)
+{
+    if (g_config.num_l2_sets == 0)
+        g_config.num_l2_sets = _min(4, g_n_uncertain_l2_sets);
+    if (g_config.num_offsets == 0)
+        g_config.num_offsets = 4;
+    if (g_config.evsets_per_l2 == 0)
+        g_config.evsets_per_l2 = 1;
+
+    EvSet ****l3_complex = build_l3_evsets_para_gran(g_config.num_l2_sets,
+                                                    g_config.num_offsets, NULL);
+    if (!l3_complex) {
+        fprintf(stderr, ERR "failed to build eviction sets\n");
+        return EXIT_FAILURE;
+    }
+
+    u32 max_evsets = g_config.num_offsets * g_config.num_l2_sets * g_config.evsets_per_l2;
+    EvSet **evsets = _calloc(max_evsets, sizeof(EvSet*));
+    if (!evsets) {
+        free_evset_complex(l3_complex, g_config.num_offsets, g_config.num_l2_sets,
+                           g_config.evsets_per_l2);
+        return EXIT_FAILURE;
+    }
+
+    // the first scan pair, or with --vtop a non-smt pair as the socket monitors use
+    i32 main_vcpu = 0, helper_vcpu = 1;
+    if (vtop) {
+        cpu_topology_t *topo = get_vcpu_topo();
+        if (topo) {
+            multi_socket_info_t socket_info = get_socket_info(topo);
+            for (i32 s = 0; s < socket_info.n_sockets; s++) {
+                i32 mv = -1, hv = -1;
+                select_vcpu_pair(&socket_info.sockets[s], topo, &mv, &hv);
+                if (mv != -1 && hv != -1) {
+                    main_vcpu = mv;
+                    helper_vcpu = hv;
+                    break;
+                }
+            }
+            free(topo);
+        } else {
+            fprintf(stderr, WRN "failed to detect vcpu topology, proceeding w/o vtop\n");
+        }
+    }
+    if (verbose)
+        printf(V1 "tuning on vcpus %d (main) and %d (helper)\n", main_vcpu, helper_vcpu);
+
+    set_cpu_affinity(main_vcpu);
+    helper_thread_ctrl hctrl = {0};
+    if (start_helper_thread_pinned(&hctrl, helper_vcpu)) {
+        // no profile is written, so later runs keep the default
+        printf(WRN "failed to start the helper thread, keeping the default prime pattern\n");
+        free(evsets);
+        free_evset_complex(l3_complex, g_config.num_offsets, g_config.num_l2_sets,
+                           g_config.evsets_per_l2);
+        return EXIT_FAILURE;
+    }
+
+    u32 n_evsets = 0;
+    for (u32 off = 0; off < g_config.num_offsets; off++) {
+        for (u32 c = 0; c < g_config.num_l2_sets; c++) {
+            for (u32 e = 0; e < g_config.evsets_per_l2; e++) {
+                EvSet *ev = l3_complex[off][c] ? l3_complex[off][c][e] : NULL;
+                if (!ev || ev->size == 0 || ev->size > l3_info.n_ways)
+                    continue;
+                ev->build_conf->hctrl = &hctrl;
+                if (ev->build_conf->lower_ev && ev->build_conf->lower_ev->build_conf)
+                    ev->build_conf->lower_ev->build_conf->hctrl = &hctrl;
+                evsets[n_evsets++] = ev;
+            }
+        }
+    }
+
+    printf(INFO "Tuning the prime pattern on %u evsets, %u trials each\n", n_evsets, trials);
+    PrimePattern best = g_prime;
+    i32 ret = EXIT_FAILURE;
+    if (!prime_tune(evsets, n_evsets, trials, &best) &&
+        !prime_profile_save(PRIME_PROFILE_PATH, &best)) {
+        g_prime = best;
+        ret = EXIT_SUCCESS;
+    }
+
+    stop_helper_thread(&hctrl);
+    free(evsets);
+    free_evset_complex(l3_complex, g_config.num_offsets, g_config.num_l2_sets,
+                       g_config.evsets_per_l2);
+    return ret;
+}
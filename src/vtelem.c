@@ -0,0 +1,108 @@
+#include "../include/common.h"
+#include "../include/telemetry.h"
+#include <bits/getopt_ext.h>
+#include <stdlib.h>
+#include <string.h>
+
+static i32 print_usage_vtelem(char *progname)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Prints the hotness samples that vset (--live, --lcas) and vcolor (--vset)\n"
+           "publish with --telemetry.\n"
+           "\n"
+           "Options:\n"
+           "  -p, --path PATH         Telemetry segment [default: " TELEM_DEF_PATH "]\n"
+           "  -f, --follow            Print every new sample until interrupted\n"
+           "  -i, --interval US       Polling interval with --follow [default: 1000]\n"
+           "  --json                  One JSON object per sample instead of text\n"
+           "\n"
+           "  -h, --help              Display this help and exit\n",
+           progname);
+    return EXIT_SUCCESS;
+}
+
+static void print_sample(const TelemSample *s, bool json)
+{
+    const char *kind = s->kind == TELEM_SOCKET ? "socket" : "color";
+
+    if (json) {
+        printf("{\"ts_ns\":%lu,\"iter\":%lu,\"kind\":\"%s\",\"wait_us\":%u,"
+               "\"overshoot_avg_ns\":%u,\"overshoot_max_ns\":%u,\"entries\":[",
+               s->ts_ns, s->iter, kind, s->wait_us, s->over_avg_ns, s->over_max_ns);
+        for (u32 i = 0; i < s->n; i++)
+            printf("%s{\"id\":%d,\"valid\":%s,\"raw\":%.4f,\"ewma\":%.4f}", i ? "," : "",
+                   s->e[i].id, s->e[i].valid ? "true" : "false", s->e[i].raw,
+                   s->e[i].ewma);
+        printf("]}\n");
+    } else {
+        printf("iter %lu | ts %lu ns | wait %u us | overshoot avg %u max %u ns\n",
+               s->iter, s->ts_ns, s->wait_us, s->over_avg_ns, s->over_max_ns);
+        for (u32 i = 0; i < s->n; i++) {
+            if (!s->e[i].valid)
+                printf("  %s %3d: N/A\n", kind, s->e[i].id);
+            else
+                printf("  %s %3d: %6.2f%% (raw %6.2f%%)\n", kind, s->e[i].id,
+                       s->e[i].ewma * 100.0, s->e[i].raw * 100.0);
+        }
+    }
+    fflush(stdout);
+}
+
+i32 main(i32 argc, char *argv[])
+{
+    const char *path = TELEM_DEF_PATH;
+    bool follow = false, json = false;
+    u32 interval_us = 1000;
+
+    struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"path", required_argument, 0, 'p'},
+        {"follow", no_argument, 0, 'f'},
+        {"interval", required_argument, 0, 'i'},
+        {"json", no_argument, 0, 1},
+        {0, 0, 0, 0}
+    };
+
+    i32 opt;
+    while ((opt = getopt_long(argc, argv, "hp:fi:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            path = optarg;
+            break;
+        case 'f':
+            follow = true;
+            break;
+        case 'i':
+            interval_us = atoi(optarg);
+            break;
+        case 1:
+            json = true;
+            break;
+        default:
+            return print_usage_vtelem(argv[0]);
+        }
+    }
+
+    TelemReader r;
+    if (telem_reader_open(&r, path))
+        return EXIT_FAILURE;
+
+    TelemSample s;
+    u64 seen = 0;
+    do {
+        u64 n = telem_published(&r);
+        if (n != seen && !telem_read_latest(&r, &s)) {
+            print_sample(&s, json);
+            seen = n;
+        } else if (!follow) {
+            fprintf(stderr, ERR "nothing published to %s yet\n", path);
+            break;
+        }
+        if (follow)
+            usleep(interval_us);
+    } while (follow);
+
+    telem_reader_close(&r);
+    return seen ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -8,6 +8,10 @@ i32 debug_mod_fd;
 
 i32 start_debug_mod(void)
 {
+#if EVSIM
+    // simulated frames are known, no module needed
+    return 1;
+#endif
     debug_mod_fd = open(DEBUG_MOD_PATH, O_RDWR);
     if (debug_mod_fd < 0) {
         fprintf(stderr, ERR "Cannot open " DEBUG_MOD_PATH ". Is gpa_hpa loaded?\n");
@@ -20,6 +24,9 @@ i32 start_debug_mod(void)
 
 void stop_debug_mod(void)
 {
+#if EVSIM
+    return;
+#endif
     close(debug_mod_fd);
     if (verbose > 1)
         printf(V2 "closed debug module's file descriptor\n");
@@ -28,6 +35,9 @@ void stop_debug_mod(void)
 // VM user space address to phys addr used to back it on the host
 u64 va_to_hpa(void *va)
 {
+#if EVSIM
+    return sim_va_to_pa(va);
+#endif
     u64 offset = (unsigned long) va & 0xFFF;
     char buf[256];
     u64 pfn = va_to_pa(va);
@@ -66,6 +76,11 @@ u64 va_to_hpa(void *va)
 // https://repositories.lib.utexas.edu/items/78ed399f-0e5e-41fe-96e1-c12a5acf74d7
 // base seqs: https://repositories.lib.utexas.edu/server/api/core/bitstreams/96abbd10-744e-4c0e-9536-2f1a7378c27f/content
 u32 l3_slice_skx_20(i64 addr) {
+#if EVSIM
+    // keep debug slice checks consistent with the simulated hash
+    if (sim_conf()->hash != SIM_HASH_SKX20)
+        return sim_llc_slice((u64)addr);
+#endif
     static const u32 base_seq[256] = {
         0, 11, 2, 9, 7, 12, 5, 14, 1, 10, 3, 8, 6, 13, 4, 15,
         1, 10, 3, 8, 6, 13, 4, 15, 0, 11, 18, 17, 7, 12, 17, 18,